@@ -0,0 +1,286 @@
+#include "Benchmarks.h"
+#include "Tokenizer.h"
+#include <filesystem>
+#include <random>
+
+// Size of a std::map node holding pair<const int, double>:
+// three pointers and the color of the red-black tree plus the payload
+static constexpr size_t MAP_NODE_SIZE = 3 * sizeof(void*) + sizeof(int) + sizeof(pair<const int, double>);
+
+void BenchmarkPostings()
+{
+    const int document_count = 10'000'000;
+    const double word_probability = 0.1;
+    mt19937 generator(42);
+    bernoulli_distribution has_word(word_probability);
+    uniform_real_distribution<double> term_freq(0.0, 1.0);
+
+    map<int, double> map_postings;
+    PostingList postings;
+    for (int document_id = 0; document_id < document_count; ++document_id) {
+        if (has_word(generator)) {
+            const double freq = term_freq(generator);
+            map_postings.emplace(document_id, freq);
+            postings.Add(document_id, freq);
+        }
+    }
+    cout << "Postings: "s << postings.Size() << endl;
+    cout << "std::map memory: "s << map_postings.size() * MAP_NODE_SIZE / 1024 << " KiB"s << endl;
+    cout << "PostingList memory: "s << postings.MemoryUsage() / 1024 << " KiB"s << endl;
+
+    double map_checksum = 0.0;
+    {
+        LOG_DURATION("std::map scan");
+        for (const auto& [document_id, freq] : map_postings) {
+            map_checksum += document_id * freq;
+        }
+    }
+    cout << "Checksum: "s << map_checksum << endl;
+    for (const bool vectorized : { false, true }) {
+        EnableVectorizedDecoding(vectorized);
+        double checksum = 0.0;
+        {
+            LOG_DURATION(vectorized ? "PostingList vectorized scan" : "PostingList scalar scan");
+            postings.ForEach([&checksum](int document_id, double freq) {
+                checksum += document_id * freq;
+                });
+        }
+        cout << "Checksum: "s << checksum << endl;
+    }
+    EnableVectorizedDecoding(true);
+}
+
+// Random texts over a vocabulary of word_count words
+static vector<string> GenerateDocuments(int document_count, int word_count, int words_per_document)
+{
+    mt19937 generator(42);
+    uniform_int_distribution<int> word(0, word_count - 1);
+    vector<string> documents(document_count);
+    for (string& document : documents) {
+        for (int i = 0; i < words_per_document; ++i) {
+            document += (i > 0 ? " w"s : "w"s) + to_string(word(generator));
+        }
+    }
+    return documents;
+}
+
+void BenchmarkSnapshot()
+{
+    const int document_count = 200'000;
+    const vector<string> documents = GenerateDocuments(document_count, 50'000, 20);
+    const string path = (filesystem::temp_directory_path() / "search_server_benchmark.snapshot"s).string();
+    {
+        SearchServer search_server("w1 w2"s);
+        {
+            LOG_DURATION("AddDocument");
+            for (int id = 0; id < document_count; ++id) {
+                search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id % 10 });
+            }
+        }
+        LOG_DURATION("SaveSnapshot");
+        search_server.SaveSnapshot(path);
+    }
+    cout << "Snapshot size: "s << filesystem::file_size(path) / 1024 << " KiB"s << endl;
+    SearchServer search_server;
+    {
+        LOG_DURATION("LoadSnapshot");
+        search_server.LoadSnapshot(path);
+    }
+    cout << "Documents: "s << search_server.GetDocumentCount() << endl;
+    filesystem::remove(path);
+}
+
+void BenchmarkAddDocuments()
+{
+    const int document_count = 200'000;
+    const vector<string> texts = GenerateDocuments(document_count, 50'000, 20);
+    vector<DocumentInput> documents;
+    documents.reserve(document_count);
+    for (int id = 0; id < document_count; ++id) {
+        documents.push_back({ id, texts[id], DocumentStatus::ACTUAL, { id % 10 } });
+    }
+    {
+        SearchServer search_server("w1 w2"s);
+        LOG_DURATION("AddDocument");
+        for (const DocumentInput& document : documents) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+    }
+    {
+        SearchServer search_server("w1 w2"s);
+        LOG_DURATION("AddDocuments seq");
+        search_server.AddDocuments(execution::seq, documents);
+    }
+    SearchServer search_server("w1 w2"s);
+    LOG_DURATION("AddDocuments par");
+    search_server.AddDocuments(execution::par, documents);
+}
+
+void BenchmarkTokenizer()
+{
+    const vector<string> documents = GenerateDocuments(200'000, 50'000, 20);
+    vector<string_view> words;
+    for (const bool vectorized : { false, true }) {
+        EnableVectorizedTokenizer(vectorized);
+        size_t word_count = 0;
+        LOG_DURATION(vectorized ? "Tokenize vectorized" : "Tokenize scalar");
+        for (int repeat = 0; repeat < 10; ++repeat) {
+            for (const string& document : documents) {
+                words.clear();
+                Tokenize(document, words);
+                word_count += words.size();
+            }
+        }
+        cout << "Words: "s << word_count << endl;
+    }
+    EnableVectorizedTokenizer(true);
+}
+
+void BenchmarkQueryCache()
+{
+    const int document_count = 20'000;
+    const vector<string> documents = GenerateDocuments(document_count, 50'000, 20);
+    SearchServer search_server;
+    for (int id = 0; id < document_count; ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    // few distinct queries of 10 words, the first ones far more frequent
+    const vector<string> distinct_queries = GenerateDocuments(1000, 50'000, 10);
+    mt19937 generator(7);
+    geometric_distribution<int> query_index(0.01);
+    vector<string_view> queries;
+    for (int i = 0; i < 200'000; ++i) {
+        queries.push_back(distinct_queries[min(query_index(generator), 999)]);
+    }
+    for (const size_t capacity : { 0u, 1000u }) {
+        search_server.SetQueryCacheCapacity(capacity);
+        LOG_DURATION(capacity > 0 ? "MatchDocument with query cache" : "MatchDocument without query cache");
+        size_t matched = 0;
+        for (size_t i = 0; i < queries.size(); ++i) {
+            matched += get<0>(search_server.MatchDocument(queries[i], static_cast<int>(i % document_count))).size();
+        }
+        cout << "Matched words: "s << matched << endl;
+    }
+    search_server.SetQueryCacheCapacity(0);
+}
+
+void BenchmarkResultCache()
+{
+    const int document_count = 50'000;
+    const vector<string> documents = GenerateDocuments(document_count, 5'000, 20);
+    SearchServer search_server;
+    for (int id = 0; id < document_count; ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    // the first queries far more frequent, every tenth one a one-off
+    const vector<string> distinct_queries = GenerateDocuments(1000, 5'000, 3);
+    const vector<string> one_off_queries = GenerateDocuments(10'000, 5'000, 3);
+    mt19937 generator(7);
+    geometric_distribution<int> query_index(0.01);
+    vector<string_view> queries;
+    for (int i = 0; i < 100'000; ++i) {
+        queries.push_back(i % 10 == 0 ? one_off_queries[i / 10] : distinct_queries[min(query_index(generator), 999)]);
+    }
+    for (const size_t capacity : { 0u, 500u }) {
+        search_server.SetResultCacheCapacity(capacity);
+        LOG_DURATION(capacity > 0 ? "FindTopDocuments with result cache" : "FindTopDocuments without result cache");
+        size_t found = 0;
+        for (const string_view query : queries) {
+            found += search_server.FindTopDocuments(query).size();
+        }
+        cout << "Found: "s << found << endl;
+    }
+    const ResultCache::Stats stats = search_server.GetResultCacheStats();
+    cout << "Result cache hits: "s << stats.hits << ", misses: "s << stats.misses << endl;
+    search_server.SetResultCacheCapacity(0);
+}
+
+void BenchmarkConcurrentQueries()
+{
+    const int document_count = 50'000;
+    const int queries_per_reader = 2'000;
+    const vector<string> documents = GenerateDocuments(document_count, 5'000, 20);
+    const vector<string> queries = GenerateDocuments(queries_per_reader, 5'000, 3);
+    SearchServer search_server;
+    for (int id = 0; id < document_count; ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    const int max_reader_count = static_cast<int>(max(thread::hardware_concurrency(), 4u));
+    for (int reader_count = 1; reader_count <= max_reader_count; reader_count *= 2) {
+        for (const bool with_writer : { false, true }) {
+            // the writer adds and removes documents until the readers are done
+            atomic<bool> reading = true;
+            int write_count = 0;
+            thread writer;
+            if (with_writer) {
+                writer = thread([&]() {
+                    for (int id = document_count; reading; ++id, ++write_count) {
+                        search_server.AddDocument(id, documents[id % document_count], DocumentStatus::ACTUAL, { 1 });
+                        search_server.RemoveDocument(id);
+                    }
+                    });
+            }
+            const auto start = chrono::steady_clock::now();
+            vector<thread> readers;
+            atomic<size_t> found = 0;
+            for (int reader = 0; reader < reader_count; ++reader) {
+                readers.emplace_back([&, reader]() {
+                    for (int i = 0; i < queries_per_reader; ++i) {
+                        found += search_server.FindTopDocuments(queries[(reader + i) % queries_per_reader]).size();
+                    }
+                    });
+            }
+            for (thread& reader : readers) {
+                reader.join();
+            }
+            const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            reading = false;
+            if (writer.joinable()) {
+                writer.join();
+            }
+            cout << reader_count << " readers"s << (with_writer ? " and a writer"s : ""s) << ": "s
+                << static_cast<int>(reader_count * queries_per_reader / seconds) << " queries/s"s;
+            if (with_writer) {
+                cout << ", "s << static_cast<int>(write_count / seconds) << " writes/s"s;
+            }
+            cout << endl;
+        }
+    }
+}
+
+void BenchmarkWriteAheadLog()
+{
+    const int document_count = 20'000;
+    const int writer_count = 8;
+    const vector<string> documents = GenerateDocuments(document_count, 50'000, 20);
+    const string path = (filesystem::temp_directory_path() / "search_server_benchmark.wal"s).string();
+    const vector<pair<string, optional<WriteAheadLog::SyncMode>>> modes = {
+        { "off"s, nullopt },
+        { "every commit"s, WriteAheadLog::SyncMode::EVERY_COMMIT },
+        { "periodic"s, WriteAheadLog::SyncMode::PERIODIC },
+        { "no fsync"s, WriteAheadLog::SyncMode::NONE },
+    };
+    for (const auto& [name, mode] : modes) {
+        filesystem::remove(path);
+        SearchServer search_server;
+        if (mode) {
+            search_server.OpenWriteAheadLog(path, *mode);
+        }
+        // the writers commit concurrently, so the log can group their records
+        const auto start = chrono::steady_clock::now();
+        vector<thread> writers;
+        for (int writer = 0; writer < writer_count; ++writer) {
+            writers.emplace_back([&, writer]() {
+                for (int id = writer; id < document_count; id += writer_count) {
+                    search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id % 10 });
+                }
+                });
+        }
+        for (thread& writer : writers) {
+            writer.join();
+        }
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "WAL "s << name << ": "s << static_cast<int>(document_count / seconds) << " documents/s"s << endl;
+    }
+    filesystem::remove(path);
+}
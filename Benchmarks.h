@@ -0,0 +1,19 @@
+#pragma once
+#include "Search_Server.h"
+// Compares compressed postings with node-based std::map postings:
+// memory footprint and the time of a full scan
+void BenchmarkPostings();
+// Compares loading a snapshot with adding the same documents one by one
+void BenchmarkSnapshot();
+// Ingest throughput without a write-ahead log and with it in every sync mode
+void BenchmarkWriteAheadLog();
+// Compares AddDocument one by one with the sequential and parallel AddDocuments
+void BenchmarkAddDocuments();
+// Compares the vectorized tokenizer with the scalar one
+void BenchmarkTokenizer();
+// Repeated queries with the query cache off and on
+void BenchmarkQueryCache();
+// Repeated searches with the result cache off and on
+void BenchmarkResultCache();
+// Query throughput of a growing number of reader threads, alone and next to a writer
+void BenchmarkConcurrentQueries();
@@ -0,0 +1,390 @@
+#include "Bitmap.h"
+#include "Cpu_features.h"
+#if defined(SEARCH_SERVER_X86)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int PopCount(uint64_t bits)
+{
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt64(bits));
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+static uint32_t CountBits(const uint64_t* words)
+{
+    uint32_t count = 0;
+    for (size_t word = 0; word < Bitmap::BITSET_WORDS; ++word) {
+        count += PopCount(words[word]);
+    }
+    return count;
+}
+
+enum class BitOperation {
+    OR,
+    AND,
+    AND_NOT
+};
+
+static void CombineScalar(BitOperation operation, uint64_t* words, const uint64_t* other_words)
+{
+    for (size_t word = 0; word < Bitmap::BITSET_WORDS; ++word) {
+        switch (operation) {
+        case BitOperation::OR:
+            words[word] |= other_words[word];
+            break;
+        case BitOperation::AND:
+            words[word] &= other_words[word];
+            break;
+        case BitOperation::AND_NOT:
+            words[word] &= ~other_words[word];
+            break;
+        }
+    }
+}
+
+#if defined(SEARCH_SERVER_X86)
+SEARCH_SERVER_TARGET("avx2")
+static void CombineAvx2(BitOperation operation, uint64_t* words, const uint64_t* other_words)
+{
+    for (size_t word = 0; word < Bitmap::BITSET_WORDS; word += 4) {
+        __m256i* destination = reinterpret_cast<__m256i*>(words + word);
+        const __m256i lhs = _mm256_loadu_si256(destination);
+        const __m256i rhs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(other_words + word));
+        switch (operation) {
+        case BitOperation::OR:
+            _mm256_storeu_si256(destination, _mm256_or_si256(lhs, rhs));
+            break;
+        case BitOperation::AND:
+            _mm256_storeu_si256(destination, _mm256_and_si256(lhs, rhs));
+            break;
+        case BitOperation::AND_NOT:
+            _mm256_storeu_si256(destination, _mm256_andnot_si256(rhs, lhs));
+            break;
+        }
+    }
+}
+#endif
+
+// Combines two bitsets word by word, returns the cardinality of the result
+static uint32_t Combine(BitOperation operation, uint64_t* words, const uint64_t* other_words)
+{
+#if defined(SEARCH_SERVER_X86)
+    if (GetCpuFeatures().avx2) {
+        CombineAvx2(operation, words, other_words);
+        return CountBits(words);
+    }
+#endif
+    CombineScalar(operation, words, other_words);
+    return CountBits(words);
+}
+
+int Bitmap::CountTrailingZeros(uint64_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+bool Bitmap::Container::Contains(uint16_t low) const
+{
+    if (IsBitset()) {
+        return (bits[low / 64] >> (low % 64)) & 1;
+    }
+    return binary_search(array.begin(), array.end(), low);
+}
+
+void Bitmap::Container::ToBitset()
+{
+    bits.assign(BITSET_WORDS, 0);
+    for (const uint16_t low : array) {
+        bits[low / 64] |= uint64_t{ 1 } << (low % 64);
+    }
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void Bitmap::Container::ToArray()
+{
+    array.clear();
+    array.reserve(cardinality);
+    for (size_t word = 0; word < BITSET_WORDS; ++word) {
+        for (uint64_t word_bits = bits[word]; word_bits != 0; word_bits &= word_bits - 1) {
+            array.push_back(static_cast<uint16_t>(word * 64 + CountTrailingZeros(word_bits)));
+        }
+    }
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+void Bitmap::Container::Normalize()
+{
+    if (IsBitset() && cardinality <= ARRAY_LIMIT) {
+        ToArray();
+    }
+    else if (!IsBitset() && array.size() > ARRAY_LIMIT) {
+        ToBitset();
+    }
+}
+
+Bitmap::Container& Bitmap::MakeUnique(shared_ptr<Container>& container)
+{
+    if (container.use_count() > 1) {
+        container = make_shared<Container>(*container);
+    }
+    return *container;
+}
+
+vector<shared_ptr<Bitmap::Container>>::iterator Bitmap::LowerBound(uint16_t key)
+{
+    return lower_bound(containers_.begin(), containers_.end(), key, [](const shared_ptr<Container>& container, uint16_t key) {
+        return container->key < key;
+        });
+}
+
+void Bitmap::Add(uint32_t id)
+{
+    const uint16_t key = static_cast<uint16_t>(id >> 16);
+    const uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+    auto it = containers_.end();
+    if (containers_.empty() || containers_.back()->key < key) {
+        containers_.push_back(make_shared<Container>());
+        containers_.back()->key = key;
+        it = prev(containers_.end());
+    }
+    else {
+        it = LowerBound(key);
+        if ((*it)->key != key) {
+            it = containers_.insert(it, make_shared<Container>());
+            (*it)->key = key;
+        }
+    }
+    Container& container = MakeUnique(*it);
+    if (container.IsBitset()) {
+        uint64_t& word = container.bits[low / 64];
+        const uint64_t bit = uint64_t{ 1 } << (low % 64);
+        if (!(word & bit)) {
+            word |= bit;
+            ++container.cardinality;
+        }
+        return;
+    }
+    if (container.array.empty() || container.array.back() < low) {
+        container.array.push_back(low);
+    }
+    else {
+        const auto position = lower_bound(container.array.begin(), container.array.end(), low);
+        if (*position == low) {
+            return;
+        }
+        container.array.insert(position, low);
+    }
+    container.cardinality = static_cast<uint32_t>(container.array.size());
+    container.Normalize();
+}
+
+void Bitmap::Remove(uint32_t id)
+{
+    const uint16_t key = static_cast<uint16_t>(id >> 16);
+    const uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+    const auto it = LowerBound(key);
+    if (it == containers_.end() || (*it)->key != key || !(*it)->Contains(low)) {
+        return;
+    }
+    if ((*it)->cardinality == 1) {
+        containers_.erase(it);
+        return;
+    }
+    Container& container = MakeUnique(*it);
+    if (container.IsBitset()) {
+        container.bits[low / 64] &= ~(uint64_t{ 1 } << (low % 64));
+    }
+    else {
+        container.array.erase(lower_bound(container.array.begin(), container.array.end(), low));
+    }
+    --container.cardinality;
+    container.Normalize();
+}
+
+bool Bitmap::Contains(uint32_t id) const
+{
+    const Container* container = FindContainer(static_cast<uint16_t>(id >> 16));
+    return container != nullptr && container->Contains(static_cast<uint16_t>(id & 0xFFFF));
+}
+
+size_t Bitmap::Cardinality() const
+{
+    size_t cardinality = 0;
+    for (const shared_ptr<Container>& container : containers_) {
+        cardinality += container->cardinality;
+    }
+    return cardinality;
+}
+
+size_t Bitmap::Cardinality(uint32_t first, uint32_t end) const
+{
+    size_t cardinality = 0;
+    for (const shared_ptr<Container>& shared_container : containers_) {
+        const Container& container = *shared_container;
+        const uint32_t container_first = static_cast<uint32_t>(container.key) << 16;
+        const uint64_t container_end = uint64_t{ container_first } + (1 << 16);
+        if (container_end <= first || container_first >= end) {
+            continue;
+        }
+        if (container_first >= first && container_end <= end) {
+            cardinality += container.cardinality;
+            continue;
+        }
+        const uint32_t low_first = first > container_first ? first - container_first : 0;
+        const uint32_t low_end = static_cast<uint32_t>(min<uint64_t>(end - container_first, 1 << 16));
+        if (container.IsBitset()) {
+            for (uint32_t low = low_first; low < low_end; ++low) {
+                cardinality += (container.bits[low / 64] >> (low % 64)) & 1;
+            }
+        }
+        else {
+            cardinality += lower_bound(container.array.begin(), container.array.end(), low_end)
+                - lower_bound(container.array.begin(), container.array.end(), low_first);
+        }
+    }
+    return cardinality;
+}
+
+Bitmap& Bitmap::operator|=(const Bitmap& other)
+{
+    vector<shared_ptr<Container>> containers;
+    containers.reserve(containers_.size() + other.containers_.size());
+    auto it = containers_.begin();
+    auto other_it = other.containers_.begin();
+    while (it != containers_.end() || other_it != other.containers_.end()) {
+        // a container of one side only is shared with the result
+        if (other_it == other.containers_.end() || (it != containers_.end() && (*it)->key < (*other_it)->key)) {
+            containers.push_back(move(*it++));
+            continue;
+        }
+        if (it == containers_.end() || (*other_it)->key < (*it)->key) {
+            containers.push_back(*other_it++);
+            continue;
+        }
+        shared_ptr<Container> shared_container = move(*it++);
+        Container& container = MakeUnique(shared_container);
+        const Container& other_container = **other_it++;
+        if (!container.IsBitset() && !other_container.IsBitset()) {
+            vector<uint16_t> array;
+            array.reserve(container.array.size() + other_container.array.size());
+            set_union(container.array.begin(), container.array.end(), other_container.array.begin(), other_container.array.end(), back_inserter(array));
+            container.array = move(array);
+            container.cardinality = static_cast<uint32_t>(container.array.size());
+        }
+        else {
+            if (!container.IsBitset()) {
+                container.ToBitset();
+            }
+            if (other_container.IsBitset()) {
+                container.cardinality = Combine(BitOperation::OR, container.bits.data(), other_container.bits.data());
+            }
+            else {
+                for (const uint16_t low : other_container.array) {
+                    container.bits[low / 64] |= uint64_t{ 1 } << (low % 64);
+                }
+                container.cardinality = CountBits(container.bits.data());
+            }
+        }
+        container.Normalize();
+        containers.push_back(move(shared_container));
+    }
+    containers_ = move(containers);
+    return *this;
+}
+
+Bitmap& Bitmap::operator&=(const Bitmap& other)
+{
+    vector<shared_ptr<Container>> containers;
+    for (shared_ptr<Container>& shared_container : containers_) {
+        const Container* other_container = other.FindContainer(shared_container->key);
+        if (other_container == nullptr) {
+            continue;
+        }
+        Container& container = MakeUnique(shared_container);
+        if (container.IsBitset() && other_container->IsBitset()) {
+            container.cardinality = Combine(BitOperation::AND, container.bits.data(), other_container->bits.data());
+        }
+        else {
+            // the result is no larger than the array operand
+            const Container& array_container = container.IsBitset() ? *other_container : container;
+            const Container& lookup_container = container.IsBitset() ? container : *other_container;
+            vector<uint16_t> array;
+            copy_if(array_container.array.begin(), array_container.array.end(), back_inserter(array), [&](uint16_t low) {
+                return lookup_container.Contains(low);
+                });
+            container.bits.clear();
+            container.array = move(array);
+            container.cardinality = static_cast<uint32_t>(container.array.size());
+        }
+        if (container.cardinality > 0) {
+            container.Normalize();
+            containers.push_back(move(shared_container));
+        }
+    }
+    containers_ = move(containers);
+    return *this;
+}
+
+Bitmap& Bitmap::operator-=(const Bitmap& other)
+{
+    vector<shared_ptr<Container>> containers;
+    for (shared_ptr<Container>& shared_container : containers_) {
+        const Container* other_container = other.FindContainer(shared_container->key);
+        if (other_container != nullptr) {
+            Container& container = MakeUnique(shared_container);
+            if (!container.IsBitset()) {
+                container.array.erase(remove_if(container.array.begin(), container.array.end(), [&](uint16_t low) {
+                    return other_container->Contains(low);
+                    }), container.array.end());
+                container.cardinality = static_cast<uint32_t>(container.array.size());
+            }
+            else if (other_container->IsBitset()) {
+                container.cardinality = Combine(BitOperation::AND_NOT, container.bits.data(), other_container->bits.data());
+            }
+            else {
+                for (const uint16_t low : other_container->array) {
+                    container.bits[low / 64] &= ~(uint64_t{ 1 } << (low % 64));
+                }
+                container.cardinality = CountBits(container.bits.data());
+            }
+            if (container.cardinality == 0) {
+                continue;
+            }
+            container.Normalize();
+        }
+        containers.push_back(move(shared_container));
+    }
+    containers_ = move(containers);
+    return *this;
+}
+
+size_t Bitmap::MemoryUsage() const
+{
+    size_t memory = sizeof(*this) + containers_.capacity() * sizeof(shared_ptr<Container>);
+    for (const shared_ptr<Container>& container : containers_) {
+        memory += sizeof(Container) + container->array.capacity() * sizeof(uint16_t) + container->bits.capacity() * sizeof(uint64_t);
+    }
+    return memory;
+}
+
+const Bitmap::Container* Bitmap::FindContainer(uint16_t key) const
+{
+    const auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const shared_ptr<Container>& container, uint16_t key) {
+        return container->key < key;
+        });
+    return it != containers_.end() && (*it)->key == key ? it->get() : nullptr;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// Compressed set of document ids in the Roaring layout: ids are grouped by
+// their high 16 bits into containers. A container keeps the low 16 bits as a
+// sorted array while it holds at most ARRAY_LIMIT ids, and as a bitset of
+// 2^16 bits otherwise. Set operations on two bitsets are vectorized.
+// Copies share the containers, changing one copies it first.
+class Bitmap {
+public:
+    inline static constexpr size_t ARRAY_LIMIT = 4096;
+    inline static constexpr size_t BITSET_WORDS = (1 << 16) / 64;
+
+    // Adding ids in ascending order appends without searching
+    void Add(uint32_t id);
+    void Remove(uint32_t id);
+    bool Contains(uint32_t id) const;
+
+    size_t Cardinality() const;
+    // Number of ids in [first, end)
+    size_t Cardinality(uint32_t first, uint32_t end) const;
+
+    bool Empty() const
+    {
+        return containers_.empty();
+    }
+
+    Bitmap& operator|=(const Bitmap& other);
+    Bitmap& operator&=(const Bitmap& other);
+    // Removes the ids of other
+    Bitmap& operator-=(const Bitmap& other);
+
+    // Calls func(id) for every id in ascending order
+    template <typename Func>
+    void ForEach(Func func) const
+    {
+        for (const shared_ptr<Container>& shared_container : containers_) {
+            const Container& container = *shared_container;
+            const uint32_t high = static_cast<uint32_t>(container.key) << 16;
+            if (container.IsBitset()) {
+                for (size_t word = 0; word < BITSET_WORDS; ++word) {
+                    for (uint64_t bits = container.bits[word]; bits != 0; bits &= bits - 1) {
+                        func(high | static_cast<uint32_t>(word * 64 + CountTrailingZeros(bits)));
+                    }
+                }
+            }
+            else {
+                for (const uint16_t low : container.array) {
+                    func(high | low);
+                }
+            }
+        }
+    }
+
+    size_t MemoryUsage() const;
+
+    // Reads the set 64 ids at a time. Reading in ascending order walks every
+    // container once, a smaller first_id starts over.
+    class WordReader {
+    public:
+        explicit WordReader(const Bitmap& bitmap)
+            : bitmap_(&bitmap)
+        {
+        }
+
+        // Bit i is set if first_id + i is in the set, first_id is a multiple of 64
+        uint64_t Read(uint32_t first_id)
+        {
+            if (first_id < last_id_) {
+                container_index_ = 0;
+                position_ = 0;
+            }
+            last_id_ = first_id;
+            const vector<shared_ptr<Container>>& containers = bitmap_->containers_;
+            const uint16_t key = static_cast<uint16_t>(first_id >> 16);
+            while (container_index_ < containers.size() && containers[container_index_]->key < key) {
+                ++container_index_;
+                position_ = 0;
+            }
+            if (container_index_ == containers.size() || containers[container_index_]->key != key) {
+                return 0;
+            }
+            const Container& container = *containers[container_index_];
+            const uint16_t first_low = static_cast<uint16_t>(first_id & 0xFFFF);
+            if (container.IsBitset()) {
+                return container.bits[first_low / 64];
+            }
+            const vector<uint16_t>& array = container.array;
+            while (position_ < array.size() && array[position_] < first_low) {
+                ++position_;
+            }
+            uint64_t word = 0;
+            for (; position_ < array.size() && array[position_] - first_low < 64; ++position_) {
+                word |= uint64_t{ 1 } << (array[position_] - first_low);
+            }
+            return word;
+        }
+
+    private:
+        const Bitmap* bitmap_;
+        size_t container_index_ = 0;
+        size_t position_ = 0;
+        uint32_t last_id_ = 0;
+    };
+
+private:
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        vector<uint16_t> array;
+        vector<uint64_t> bits;
+
+        bool IsBitset() const
+        {
+            return !bits.empty();
+        }
+
+        bool Contains(uint16_t low) const;
+        void ToBitset();
+        void ToArray();
+        // Switches to the representation that suits the cardinality
+        void Normalize();
+    };
+    // sorted by key
+    vector<shared_ptr<Container>> containers_;
+
+    static int CountTrailingZeros(uint64_t bits);
+    const Container* FindContainer(uint16_t key) const;
+    // Position of the first container with a key not less than key
+    vector<shared_ptr<Container>>::iterator LowerBound(uint16_t key);
+    // The container unless another copy shares it, then a copy of it
+    static Container& MakeUnique(shared_ptr<Container>& container);
+};
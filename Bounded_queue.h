@@ -0,0 +1,75 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// Queue between two pipeline stages holding at most capacity items: Push blocks
+// while it is full, so a fast producer waits for a slow consumer. Close ends
+// the stream, the consumer still gets the queued items; Cancel also drops them
+// and makes both sides stop.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(capacity)
+    {
+        if (capacity == 0) {
+            throw invalid_argument("queue capacity must be positive"s);
+        }
+    }
+
+    // Returns false when the queue was cancelled and the item is dropped
+    bool Push(T item)
+    {
+        unique_lock<mutex> lock(mutex_);
+        not_full_.wait(lock, [&]() {
+            return items_.size() < capacity_ || cancelled_;
+            });
+        if (cancelled_) {
+            return false;
+        }
+        items_.push_back(move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // nullopt once the queue is closed and empty or cancelled
+    optional<T> Pop()
+    {
+        unique_lock<mutex> lock(mutex_);
+        not_empty_.wait(lock, [&]() {
+            return !items_.empty() || closed_ || cancelled_;
+            });
+        if (cancelled_ || items_.empty()) {
+            return nullopt;
+        }
+        T item = move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return item;
+    }
+
+    void Close()
+    {
+        lock_guard<mutex> guard(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+    void Cancel()
+    {
+        lock_guard<mutex> guard(mutex_);
+        cancelled_ = true;
+        items_.clear();
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+private:
+    const size_t capacity_;
+    mutex mutex_;
+    condition_variable not_full_;
+    condition_variable not_empty_;
+    deque<T> items_;
+    bool closed_ = false;
+    bool cancelled_ = false;
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include "headers.h"
+#include "Flat_hash_map.h"
+using namespace std;
+
+template <typename Key, typename Value>
+class ConcurrentMap {
+public:
+    static_assert(is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
+
+    struct Access {
+        lock_guard<mutex> guard;
+        Value& ref_to_value;
+    };
+
+    explicit ConcurrentMap(size_t bucket_count)
+        : buckets_(bucket_count)
+    {
+    }
+
+    Access operator[](const Key& key)
+    {
+        Bucket& bucket = GetBucket(key);
+        return { lock_guard<mutex>(bucket.bucket_mutex), bucket.data[key] };
+    }
+
+    void Erase(const Key& key)
+    {
+        Bucket& bucket = GetBucket(key);
+        lock_guard<mutex> guard(bucket.bucket_mutex);
+        bucket.data.erase(key);
+    }
+
+    // Calls func(bucket_index, bucket_data) for every bucket in parallel
+    template <typename Func>
+    void ForEachBucket(const execution::parallel_policy& par, Func func)
+    {
+        vector<size_t> indexes(buckets_.size());
+        iota(indexes.begin(), indexes.end(), 0);
+        for_each(par, indexes.begin(), indexes.end(), [&](size_t index) {
+            lock_guard<mutex> guard(buckets_[index].bucket_mutex);
+            func(index, as_const(buckets_[index].data));
+            });
+    }
+
+    size_t BucketCount() const
+    {
+        return buckets_.size();
+    }
+
+    map<Key, Value> BuildOrdinaryMap()
+    {
+        map<Key, Value> result;
+        for (Bucket& bucket : buckets_) {
+            lock_guard<mutex> guard(bucket.bucket_mutex);
+            result.insert(bucket.data.begin(), bucket.data.end());
+        }
+        return result;
+    }
+
+private:
+    struct Bucket {
+        mutex bucket_mutex;
+        FlatHashMap<Key, Value> data;
+    };
+    vector<Bucket> buckets_;
+
+    Bucket& GetBucket(const Key& key)
+    {
+        return buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+    }
+};
@@ -0,0 +1,410 @@
+#include "Corpus_ingest.h"
+#include "Bounded_queue.h"
+#include <charconv>
+#include <fstream>
+
+namespace {
+
+// Lines of one block and the documents parsed from them
+struct CorpusBatch {
+    string lines;
+    StringPool pool;
+    vector<DocumentInput> documents;
+};
+
+DocumentStatus ParseDocumentStatus(string_view text)
+{
+    static const array<pair<string_view, DocumentStatus>, DOCUMENT_STATUS_COUNT> statuses = { {
+        { "ACTUAL"sv, DocumentStatus::ACTUAL },
+        { "IRRELEVANT"sv, DocumentStatus::IRRELEVANT },
+        { "BANNED"sv, DocumentStatus::BANNED },
+        { "REMOVED"sv, DocumentStatus::REMOVED },
+    } };
+    for (const auto& [name, status] : statuses) {
+        if (name == text) {
+            return status;
+        }
+    }
+    throw invalid_argument("unknown document status "s + string(text));
+}
+
+// Parses an int at the start of text and removes it
+int ConsumeInt(string_view& text)
+{
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (error != errc()) {
+        throw invalid_argument("wrong number"s);
+    }
+    text.remove_prefix(end - text.data());
+    return value;
+}
+
+int ParseInt(string_view text)
+{
+    const int value = ConsumeInt(text);
+    if (!text.empty()) {
+        throw invalid_argument("wrong number"s);
+    }
+    return value;
+}
+
+DocumentInput ParseTsvLine(string_view line)
+{
+    array<string_view, 3> fields;
+    for (string_view& field : fields) {
+        const size_t tab = line.find('\t');
+        if (tab == line.npos) {
+            throw invalid_argument("a line must have 4 tab separated fields"s);
+        }
+        field = line.substr(0, tab);
+        line.remove_prefix(tab + 1);
+    }
+    DocumentInput document;
+    document.id = ParseInt(fields[0]);
+    document.status = ParseDocumentStatus(fields[1]);
+    for (string_view ratings = fields[2]; !ratings.empty();) {
+        const size_t space = ratings.find(' ');
+        if (space != 0) {
+            document.ratings.push_back(ParseInt(ratings.substr(0, space)));
+        }
+        ratings.remove_prefix(space == ratings.npos ? ratings.size() : space + 1);
+    }
+    document.text = line;
+    return document;
+}
+
+void SkipJsonSpaces(string_view& text)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+}
+
+void ConsumeJsonChar(string_view& text, char c)
+{
+    SkipJsonSpaces(text);
+    if (text.empty() || text.front() != c) {
+        throw invalid_argument("expected '"s + c + "' in json"s);
+    }
+    text.remove_prefix(1);
+}
+
+bool ConsumeJsonCharIf(string_view& text, char c)
+{
+    SkipJsonSpaces(text);
+    if (!text.empty() && text.front() == c) {
+        text.remove_prefix(1);
+        return true;
+    }
+    return false;
+}
+
+uint32_t ConsumeJsonHex(string_view& text)
+{
+    uint32_t code = 0;
+    if (text.size() < 4 || from_chars(text.data(), text.data() + 4, code, 16).ptr != text.data() + 4) {
+        throw invalid_argument("wrong \\u escape in json"s);
+    }
+    text.remove_prefix(4);
+    return code;
+}
+
+void AppendUtf8(string& out, uint32_t code)
+{
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    }
+    else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | code >> 6);
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | code >> 12);
+        out += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else {
+        out += static_cast<char>(0xF0 | code >> 18);
+        out += static_cast<char>(0x80 | (code >> 12 & 0x3F));
+        out += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+// A string without escapes is returned as a view of the line, an escaped one is stored in the pool
+string_view ConsumeJsonString(string_view& text, StringPool& pool)
+{
+    ConsumeJsonChar(text, '"');
+    const size_t end = text.find_first_of("\"\\"sv);
+    if (end == text.npos) {
+        throw invalid_argument("unterminated json string"s);
+    }
+    if (text[end] == '"') {
+        const string_view result = text.substr(0, end);
+        text.remove_prefix(end + 1);
+        return result;
+    }
+    string result(text.substr(0, end));
+    text.remove_prefix(end);
+    while (true) {
+        if (text.empty()) {
+            throw invalid_argument("unterminated json string"s);
+        }
+        const char c = text.front();
+        text.remove_prefix(1);
+        if (c == '"') {
+            return pool.Store(result);
+        }
+        if (c != '\\') {
+            result += c;
+            continue;
+        }
+        if (text.empty()) {
+            throw invalid_argument("unterminated json string"s);
+        }
+        const char escaped = text.front();
+        text.remove_prefix(1);
+        switch (escaped) {
+        case '"': case '\\': case '/': result += escaped; break;
+        case 'b': result += '\b'; break;
+        case 'f': result += '\f'; break;
+        case 'n': result += '\n'; break;
+        case 'r': result += '\r'; break;
+        case 't': result += '\t'; break;
+        case 'u': {
+            uint32_t code = ConsumeJsonHex(text);
+            if (code >= 0xD800 && code < 0xDC00) {
+                // a surrogate pair
+                if (text.size() < 2 || text[0] != '\\' || text[1] != 'u') {
+                    throw invalid_argument("unpaired surrogate in json"s);
+                }
+                text.remove_prefix(2);
+                const uint32_t low = ConsumeJsonHex(text);
+                if (low < 0xDC00 || low >= 0xE000) {
+                    throw invalid_argument("unpaired surrogate in json"s);
+                }
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (code >= 0xDC00 && code < 0xE000) {
+                throw invalid_argument("unpaired surrogate in json"s);
+            }
+            AppendUtf8(result, code);
+            break;
+        }
+        default:
+            throw invalid_argument("wrong escape in json"s);
+        }
+    }
+}
+
+int ConsumeJsonInt(string_view& text)
+{
+    SkipJsonSpaces(text);
+    return ConsumeInt(text);
+}
+
+// Skips a value of a key the corpus doesn't use
+void SkipJsonValue(string_view& text, StringPool& pool)
+{
+    SkipJsonSpaces(text);
+    if (text.empty()) {
+        throw invalid_argument("expected a json value"s);
+    }
+    if (text.front() == '"') {
+        ConsumeJsonString(text, pool);
+    }
+    else if (text.front() == '[' || text.front() == '{') {
+        const char close = text.front() == '[' ? ']' : '}';
+        text.remove_prefix(1);
+        if (ConsumeJsonCharIf(text, close)) {
+            return;
+        }
+        do {
+            if (close == '}') {
+                ConsumeJsonString(text, pool);
+                ConsumeJsonChar(text, ':');
+            }
+            SkipJsonValue(text, pool);
+        } while (ConsumeJsonCharIf(text, ','));
+        ConsumeJsonChar(text, close);
+    }
+    else {
+        // a number, true, false or null
+        const size_t end = text.find_first_of(",]} \t"sv);
+        text.remove_prefix(end == text.npos ? text.size() : end);
+    }
+}
+
+DocumentInput ParseJsonLine(string_view line, StringPool& pool)
+{
+    DocumentInput document;
+    bool has_id = false;
+    bool has_text = false;
+    ConsumeJsonChar(line, '{');
+    if (!ConsumeJsonCharIf(line, '}')) {
+        do {
+            const string_view key = ConsumeJsonString(line, pool);
+            ConsumeJsonChar(line, ':');
+            if (key == "id"sv) {
+                document.id = ConsumeJsonInt(line);
+                has_id = true;
+            }
+            else if (key == "status"sv) {
+                document.status = ParseDocumentStatus(ConsumeJsonString(line, pool));
+            }
+            else if (key == "ratings"sv) {
+                ConsumeJsonChar(line, '[');
+                if (!ConsumeJsonCharIf(line, ']')) {
+                    do {
+                        document.ratings.push_back(ConsumeJsonInt(line));
+                    } while (ConsumeJsonCharIf(line, ','));
+                    ConsumeJsonChar(line, ']');
+                }
+            }
+            else if (key == "text"sv) {
+                document.text = ConsumeJsonString(line, pool);
+                has_text = true;
+            }
+            else {
+                SkipJsonValue(line, pool);
+            }
+        } while (ConsumeJsonCharIf(line, ','));
+        ConsumeJsonChar(line, '}');
+    }
+    SkipJsonSpaces(line);
+    if (!line.empty()) {
+        throw invalid_argument("unexpected text after the json object"s);
+    }
+    if (!has_id || !has_text) {
+        throw invalid_argument("a json document must have an id and a text"s);
+    }
+    return document;
+}
+
+} // namespace
+
+DocumentInput ParseCorpusLine(string_view line, CorpusFormat format, StringPool& pool)
+{
+    return format == CorpusFormat::TSV ? ParseTsvLine(line) : ParseJsonLine(line, pool);
+}
+
+IngestStats IngestCorpus(SearchServer& search_server, const string& path, const IngestOptions& options)
+{
+    if (options.block_size == 0) {
+        throw invalid_argument("block size must be positive"s);
+    }
+    ifstream file(path, ios::binary);
+    if (!file) {
+        throw runtime_error("can't open corpus file "s + path);
+    }
+    const auto start = chrono::steady_clock::now();
+    IngestStats stats;
+    BoundedQueue<string> blocks(options.queue_capacity);
+    // a batch is never moved, the documents view its lines
+    BoundedQueue<unique_ptr<CorpusBatch>> batches(options.queue_capacity);
+    // only the stage that fails records its error, the others see the cancelled queues
+    array<exception_ptr, 3> errors;
+    const auto cancel = [&]() {
+        blocks.Cancel();
+        batches.Cancel();
+    };
+
+    thread reader([&]() {
+        try {
+            string rest;
+            while (true) {
+                string block = move(rest);
+                rest.clear();
+                const size_t rest_size = block.size();
+                block.resize(rest_size + options.block_size);
+                file.read(block.data() + rest_size, options.block_size);
+                const size_t read_size = static_cast<size_t>(file.gcount());
+                block.resize(rest_size + read_size);
+                stats.byte_count += read_size;
+                if (read_size == 0) {
+                    if (file.bad()) {
+                        throw runtime_error("can't read corpus file "s + path);
+                    }
+                    // the last line may have no line feed
+                    if (!block.empty() && !blocks.Push(move(block))) {
+                        return;
+                    }
+                    break;
+                }
+                // a block ends with a whole line
+                const size_t line_end = block.rfind('\n');
+                if (line_end == block.npos) {
+                    rest = move(block);
+                    continue;
+                }
+                rest.assign(block, line_end + 1);
+                block.resize(line_end + 1);
+                if (!blocks.Push(move(block))) {
+                    return;
+                }
+            }
+            blocks.Close();
+        }
+        catch (...) {
+            errors[0] = current_exception();
+            cancel();
+        }
+        });
+
+    thread parser([&]() {
+        try {
+            size_t line_number = 0;
+            while (optional<string> block = blocks.Pop()) {
+                auto batch = make_unique<CorpusBatch>();
+                batch->lines = move(*block);
+                for (string_view lines = batch->lines; !lines.empty();) {
+                    const size_t line_end = lines.find('\n');
+                    string_view line = lines.substr(0, line_end);
+                    lines.remove_prefix(line_end == lines.npos ? lines.size() : line_end + 1);
+                    ++line_number;
+                    if (!line.empty() && line.back() == '\r') {
+                        line.remove_suffix(1);
+                    }
+                    if (line.empty()) {
+                        continue;
+                    }
+                    try {
+                        batch->documents.push_back(ParseCorpusLine(line, options.format, batch->pool));
+                    }
+                    catch (const invalid_argument& e) {
+                        throw invalid_argument("corpus line "s + to_string(line_number) + ": "s + e.what());
+                    }
+                }
+                if (!batches.Push(move(batch))) {
+                    return;
+                }
+            }
+            batches.Close();
+        }
+        catch (...) {
+            errors[1] = current_exception();
+            cancel();
+        }
+        });
+
+    try {
+        while (optional<unique_ptr<CorpusBatch>> batch = batches.Pop()) {
+            search_server.AddDocuments(execution::par, (*batch)->documents);
+            stats.document_count += (*batch)->documents.size();
+        }
+    }
+    catch (...) {
+        errors[2] = current_exception();
+        cancel();
+    }
+    reader.join();
+    parser.join();
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+    stats.duration = chrono::steady_clock::now() - start;
+    return stats;
+}
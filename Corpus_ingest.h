@@ -0,0 +1,48 @@
+#pragma once
+#include "Search_Server.h"
+#include "String_pool.h"
+using namespace std;
+
+enum class CorpusFormat {
+    // id <tab> status <tab> ratings separated by spaces <tab> text
+    TSV,
+    // {"id": 1, "status": "ACTUAL", "ratings": [1, 2], "text": "..."}, other keys are skipped
+    JSONL,
+};
+
+struct IngestOptions {
+    CorpusFormat format = CorpusFormat::TSV;
+    // bytes read at once, a longer line gets a longer block
+    size_t block_size = 4 * 1024 * 1024;
+    // blocks and batches waiting between the stages
+    size_t queue_capacity = 4;
+};
+
+struct IngestStats {
+    size_t document_count = 0;
+    uint64_t byte_count = 0;
+    chrono::duration<double> duration{ 0 };
+
+    double GetDocumentsPerSecond() const
+    {
+        return duration.count() > 0 ? document_count / duration.count() : 0;
+    }
+
+    double GetMegabytesPerSecond() const
+    {
+        return duration.count() > 0 ? byte_count / (1024.0 * 1024.0) / duration.count() : 0;
+    }
+};
+
+// Streams a corpus file with a document per line into the server. A reader thread
+// reads blocks of whole lines, a parser thread turns every block into a batch and
+// the calling thread indexes the batches by the parallel AddDocuments, which
+// tokenizes them on all cores. The stages are connected by bounded queues, so
+// the memory used doesn't depend on the size of the file.
+// Throws runtime_error when the file can't be read and invalid_argument for a
+// malformed line or a document AddDocument rejects; the batches indexed before stay.
+IngestStats IngestCorpus(SearchServer& search_server, const string& path, const IngestOptions& options = {});
+
+// Throws invalid_argument when the line is malformed. The text views the line
+// unless it has to be unescaped into the pool.
+DocumentInput ParseCorpusLine(string_view line, CorpusFormat format, StringPool& pool);
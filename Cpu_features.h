@@ -0,0 +1,23 @@
+#pragma once
+// Runtime detection of the instruction sets used by the vectorized kernels.
+// The kernels are compiled with per-function target attributes, so the binary
+// still runs on CPUs without them and falls back to the scalar code.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SEARCH_SERVER_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SEARCH_SERVER_TARGET(features)
+#else
+#define SEARCH_SERVER_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+// SSE2 is part of the baseline of the target, no runtime check is needed
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2 1
+#endif
+
+struct CpuFeatures {
+    bool sse41 = false;
+    bool avx2 = false;
+};
+
+const CpuFeatures& GetCpuFeatures();
@@ -0,0 +1,50 @@
+#pragma once
+#include "headers.h"
+
+const double epsilon = 1e-6;
+
+struct Document {
+    int id;
+    double relevance;
+    int rating;
+    Document() {
+        id = 0;
+        relevance = 0.0;
+        rating = 0;
+    }
+    Document(int id, double relevance, int rating)
+        : id(id)
+        , relevance(relevance)
+        , rating(rating) {
+    }
+};
+
+enum class DocumentStatus : uint8_t {
+    ACTUAL,
+    IRRELEVANT,
+    BANNED,
+    REMOVED,
+};
+
+const size_t DOCUMENT_STATUS_COUNT = 4;
+
+// A document for SearchServer::AddDocuments, the text must outlive the call
+struct DocumentInput {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
+// Documents are ranked by relevance, relevances closer than epsilon are ranked by rating
+// and then by id, so every search path returns tied documents in the same order
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs)
+{
+    if (std::abs(lhs.relevance - rhs.relevance) < epsilon) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
@@ -0,0 +1,48 @@
+#include "Document_filter.h"
+#include "Cpu_features.h"
+#if defined(SEARCH_SERVER_X86)
+#include <immintrin.h>
+#endif
+
+static uint64_t MatchBlockScalar(const DocumentFilter& filter, const DocumentStatus* statuses, const int* ratings)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < DocumentFilter::BLOCK_SIZE; ++i) {
+        mask |= static_cast<uint64_t>(filter(0, statuses[i], ratings[i])) << i;
+    }
+    return mask;
+}
+
+#if defined(SEARCH_SERVER_X86)
+SEARCH_SERVER_TARGET("avx2")
+static uint64_t MatchBlockAvx2(const DocumentFilter& filter, const DocumentStatus* statuses, const int* ratings)
+{
+    const __m256i status = _mm256_set1_epi8(static_cast<char>(filter.status));
+    const __m256i statuses_low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(statuses));
+    const __m256i statuses_high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(statuses + 32));
+    const uint64_t status_mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(statuses_low, status)))
+        | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(statuses_high, status)))) << 32;
+
+    const __m256i min_rating = _mm256_set1_epi32(filter.rating_range.min_rating);
+    const __m256i max_rating = _mm256_set1_epi32(filter.rating_range.max_rating);
+    uint64_t rating_mask = 0;
+    for (size_t i = 0; i < DocumentFilter::BLOCK_SIZE; i += 8) {
+        const __m256i rating = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ratings + i));
+        const __m256i out_of_range = _mm256_or_si256(_mm256_cmpgt_epi32(min_rating, rating), _mm256_cmpgt_epi32(rating, max_rating));
+        const uint64_t in_range = ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(out_of_range))) & 0xFF;
+        rating_mask |= in_range << i;
+    }
+    return status_mask & rating_mask;
+}
+#endif
+
+uint64_t DocumentFilter::MatchBlock(const DocumentStatus* statuses, const int* ratings, size_t count) const
+{
+    const uint64_t candidates = count >= BLOCK_SIZE ? ~uint64_t{ 0 } : (uint64_t{ 1 } << count) - 1;
+#if defined(SEARCH_SERVER_X86)
+    if (GetCpuFeatures().avx2) {
+        return MatchBlockAvx2(*this, statuses, ratings) & candidates;
+    }
+#endif
+    return MatchBlockScalar(*this, statuses, ratings) & candidates;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "Document.h"
+using namespace std;
+
+// Inclusive bounds of the document rating
+struct RatingRange {
+    int min_rating = numeric_limits<int>::min();
+    int max_rating = numeric_limits<int>::max();
+
+    // Every rating is in range
+    bool IsUnbounded() const
+    {
+        return min_rating == numeric_limits<int>::min() && max_rating == numeric_limits<int>::max();
+    }
+};
+
+// Built-in document predicate: the status must match and the rating must be in range.
+// Unlike user predicates it is evaluated over blocks of candidates with vector compares.
+struct DocumentFilter {
+    inline static constexpr size_t BLOCK_SIZE = 64;
+
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    RatingRange rating_range;
+
+    bool operator()(int, DocumentStatus document_status, int rating) const
+    {
+        return document_status == status
+            && rating >= rating_range.min_rating && rating <= rating_range.max_rating;
+    }
+
+    // Bit i of the result is set if candidate i passes the filter.
+    // Both arrays hold BLOCK_SIZE elements, only the first count of them are candidates.
+    uint64_t MatchBlock(const DocumentStatus* statuses, const int* ratings, size_t count) const;
+};
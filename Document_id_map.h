@@ -0,0 +1,170 @@
+#pragma once
+#include "headers.h"
+#include "Flat_hash_map.h"
+#include "Persistent_vector.h"
+#include "Persistent_id_table.h"
+using namespace std;
+
+// Maps the document ids of the callers to dense internal ids 0, 1, 2, ...
+// given in the order the documents are added. The slots of removed documents
+// stay unused until Remap renumbers the live documents. Copies share the ids
+// and the hash index, changing a copy copies only the nodes it changes.
+class DocumentIdMap {
+public:
+    inline static constexpr uint32_t INVALID_INTERNAL_ID = numeric_limits<uint32_t>::max();
+
+    // Iterates over the external ids in ascending order
+    using Iterator = vector<int>::const_iterator;
+
+    // Returns the new internal id. A present external id leaves the map as it was
+    // and gives INVALID_INTERNAL_ID.
+    uint32_t Add(int external_id)
+    {
+        const size_t hash = FlatHash<int>{}(external_id);
+        if (Find(external_id, hash) != INVALID_INTERNAL_ID) {
+            return INVALID_INTERNAL_ID;
+        }
+        const uint32_t internal_id = static_cast<uint32_t>(to_external_.Size());
+        to_external_.PushBack(external_id);
+        to_internal_.Insert(hash, internal_id, [&](uint32_t id) {
+            return FlatHash<int>{}(to_external_[id]);
+            }, [&](uint32_t id) {
+                return IsLive(id);
+            });
+        ++size_;
+        sorted_ids_ = make_shared<SortedIds>();
+        return internal_id;
+    }
+
+    // Takes the next internal id for a document removed already, restores the holes of a snapshot
+    uint32_t AddRemoved()
+    {
+        const uint32_t internal_id = static_cast<uint32_t>(to_external_.Size());
+        to_external_.PushBack(INVALID_EXTERNAL_ID);
+        return internal_id;
+    }
+
+    // Returns the freed internal id or INVALID_INTERNAL_ID
+    uint32_t Remove(int external_id)
+    {
+        const uint32_t internal_id = Find(external_id);
+        if (internal_id == INVALID_INTERNAL_ID) {
+            return INVALID_INTERNAL_ID;
+        }
+        // the hash index drops the dead id when it grows
+        to_external_.Set(internal_id, INVALID_EXTERNAL_ID);
+        --size_;
+        sorted_ids_ = make_shared<SortedIds>();
+        return internal_id;
+    }
+
+    uint32_t Find(int external_id) const
+    {
+        return Find(external_id, FlatHash<int>{}(external_id));
+    }
+
+    int GetExternal(uint32_t internal_id) const
+    {
+        return to_external_[internal_id];
+    }
+
+    bool IsLive(uint32_t internal_id) const
+    {
+        return to_external_[internal_id] != INVALID_EXTERNAL_ID;
+    }
+
+    // Number of live documents
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    // Number of internal ids given out, removed ones included
+    size_t Capacity() const
+    {
+        return to_external_.Size();
+    }
+
+    // New internal ids numbering the live documents densely in their order,
+    // INVALID_INTERNAL_ID for the removed ones
+    vector<uint32_t> GetCompactedIds() const
+    {
+        vector<uint32_t> new_ids(to_external_.Size(), INVALID_INTERNAL_ID);
+        uint32_t next_id = 0;
+        to_external_.ForEach([&](size_t internal_id, int external_id) {
+            if (external_id != INVALID_EXTERNAL_ID) {
+                new_ids[internal_id] = next_id++;
+            }
+            });
+        return new_ids;
+    }
+
+    // Renumbers the internal ids by new_ids[old id] keeping their order, capacity new ids
+    // are given out. Every live document needs a new id, a removed one given a new id
+    // leaves a hole there, INVALID_INTERNAL_ID drops the old id.
+    void Remap(const vector<uint32_t>& new_ids, size_t capacity)
+    {
+        vector<int> to_external(capacity, INVALID_EXTERNAL_ID);
+        to_external_.ForEach([&](size_t internal_id, int external_id) {
+            if (new_ids[internal_id] != INVALID_INTERNAL_ID) {
+                to_external[new_ids[internal_id]] = external_id;
+            }
+            });
+        to_external_.Clear();
+        for (const int external_id : to_external) {
+            to_external_.PushBack(external_id);
+        }
+        to_internal_.Assign(static_cast<uint32_t>(capacity), [&](uint32_t id) {
+            return FlatHash<int>{}(to_external_[id]);
+            }, [&](uint32_t id) {
+                return IsLive(id);
+            });
+        sorted_ids_ = make_shared<SortedIds>();
+    }
+
+    // The external ids are sorted once per version of the map, by the first iteration
+    Iterator begin() const
+    {
+        return GetSortedIds().begin();
+    }
+
+    Iterator end() const
+    {
+        return GetSortedIds().end();
+    }
+
+private:
+    inline static constexpr int INVALID_EXTERNAL_ID = -1;
+    struct SortedIds {
+        once_flag sorted;
+        vector<int> ids;
+    };
+    PersistentVector<int> to_external_;
+    // hash index of the live internal ids by external id
+    PersistentIdTable to_internal_;
+    size_t size_ = 0;
+    // copies share it until one of them changes
+    shared_ptr<SortedIds> sorted_ids_ = make_shared<SortedIds>();
+
+    uint32_t Find(int external_id, size_t hash) const
+    {
+        const uint32_t internal_id = to_internal_.Find(hash, [&](uint32_t id) {
+            return to_external_[id] == external_id;
+            });
+        return internal_id != PersistentIdTable::EMPTY ? internal_id : INVALID_INTERNAL_ID;
+    }
+
+    const vector<int>& GetSortedIds() const
+    {
+        call_once(sorted_ids_->sorted, [&]() {
+            sorted_ids_->ids.reserve(size_);
+            to_external_.ForEach([&](size_t, int external_id) {
+                if (external_id != INVALID_EXTERNAL_ID) {
+                    sorted_ids_->ids.push_back(external_id);
+                }
+                });
+            sort(sorted_ids_->ids.begin(), sorted_ids_->ids.end());
+            });
+        return sorted_ids_->ids;
+    }
+};
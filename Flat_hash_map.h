@@ -0,0 +1,569 @@
+#pragma once
+#include "headers.h"
+#include "Cpu_features.h"
+#if defined(SEARCH_SERVER_SSE2)
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+// Hash for the flat tables: the standard hash mixed so that its low 7 bits and
+// the rest are both usable. Strings are hashed as string_view, so a table with
+// string keys is searched by string_view without building a string.
+template <typename Key>
+struct FlatHash {
+    size_t operator()(const Key& key) const
+    {
+        return Mix(hash<Key>{}(key));
+    }
+
+    static size_t Mix(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDull;
+        value ^= value >> 33;
+        return static_cast<size_t>(value);
+    }
+};
+
+template <>
+struct FlatHash<string> {
+    using is_transparent = void;
+
+    size_t operator()(string_view key) const
+    {
+        return FlatHash<string_view>::Mix(hash<string_view>{}(key));
+    }
+};
+
+// Open-addressing hash table in the SwissTable layout. Every slot has a control
+// byte: empty, deleted or the low 7 bits of the hash of its key. The slots are
+// split into groups of 16 whose control bytes are compared with a probe at once
+// (one SSE2 comparison), the rest of the hash selects the first group to probe.
+// Slots are stored inline, so inserting allocates only on growth and a lookup
+// touches one control group and the matching slots.
+// Value void gives a set. Inserting or erasing invalidates iterators and references.
+template <typename Key, typename Value, typename Hash = FlatHash<Key>, typename Equal = equal_to<>>
+class FlatHashTable {
+public:
+    inline static constexpr bool IS_SET = is_void_v<Value>;
+    using key_type = Key;
+    using value_type = conditional_t<IS_SET, const Key, pair<const Key, conditional_t<IS_SET, char, Value>>>;
+    inline static constexpr size_t GROUP_WIDTH = 16;
+
+    template <bool IsConst>
+    class Iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = FlatHashTable::value_type;
+        using difference_type = ptrdiff_t;
+        using pointer = conditional_t<IsConst, const value_type*, value_type*>;
+        using reference = conditional_t<IsConst, const value_type&, value_type&>;
+
+        Iterator() = default;
+
+        Iterator(const FlatHashTable* table, size_t index)
+            : table_(table)
+            , index_(index)
+        {
+            SkipFree();
+        }
+
+        // a mutable iterator converts to a constant one
+        operator Iterator<true>() const
+        {
+            return Iterator<true>(table_, index_);
+        }
+
+        reference operator*() const
+        {
+            return *table_->SlotAt(index_);
+        }
+
+        pointer operator->() const
+        {
+            return table_->SlotAt(index_);
+        }
+
+        Iterator& operator++()
+        {
+            ++index_;
+            SkipFree();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return index_ == other.index_;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return index_ != other.index_;
+        }
+
+    private:
+        friend class FlatHashTable;
+        const FlatHashTable* table_ = nullptr;
+        size_t index_ = 0;
+
+        void SkipFree()
+        {
+            while (index_ < table_->capacity_ && !IsFull(table_->controls_[index_])) {
+                ++index_;
+            }
+        }
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashTable() = default;
+
+    template <typename InputIt>
+    FlatHashTable(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    FlatHashTable(initializer_list<conditional_t<IS_SET, Key, pair<Key, conditional_t<IS_SET, char, Value>>>> values)
+        : FlatHashTable(values.begin(), values.end())
+    {
+    }
+
+    FlatHashTable(const FlatHashTable& other)
+    {
+        *this = other;
+    }
+
+    FlatHashTable(FlatHashTable&& other) noexcept
+    {
+        *this = move(other);
+    }
+
+    FlatHashTable& operator=(const FlatHashTable& other)
+    {
+        if (this != &other) {
+            clear();
+            reserve(other.size());
+            for (const value_type& value : other) {
+                insert(value);
+            }
+        }
+        return *this;
+    }
+
+    FlatHashTable& operator=(FlatHashTable&& other) noexcept
+    {
+        if (this != &other) {
+            Release();
+            controls_ = exchange(other.controls_, EmptyGroup());
+            slots_ = exchange(other.slots_, nullptr);
+            capacity_ = exchange(other.capacity_, 0);
+            size_ = exchange(other.size_, 0);
+            deleted_count_ = exchange(other.deleted_count_, 0);
+        }
+        return *this;
+    }
+
+    ~FlatHashTable()
+    {
+        Release();
+    }
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end()
+    {
+        return iterator(this, capacity_);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, capacity_);
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    // Number of slots
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    // Keeps the slots
+    void clear()
+    {
+        for (size_t index = 0; index < capacity_; ++index) {
+            if (IsFull(controls_[index])) {
+                SlotAt(index)->~value_type();
+            }
+        }
+        if (capacity_ > 0) {
+            fill(controls_, controls_ + capacity_, EMPTY);
+        }
+        size_ = 0;
+        deleted_count_ = 0;
+    }
+
+    // Makes room for count elements without growing
+    void reserve(size_t count)
+    {
+        if (count + deleted_count_ > MaxLoad(capacity_)) {
+            size_t capacity = max(capacity_, GROUP_WIDTH);
+            while (count > MaxLoad(capacity)) {
+                capacity *= 2;
+            }
+            Rehash(capacity);
+        }
+    }
+
+    template <typename K>
+    iterator find(const K& key)
+    {
+        return iterator(this, FindIndex(key));
+    }
+
+    template <typename K>
+    const_iterator find(const K& key) const
+    {
+        return const_iterator(this, FindIndex(key));
+    }
+
+    template <typename K>
+    bool contains(const K& key) const
+    {
+        return FindIndex(key) != capacity_;
+    }
+
+    template <typename K>
+    size_t count(const K& key) const
+    {
+        return contains(key) ? 1 : 0;
+    }
+
+    // Constructs the element from the key and args unless the key is present
+    template <typename K, typename... Args>
+    pair<iterator, bool> try_emplace(K&& key, Args&&... args)
+    {
+        const size_t hash = Hash{}(key);
+        size_t index = FindIndex(key, hash);
+        if (index != capacity_) {
+            return { iterator(this, index), false };
+        }
+        index = PrepareInsert(hash);
+        if constexpr (IS_SET) {
+            new (RawSlotAt(index)) value_type(forward<K>(key));
+        }
+        else {
+            new (RawSlotAt(index)) value_type(piecewise_construct, forward_as_tuple(forward<K>(key)), forward_as_tuple(forward<Args>(args)...));
+        }
+        return { iterator(this, index), true };
+    }
+
+    template <typename V>
+    pair<iterator, bool> insert(V&& value)
+    {
+        if constexpr (IS_SET) {
+            return try_emplace(forward<V>(value));
+        }
+        else {
+            return try_emplace(forward<V>(value).first, forward<V>(value).second);
+        }
+    }
+
+    template <typename K, typename... Args>
+    pair<iterator, bool> emplace(K&& key, Args&&... args)
+    {
+        return try_emplace(forward<K>(key), forward<Args>(args)...);
+    }
+
+    template <typename K, bool IsSet = IS_SET, enable_if_t<!IsSet, int> = 0>
+    auto& operator[](K&& key)
+    {
+        return try_emplace(forward<K>(key)).first->second;
+    }
+
+    template <typename K, bool IsSet = IS_SET, enable_if_t<!IsSet, int> = 0>
+    auto& at(const K& key)
+    {
+        const size_t index = FindIndex(key);
+        if (index == capacity_) {
+            throw out_of_range("no such key in the flat hash table"s);
+        }
+        return SlotAt(index)->second;
+    }
+
+    template <typename K, bool IsSet = IS_SET, enable_if_t<!IsSet, int> = 0>
+    const auto& at(const K& key) const
+    {
+        const size_t index = FindIndex(key);
+        if (index == capacity_) {
+            throw out_of_range("no such key in the flat hash table"s);
+        }
+        return SlotAt(index)->second;
+    }
+
+    template <typename K>
+    size_t erase(const K& key)
+    {
+        const size_t index = FindIndex(key);
+        if (index == capacity_) {
+            return 0;
+        }
+        EraseAt(index);
+        return 1;
+    }
+
+    void erase(const_iterator it)
+    {
+        EraseAt(it.index_);
+    }
+
+private:
+    // control bytes: a full slot holds the low 7 bits of the hash
+    inline static constexpr int8_t EMPTY = -128;
+    inline static constexpr int8_t DELETED = -2;
+
+    // empty tables point to one group of empty controls, so probing needs no check
+    int8_t* controls_ = EmptyGroup();
+    value_type* slots_ = nullptr;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    size_t deleted_count_ = 0;
+
+    static int8_t* EmptyGroup()
+    {
+        alignas(16) static int8_t empty_group[GROUP_WIDTH] = {
+            EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+            EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY
+        };
+        return empty_group;
+    }
+
+    static bool IsFull(int8_t control)
+    {
+        return control >= 0;
+    }
+
+    static size_t MaxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    static int8_t H2(size_t hash)
+    {
+        return static_cast<int8_t>(hash & 0x7F);
+    }
+
+    static size_t H1(size_t hash)
+    {
+        return hash >> 7;
+    }
+
+    // Bit i is set for every control byte i of the group matching the condition
+    static uint32_t Match(const int8_t* group, int8_t control)
+    {
+#if defined(SEARCH_SERVER_SSE2)
+        const __m128i controls = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8(control))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+            mask |= static_cast<uint32_t>(group[i] == control) << i;
+        }
+        return mask;
+#endif
+    }
+
+    static uint32_t MatchEmptyOrDeleted(const int8_t* group)
+    {
+#if defined(SEARCH_SERVER_SSE2)
+        // empty and deleted are the only controls below -1
+        const __m128i controls = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), controls)));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+            mask |= static_cast<uint32_t>(group[i] < -1) << i;
+        }
+        return mask;
+#endif
+    }
+
+    static int LowestBit(uint32_t mask)
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    value_type* SlotAt(size_t index) const
+    {
+        return slots_ + index;
+    }
+
+    // The slot to construct an element in, the key of a set element is const
+    void* RawSlotAt(size_t index) const
+    {
+        return const_cast<remove_const_t<value_type>*>(slots_ + index);
+    }
+
+    size_t GroupMask() const
+    {
+        return capacity_ == 0 ? 0 : capacity_ / GROUP_WIDTH - 1;
+    }
+
+    static const Key& KeyOf(const value_type& value)
+    {
+        if constexpr (IS_SET) {
+            return value;
+        }
+        else {
+            return value.first;
+        }
+    }
+
+    template <typename K>
+    size_t FindIndex(const K& key) const
+    {
+        return FindIndex(key, Hash{}(key));
+    }
+
+    // Probes the groups in triangular order, which visits every group once
+    // since their number is a power of two
+    template <typename K>
+    size_t FindIndex(const K& key, size_t hash) const
+    {
+        const size_t group_mask = GroupMask();
+        size_t group = H1(hash) & group_mask;
+        for (size_t step = 1;; ++step) {
+            const int8_t* controls = controls_ + group * GROUP_WIDTH;
+            for (uint32_t mask = Match(controls, H2(hash)); mask != 0; mask &= mask - 1) {
+                const size_t index = group * GROUP_WIDTH + LowestBit(mask);
+                if (Equal{}(KeyOf(*SlotAt(index)), key)) {
+                    return index;
+                }
+            }
+            if (Match(controls, EMPTY) != 0 || step > group_mask) {
+                return capacity_;
+            }
+            group = (group + step) & group_mask;
+        }
+    }
+
+    // Claims a free slot for a key known to be absent
+    size_t PrepareInsert(size_t hash)
+    {
+        if (size_ + deleted_count_ + 1 > MaxLoad(capacity_)) {
+            // tombstones alone are dropped in place, otherwise the table doubles
+            Rehash(size_ + 1 > MaxLoad(capacity_) / 2 || capacity_ == 0 ? max(capacity_ * 2, GROUP_WIDTH) : capacity_);
+        }
+        const size_t index = FindFreeIndex(hash);
+        deleted_count_ -= controls_[index] == DELETED ? 1 : 0;
+        controls_[index] = H2(hash);
+        ++size_;
+        return index;
+    }
+
+    size_t FindFreeIndex(size_t hash) const
+    {
+        const size_t group_mask = GroupMask();
+        size_t group = H1(hash) & group_mask;
+        for (size_t step = 1;; ++step) {
+            const uint32_t mask = MatchEmptyOrDeleted(controls_ + group * GROUP_WIDTH);
+            if (mask != 0) {
+                return group * GROUP_WIDTH + LowestBit(mask);
+            }
+            group = (group + step) & group_mask;
+        }
+    }
+
+    void EraseAt(size_t index)
+    {
+        SlotAt(index)->~value_type();
+        --size_;
+        // a group with an empty slot never made a probe go on,
+        // so the slot may become empty instead of a tombstone
+        const int8_t* group = controls_ + index / GROUP_WIDTH * GROUP_WIDTH;
+        if (Match(group, EMPTY) != 0) {
+            controls_[index] = EMPTY;
+        }
+        else {
+            controls_[index] = DELETED;
+            ++deleted_count_;
+        }
+    }
+
+    void Rehash(size_t capacity)
+    {
+        int8_t* old_controls = controls_;
+        value_type* old_slots = slots_;
+        const size_t old_capacity = capacity_;
+        controls_ = static_cast<int8_t*>(::operator new(capacity, align_val_t{ GROUP_WIDTH }));
+        fill(controls_, controls_ + capacity, EMPTY);
+        slots_ = static_cast<value_type*>(::operator new(capacity * sizeof(value_type)));
+        capacity_ = capacity;
+        deleted_count_ = 0;
+        for (size_t index = 0; index < old_capacity; ++index) {
+            if (IsFull(old_controls[index])) {
+                value_type& value = old_slots[index];
+                const size_t hash = Hash{}(KeyOf(value));
+                const size_t new_index = FindFreeIndex(hash);
+                controls_[new_index] = H2(hash);
+                new (RawSlotAt(new_index)) value_type(move(value));
+                value.~value_type();
+            }
+        }
+        if (old_capacity > 0) {
+            ::operator delete(old_controls, align_val_t{ GROUP_WIDTH });
+            ::operator delete(const_cast<remove_const_t<value_type>*>(old_slots));
+        }
+    }
+
+    void Release()
+    {
+        if (capacity_ == 0) {
+            return;
+        }
+        clear();
+        ::operator delete(controls_, align_val_t{ GROUP_WIDTH });
+        ::operator delete(const_cast<remove_const_t<value_type>*>(slots_));
+        controls_ = EmptyGroup();
+        slots_ = nullptr;
+        capacity_ = 0;
+    }
+};
+
+template <typename Key, typename Value, typename Hash = FlatHash<Key>, typename Equal = equal_to<>>
+using FlatHashMap = FlatHashTable<Key, Value, Hash, Equal>;
+
+template <typename Key, typename Hash = FlatHash<Key>, typename Equal = equal_to<>>
+using FlatHashSet = FlatHashTable<Key, void, Hash, Equal>;
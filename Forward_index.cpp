@@ -0,0 +1,88 @@
+#include "Forward_index.h"
+
+TermFreqsView ForwardIndex::TermFreqPool::Store(TermFreqsView term_freqs)
+{
+    if (term_freqs.size() > free_size_) {
+        // a document longer than a chunk gets a chunk of its own
+        const size_t chunk_size = max(CHUNK_SIZE, term_freqs.size());
+        chunks_.push_back(make_unique<TermFreq[]>(chunk_size));
+        free_ = chunks_.back().get();
+        free_size_ = chunk_size;
+    }
+    TermFreq* stored = free_;
+    copy(term_freqs.begin(), term_freqs.end(), stored);
+    free_ += term_freqs.size();
+    free_size_ -= term_freqs.size();
+    return TermFreqsView(stored, term_freqs.size());
+}
+
+void ForwardIndex::Remap(const vector<uint32_t>& new_ids, size_t capacity)
+{
+    vector<TermFreqsView> views(capacity);
+    auto pool = make_shared<TermFreqPool>();
+    term_freqs_.ForEach([&](size_t internal_id, TermFreqsView term_freqs) {
+        if (new_ids[internal_id] == DocumentIdMap::INVALID_INTERNAL_ID) {
+            return;
+        }
+        views[new_ids[internal_id]] = IsMapped(term_freqs) ? term_freqs : pool->Store(term_freqs);
+        });
+    term_freqs_.Clear();
+    for (const TermFreqsView term_freqs : views) {
+        term_freqs_.PushBack(term_freqs);
+    }
+    pool_ = move(pool);
+}
+
+void ForwardIndex::Write(const vector<uint32_t>& internal_ids, index_file::SectionWriter& section) const
+{
+    vector<uint64_t> offsets = { 0 };
+    offsets.reserve(internal_ids.size() + 1);
+    for (const uint32_t internal_id : internal_ids) {
+        offsets.push_back(offsets.back() + Get(internal_id).size());
+    }
+    // value-initialized, so the padding of the entries is written as zeros
+    vector<TermFreq> entries(static_cast<size_t>(offsets.back()));
+    size_t position = 0;
+    for (const uint32_t internal_id : internal_ids) {
+        for (const auto& [term, freq] : Get(internal_id)) {
+            entries[position].term = term;
+            entries[position].freq = freq;
+            ++position;
+        }
+    }
+    section.Write(static_cast<uint64_t>(internal_ids.size()));
+    section.Write(offsets.data(), offsets.size());
+    section.Write(entries.data(), entries.size());
+}
+
+ForwardIndex ForwardIndex::Read(index_file::SectionReader section, shared_ptr<const MappedFile> file, vector<uint32_t>& document_freqs)
+{
+    const uint64_t document_count = section.Read<uint64_t>();
+    if (document_count >= DocumentIdMap::INVALID_INTERNAL_ID) {
+        throw invalid_argument("index file has a malformed forward index"s);
+    }
+    const uint64_t* offsets = section.Read<uint64_t>(static_cast<size_t>(document_count + 1));
+    const TermFreq* entries = section.Read<TermFreq>(static_cast<size_t>(offsets[document_count]));
+    for (size_t position = 0; position < document_count; ++position) {
+        if (offsets[position] > offsets[position + 1] || offsets[position + 1] > offsets[document_count]) {
+            throw invalid_argument("index file has a malformed forward index"s);
+        }
+        for (uint64_t i = offsets[position]; i < offsets[position + 1]; ++i) {
+            const TermId term = entries[i].term;
+            if (term == TermDictionary::INVALID_TERM_ID || (i > offsets[position] && entries[i - 1].term >= term)) {
+                throw invalid_argument("index file has a malformed forward index"s);
+            }
+            if (term >= document_freqs.size()) {
+                document_freqs.resize(term + 1);
+            }
+            ++document_freqs[term];
+        }
+    }
+    ForwardIndex forward_index;
+    for (size_t position = 0; position < document_count; ++position) {
+        forward_index.term_freqs_.PushBack(TermFreqsView(entries + offsets[position],
+            static_cast<size_t>(offsets[position + 1] - offsets[position])));
+    }
+    forward_index.file_ = move(file);
+    return forward_index;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "headers.h"
+#include "Segment.h"
+#include "Mapped_file.h"
+#include "Index_file.h"
+#include "Document_id_map.h"
+#include "Persistent_vector.h"
+using namespace std;
+
+// Term frequencies of one document sorted by term id, viewing a TermFreqs or a mapped file
+class TermFreqsView {
+public:
+    TermFreqsView() = default;
+
+    TermFreqsView(const TermFreq* data, size_t size)
+        : data_(data)
+        , size_(size)
+    {
+    }
+
+    const TermFreq* begin() const
+    {
+        return data_;
+    }
+
+    const TermFreq* end() const
+    {
+        return data_ + size_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+private:
+    const TermFreq* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Forward index: the term frequencies of every document by internal id.
+// The documents read from a file are viewed in its mapping, so opening it
+// doesn't build a vector per document; the documents added later are copied
+// back to back into a pool whose entries never move. Copies share the pool and
+// the views, changing a copy copies only the nodes it changes.
+class ForwardIndex {
+public:
+    // Number of internal ids, removed documents included
+    size_t Size() const
+    {
+        return term_freqs_.Size();
+    }
+
+    TermFreqsView Get(uint32_t internal_id) const
+    {
+        return term_freqs_[internal_id];
+    }
+
+    // Appends the document with the next internal id
+    void Add(const TermFreqs& term_freqs)
+    {
+        term_freqs_.PushBack(pool_->Store(TermFreqsView(term_freqs.data(), term_freqs.size())));
+    }
+
+    // Drops the term frequencies of a removed document, the pool keeps them until a Remap
+    void Clear(uint32_t internal_id)
+    {
+        term_freqs_.Set(internal_id, TermFreqsView());
+    }
+
+    // Renumbers the documents by new_ids[old id] like DocumentIdMap::Remap,
+    // the documents in memory move to a new pool without the dropped ones
+    void Remap(const vector<uint32_t>& new_ids, size_t capacity);
+
+    // Writes the documents in the order of internal_ids as a forward index section
+    void Write(const vector<uint32_t>& internal_ids, index_file::SectionWriter& section) const;
+    // Forward index viewing the section of the mapped file. Throws invalid_argument
+    // when the section is malformed, counts the documents with every term in document_freqs.
+    static ForwardIndex Read(index_file::SectionReader section, shared_ptr<const MappedFile> file, vector<uint32_t>& document_freqs);
+
+private:
+    // Monotonic storage of term frequencies like StringPool, one writer at a time
+    class TermFreqPool {
+    public:
+        inline static constexpr size_t CHUNK_SIZE = 4096;
+
+        TermFreqsView Store(TermFreqsView term_freqs);
+
+    private:
+        vector<unique_ptr<TermFreq[]>> chunks_;
+        TermFreq* free_ = nullptr;
+        size_t free_size_ = 0;
+    };
+
+    shared_ptr<TermFreqPool> pool_ = make_shared<TermFreqPool>();
+    PersistentVector<TermFreqsView> term_freqs_;
+    // keeps the viewed section mapped
+    shared_ptr<const MappedFile> file_;
+
+    bool IsMapped(TermFreqsView term_freqs) const
+    {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(term_freqs.begin());
+        return file_ && data >= file_->Data() && data < file_->Data() + file_->Size();
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include "headers.h"
+#include "Term_dictionary.h"
+#include "Persistent_vector.h"
+using namespace std;
+
+// Document frequencies and cached inverse document frequencies of the terms.
+// AddDocument and RemoveDocument keep the document frequencies up to date.
+// A cached idf is used while the corpus size stays within the tolerance
+// of the size it was computed for, otherwise it is recomputed on the fly.
+// Tolerance 0 gives the exact idf. Copies share the entries they don't change.
+class IdfCache {
+public:
+    explicit IdfCache(double tolerance = 0.0)
+        : tolerance_(tolerance)
+    {
+    }
+
+    void SetTolerance(double tolerance)
+    {
+        if (tolerance < 0.0) {
+            throw invalid_argument("negative idf tolerance"s);
+        }
+        tolerance_ = tolerance;
+    }
+
+    double GetTolerance() const
+    {
+        return tolerance_;
+    }
+
+    // Must be called before the document frequencies of the changed document are updated
+    void SetDocumentCount(size_t document_count)
+    {
+        document_count_ = document_count;
+        if (tolerance_ > 0.0 && IsStale(refresh_document_count_)) {
+            for (TermId term = 0; term < entries_.Size(); ++term) {
+                Refresh(entries_.GetMutable(term));
+            }
+            refresh_document_count_ = document_count_;
+        }
+    }
+
+    // Forgets the document frequencies of all terms
+    void Clear()
+    {
+        entries_.Clear();
+        document_count_ = 0;
+        refresh_document_count_ = 0;
+    }
+
+    void SetDocumentFreq(TermId term, uint32_t document_freq)
+    {
+        entries_.Resize(term + 1);
+        Entry& entry = entries_.GetMutable(term);
+        entry.document_freq = document_freq;
+        Refresh(entry);
+    }
+
+    void IncrementDocumentFreq(TermId term)
+    {
+        entries_.Resize(term + 1);
+        Entry& entry = entries_.GetMutable(term);
+        ++entry.document_freq;
+        Refresh(entry);
+    }
+
+    void DecrementDocumentFreq(TermId term)
+    {
+        Entry& entry = entries_.GetMutable(term);
+        --entry.document_freq;
+        Refresh(entry);
+    }
+
+    uint32_t GetDocumentFreq(TermId term) const
+    {
+        return term < entries_.Size() ? entries_[term].document_freq : 0;
+    }
+
+    double Get(TermId term) const
+    {
+        const Entry& entry = entries_[term];
+        if (!IsStale(entry.document_count)) {
+            return entry.idf;
+        }
+        return ComputeIdf(entry.document_freq);
+    }
+
+private:
+    struct Entry {
+        uint32_t document_freq = 0;
+        size_t document_count = 0;
+        double idf = 0.0;
+    };
+    PersistentVector<Entry> entries_;
+    size_t document_count_ = 0;
+    size_t refresh_document_count_ = 0;
+    double tolerance_;
+
+    bool IsStale(size_t document_count) const
+    {
+        return abs(static_cast<double>(document_count_) - static_cast<double>(document_count))
+            > tolerance_ * static_cast<double>(document_count);
+    }
+
+    double ComputeIdf(uint32_t document_freq) const
+    {
+        return document_freq > 0 ? log(static_cast<double>(document_count_) / document_freq) : 0.0;
+    }
+
+    void Refresh(Entry& entry) const
+    {
+        entry.idf = ComputeIdf(entry.document_freq);
+        entry.document_count = document_count_;
+    }
+};
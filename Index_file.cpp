@@ -0,0 +1,192 @@
+#include "Index_file.h"
+#include <cstring>
+#include <filesystem>
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace index_file {
+
+// Flushes the written file to the disk
+static bool SyncFile(const string& path)
+{
+#if defined(_WIN32)
+    const int file = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    const bool synced = file >= 0 && _commit(file) == 0;
+    if (file >= 0) {
+        _close(file);
+    }
+#else
+    const int file = open(path.c_str(), O_RDONLY);
+    const bool synced = file >= 0 && fsync(file) == 0;
+    if (file >= 0) {
+        close(file);
+    }
+#endif
+    return synced;
+}
+
+uint64_t ComputeChecksum(const uint8_t* data, size_t size)
+{
+    // 64-bit multiply-rotate over whole words, 4 independent lanes
+    constexpr uint64_t PRIME = 0x9E3779B185EBCA87ull;
+    uint64_t lanes[4] = { 1, 2, 3, 4 };
+    size_t position = 0;
+    for (; position + 32 <= size; position += 32) {
+        for (size_t lane = 0; lane < 4; ++lane) {
+            uint64_t word;
+            memcpy(&word, data + position + lane * 8, 8);
+            lanes[lane] = (lanes[lane] ^ word) * PRIME;
+            lanes[lane] = (lanes[lane] << 31) | (lanes[lane] >> 33);
+        }
+    }
+    uint64_t checksum = size;
+    for (const uint64_t lane : lanes) {
+        checksum = (checksum ^ lane) * PRIME;
+    }
+    for (; position + 8 <= size; position += 8) {
+        uint64_t word;
+        memcpy(&word, data + position, 8);
+        checksum = ((checksum ^ word) * PRIME);
+        checksum = (checksum << 31) | (checksum >> 33);
+    }
+    return checksum ^ (checksum >> 29);
+}
+
+Writer::Writer(const string& path, FileKind kind)
+    : path_(path)
+    , temporary_path_(path + ".tmp"s)
+    , output_(temporary_path_, ios::binary | ios::trunc)
+{
+    if (!output_) {
+        throw runtime_error("can't write "s + temporary_path_);
+    }
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byte_order_mark = BYTE_ORDER_MARK;
+    header.kind = kind;
+    output_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+Writer::~Writer()
+{
+    if (!finished_) {
+        output_.close();
+        error_code error;
+        filesystem::remove(temporary_path_, error);
+    }
+}
+
+void Writer::WriteSection(const SectionWriter& section)
+{
+    const vector<uint8_t>& data = section.GetData();
+    const SectionHeader header = { section.GetType(), 0, data.size(), ComputeChecksum(data.data(), data.size()) };
+    output_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output_.write(reinterpret_cast<const char*>(data.data()), static_cast<streamsize>(data.size()));
+}
+
+void Writer::Finish()
+{
+    output_.close();
+    // the file must be on the disk before it replaces the old one
+    if (!output_ || !SyncFile(temporary_path_)) {
+        throw runtime_error("can't write "s + temporary_path_);
+    }
+    error_code error;
+    filesystem::rename(temporary_path_, path_, error);
+    if (error) {
+        throw runtime_error("can't replace "s + path_ + ": "s + error.message());
+    }
+    finished_ = true;
+}
+
+vector<string_view> SectionReader::ReadStrings()
+{
+    const uint64_t count = Read<uint64_t>();
+    if (count >= size_) {
+        throw invalid_argument("index file has wrong string count"s);
+    }
+    const uint64_t* offsets = Read<uint64_t>(count + 1);
+    const char* texts = Read<char>(offsets[count]);
+    vector<string_view> strings;
+    strings.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1]) {
+            throw invalid_argument("index file has wrong string offsets"s);
+        }
+        strings.emplace_back(texts + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return strings;
+}
+
+void SectionReader::VerifyChecksum() const
+{
+    if (ComputeChecksum(data_, size_) != checksum_) {
+        throw invalid_argument("index file section is corrupted"s);
+    }
+}
+
+Reader::Reader(shared_ptr<const MappedFile> file, FileKind kind)
+    : file_(move(file))
+{
+    const uint8_t* data = file_->Data();
+    const size_t size = file_->Size();
+    Header header;
+    if (size < sizeof(header)) {
+        throw invalid_argument("not an index file"s);
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw invalid_argument("not an index file"s);
+    }
+    if (header.byte_order_mark != BYTE_ORDER_MARK) {
+        throw invalid_argument("index file has a different byte order"s);
+    }
+    if (header.version != VERSION) {
+        throw invalid_argument("unsupported index file version "s + to_string(header.version));
+    }
+    if (header.kind != kind) {
+        throw invalid_argument(kind == FileKind::INDEX ? "not an index file"s : "not a snapshot file"s);
+    }
+    for (size_t position = sizeof(header); position < size;) {
+        SectionHeader section;
+        if (size - position < sizeof(section)) {
+            throw invalid_argument("index file is truncated"s);
+        }
+        memcpy(&section, data + position, sizeof(section));
+        position += sizeof(section);
+        if (section.size > size - position || section.size % 8 != 0) {
+            throw invalid_argument("index file is truncated"s);
+        }
+        // unknown sections are skipped by the readers
+        sections_.push_back({ section.type, data + position, static_cast<size_t>(section.size), section.checksum });
+        position += static_cast<size_t>(section.size);
+    }
+}
+
+SectionReader Reader::GetSection(SectionType type) const
+{
+    const vector<SectionReader> sections = GetSections(type);
+    if (sections.empty()) {
+        throw invalid_argument("index file misses section "s + to_string(static_cast<uint32_t>(type)));
+    }
+    return sections.front();
+}
+
+vector<SectionReader> Reader::GetSections(SectionType type) const
+{
+    vector<SectionReader> sections;
+    for (const Section& section : sections_) {
+        if (section.type == type) {
+            sections.emplace_back(section.data, section.size, section.checksum);
+        }
+    }
+    return sections;
+}
+
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include "headers.h"
+#include "Mapped_file.h"
+#include <fstream>
+using namespace std;
+
+// Binary index and snapshot files: a header and a sequence of length-prefixed
+// sections with checksums. Every section and every array inside it starts at
+// a multiple of 8 bytes, so the arrays of a mapped file are read in place.
+// Numbers are stored in the byte order of the machine that wrote the file,
+// the header records it.
+namespace index_file {
+
+inline constexpr char MAGIC[8] = { 'S', 'S', 'I', 'N', 'D', 'E', 'X', '\0' };
+inline constexpr uint32_t VERSION = 3;
+inline constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+enum class FileKind : uint32_t {
+    // read-only index searched in place
+    INDEX = 1,
+    // full state of a server
+    SNAPSHOT
+};
+
+enum class SectionType : uint32_t {
+    STOP_WORDS = 1,
+    TERMS,
+    DOCUMENTS,
+    FORWARD_INDEX,
+    POSTINGS,
+    DELETED_DOCUMENTS,
+    // lsn of the last write-ahead log record the snapshot holds
+    LOG_POSITION
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    FileKind kind;
+    uint32_t reserved;
+};
+
+struct SectionHeader {
+    SectionType type;
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t checksum;
+};
+
+// Checksum of size bytes, size is a multiple of 8
+uint64_t ComputeChecksum(const uint8_t* data, size_t size);
+
+// Contents of one section collected in memory
+class SectionWriter {
+public:
+    // Contents stored outside a section, such as the payload of a log record
+    SectionWriter() = default;
+
+    explicit SectionWriter(SectionType type)
+        : type_(type)
+    {
+    }
+
+    template <typename T>
+    void Write(const T* values, size_t count)
+    {
+        static_assert(is_trivially_copyable_v<T>, "only trivially copyable values can be written"s);
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+        data_.insert(data_.end(), bytes, bytes + count * sizeof(T));
+        data_.resize((data_.size() + 7) / 8 * 8);
+    }
+
+    template <typename T>
+    void Write(const T& value)
+    {
+        Write(&value, 1);
+    }
+
+    // Writes the strings as their count, count + 1 offsets and the concatenated texts
+    template <typename StringContainer>
+    void WriteStrings(const StringContainer& strings)
+    {
+        vector<uint64_t> offsets = { 0 };
+        string texts;
+        for (const auto& str : strings) {
+            texts += str;
+            offsets.push_back(texts.size());
+        }
+        Write(static_cast<uint64_t>(strings.size()));
+        Write(offsets.data(), offsets.size());
+        Write(texts.data(), texts.size());
+    }
+
+    SectionType GetType() const
+    {
+        return type_;
+    }
+
+    const vector<uint8_t>& GetData() const
+    {
+        return data_;
+    }
+
+private:
+    SectionType type_{};
+    vector<uint8_t> data_;
+};
+
+// Writes the file next to the path and renames it over the path on Finish,
+// so a reader never sees a partly written file and mappings of the old one stay valid.
+// Throws runtime_error when the file can't be written.
+class Writer {
+public:
+    Writer(const string& path, FileKind kind);
+    // Removes the unfinished file
+    ~Writer();
+
+    void WriteSection(const SectionWriter& section);
+    void Finish();
+
+private:
+    string path_;
+    string temporary_path_;
+    ofstream output_;
+    bool finished_ = false;
+};
+
+// Reads the arrays of one section in order without copying them
+class SectionReader {
+public:
+    SectionReader(const uint8_t* data, size_t size, uint64_t checksum)
+        : data_(data)
+        , size_(size)
+        , checksum_(checksum)
+    {
+    }
+
+    // Throws invalid_argument when the section is shorter than the array
+    template <typename T>
+    const T* Read(size_t count)
+    {
+        if (count > (size_ - position_) / sizeof(T)) {
+            throw invalid_argument("index file section is truncated"s);
+        }
+        const T* values = reinterpret_cast<const T*>(data_ + position_);
+        position_ += (count * sizeof(T) + 7) / 8 * 8;
+        position_ = min(position_, size_);
+        return values;
+    }
+
+    template <typename T>
+    T Read()
+    {
+        return *Read<T>(1);
+    }
+
+    vector<string_view> ReadStrings();
+
+    // Throws invalid_argument when the contents don't match the checksum
+    void VerifyChecksum() const;
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    uint64_t checksum_;
+    size_t position_ = 0;
+};
+
+// Checks the header of a mapped file and finds its sections.
+// The checksums are left to the caller: an index is searched in place without
+// reading it whole, a snapshot is verified section by section while loading.
+class Reader {
+public:
+    // Throws invalid_argument when the file isn't of this kind, version and byte order
+    Reader(shared_ptr<const MappedFile> file, FileKind kind);
+
+    // Throws invalid_argument when the file has no such section
+    SectionReader GetSection(SectionType type) const;
+    // All sections of the type in file order
+    vector<SectionReader> GetSections(SectionType type) const;
+
+    const shared_ptr<const MappedFile>& GetFile() const
+    {
+        return file_;
+    }
+
+private:
+    struct Section {
+        SectionType type;
+        const uint8_t* data;
+        size_t size;
+        uint64_t checksum;
+    };
+    shared_ptr<const MappedFile> file_;
+    vector<Section> sections_;
+};
+
+}
@@ -22,7 +22,7 @@ public:
         using namespace std::literals;
         const auto end_time = Clock::now();
         const auto dur = end_time - start_time_;
-        out_ << "Operation time: " << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
+        out_ << id_ << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
     }
 
 private:
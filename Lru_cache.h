@@ -0,0 +1,82 @@
+#pragma once
+#include "headers.h"
+#include "Flat_hash_map.h"
+#include <list>
+using namespace std;
+
+// Map from strings to values holding at most capacity entries: inserting into
+// a full cache evicts the least recently used entry. A zero capacity keeps
+// nothing. Not synchronized, the owner locks around it.
+template <typename Value>
+class LruCache {
+public:
+    explicit LruCache(size_t capacity = 0)
+        : capacity_(capacity)
+    {
+    }
+
+    // nullptr when the key is missing, a found entry becomes the most recently used
+    Value* Find(string_view key)
+    {
+        const auto it = positions_.find(key);
+        if (it == positions_.end()) {
+            return nullptr;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return &it->second->value;
+    }
+
+    // Inserts the entry or replaces the value of the key
+    void Insert(string_view key, Value value)
+    {
+        if (capacity_ == 0) {
+            return;
+        }
+        if (Value* found = Find(key)) {
+            *found = move(value);
+            return;
+        }
+        if (entries_.size() == capacity_) {
+            positions_.erase(string_view(entries_.back().key));
+            entries_.pop_back();
+        }
+        entries_.push_front({ string(key), move(value) });
+        positions_.emplace(string_view(entries_.front().key), entries_.begin());
+    }
+
+    void Clear()
+    {
+        positions_.clear();
+        entries_.clear();
+    }
+
+    // Evicts the least recently used entries above the new capacity
+    void SetCapacity(size_t capacity)
+    {
+        capacity_ = capacity;
+        while (entries_.size() > capacity_) {
+            positions_.erase(string_view(entries_.back().key));
+            entries_.pop_back();
+        }
+    }
+
+    size_t GetCapacity() const
+    {
+        return capacity_;
+    }
+
+    size_t Size() const
+    {
+        return entries_.size();
+    }
+
+private:
+    struct Entry {
+        string key;
+        Value value;
+    };
+    size_t capacity_;
+    // most recently used first, the nodes never move so the keys can be viewed
+    list<Entry> entries_;
+    FlatHashMap<string_view, typename list<Entry>::iterator> positions_;
+};
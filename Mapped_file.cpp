@@ -0,0 +1,86 @@
+#include "Mapped_file.h"
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+shared_ptr<const MappedFile> MappedFile::Open(const string& path)
+{
+    shared_ptr<MappedFile> file(new MappedFile());
+    file->file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file->file_ == INVALID_HANDLE_VALUE) {
+        file->file_ = nullptr;
+        throw runtime_error("can't open "s + path);
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->file_, &size)) {
+        throw runtime_error("can't get the size of "s + path);
+    }
+    file->size_ = static_cast<size_t>(size.QuadPart);
+    if (file->size_ == 0) {
+        return file;
+    }
+    file->mapping_ = CreateFileMappingA(file->file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file->mapping_ == nullptr) {
+        throw runtime_error("can't map "s + path);
+    }
+    file->data_ = static_cast<const uint8_t*>(MapViewOfFile(file->mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (file->data_ == nullptr) {
+        throw runtime_error("can't map "s + path);
+    }
+    return file;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_ != nullptr) {
+        CloseHandle(mapping_);
+    }
+    if (file_ != nullptr) {
+        CloseHandle(file_);
+    }
+}
+#else
+shared_ptr<const MappedFile> MappedFile::Open(const string& path)
+{
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw runtime_error("can't open "s + path);
+    }
+    shared_ptr<MappedFile> file(new MappedFile());
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        throw runtime_error("can't get the size of "s + path);
+    }
+    file->size_ = static_cast<size_t>(status.st_size);
+    if (file->size_ > 0) {
+        void* data = mmap(nullptr, file->size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (data == MAP_FAILED) {
+            close(descriptor);
+            throw runtime_error("can't map "s + path);
+        }
+        file->data_ = static_cast<const uint8_t*>(data);
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(descriptor);
+    return file;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+}
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// A whole file mapped read-only into memory, unmapped when the last owner is gone
+class MappedFile {
+public:
+    // Throws runtime_error when the file can't be opened or mapped
+    static shared_ptr<const MappedFile> Open(const string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const uint8_t* Data() const
+    {
+        return data_;
+    }
+
+    size_t Size() const
+    {
+        return size_;
+    }
+
+private:
+    MappedFile() = default;
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#if defined(_WIN32)
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
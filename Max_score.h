@@ -0,0 +1,242 @@
+#pragma once
+#include "Document.h"
+#include "Document_filter.h"
+#include "Posting_list.h"
+#include "Bitmap.h"
+#include "Top_documents.h"
+#include "Persistent_vector.h"
+using namespace std;
+
+// Document-at-a-time top-k evaluation with MaxScore pruning.
+// Terms are ordered by the upper bound of their score (idf * max term frequency).
+// Terms whose bounds together can't reach the current k-th relevance are
+// non-essential: only documents from the essential postings become candidates,
+// and a candidate is dropped as soon as its partial score plus the bounds of
+// the remaining terms (refined by the block maximums) falls below the k-th.
+// With required terms the candidates are the intersection of their postings
+// instead, and every candidate is scored by all terms with the same pruning.
+// Returns exactly the top-k of exhaustive scoring.
+class MaxScoreEvaluator {
+public:
+    void AddTerm(const PostingList& postings, double inverse_document_freq)
+    {
+        if (!postings.Empty()) {
+            terms_.push_back({ PostingList::Cursor(postings), inverse_document_freq, inverse_document_freq * postings.MaxTermFreq() });
+        }
+    }
+
+    // Only documents with all the required terms are returned, they are scored like the other terms
+    void AddRequiredTerm(const PostingList& postings, double inverse_document_freq)
+    {
+        required_.push_back(&postings);
+        AddTerm(postings, inverse_document_freq);
+    }
+
+    // The documents are skipped before scoring, the bitmap must outlive the evaluator
+    void AddExcludedDocuments(const Bitmap& excluded)
+    {
+        excluded_.push_back(&excluded);
+    }
+
+    // Only the documents in allowed are scored, the bitmap must outlive the evaluator.
+    // Like the filter it is read a block of BLOCK_SIZE internal ids at once.
+    void SetAllowedDocuments(const Bitmap& allowed)
+    {
+        allowed_.emplace(allowed);
+        filter_block_ = numeric_limits<size_t>::max();
+    }
+
+    // Only the documents passing the filter are scored. The filter is evaluated over the
+    // block of BLOCK_SIZE internal ids of a candidate at once, a leaf of the columns indexed
+    // by internal id. The filter and the columns must outlive the evaluator.
+    void SetDocumentFilter(const DocumentFilter& filter, const PersistentVector<DocumentStatus>& statuses, const PersistentVector<int>& ratings)
+    {
+        static_assert(PersistentVector<int>::LEAF_SIZE == DocumentFilter::BLOCK_SIZE);
+        filter_ = &filter;
+        statuses_ = &statuses;
+        ratings_ = &ratings;
+        filter_block_ = numeric_limits<size_t>::max();
+    }
+
+    // make_document(internal_id, relevance) returns nullopt for documents rejected by the predicate
+    template <typename MakeDocument>
+    vector<Document> FindTopDocuments(size_t result_count, MakeDocument make_document)
+    {
+        TopDocuments top_documents(result_count);
+        FindTopDocuments(top_documents, make_document);
+        return top_documents.Extract();
+    }
+
+    // Adds the documents to top_documents, its current k-th relevance is the initial threshold
+    template <typename MakeDocument>
+    void FindTopDocuments(TopDocuments& top_documents, MakeDocument make_document)
+    {
+        if (top_documents.GetCapacity() == 0) {
+            return;
+        }
+        sort(terms_.begin(), terms_.end(), [](const Term& lhs, const Term& rhs) {
+            return lhs.upper_bound < rhs.upper_bound;
+            });
+        // bound_sums[i] is the upper bound of the score from the terms 0..i
+        vector<double> bound_sums(terms_.size());
+        double bound_sum = 0.0;
+        for (size_t i = 0; i < terms_.size(); ++i) {
+            bound_sum += terms_[i].upper_bound;
+            bound_sums[i] = bound_sum;
+        }
+        double threshold = top_documents.IsFull() ? top_documents.GetThreshold() : -numeric_limits<double>::infinity();
+        if (!required_.empty()) {
+            for (const uint32_t internal_id : IntersectPostings(required_)) {
+                double relevance = 0.0;
+                if (IsSkipped(internal_id) || !ScoreNonEssential(internal_id, terms_.size(), bound_sums, threshold, relevance)) {
+                    continue;
+                }
+                ++scored_document_count_;
+                const optional<Document> document = make_document(internal_id, relevance);
+                if (document) {
+                    top_documents.Add(*document);
+                    if (top_documents.IsFull()) {
+                        threshold = top_documents.GetThreshold();
+                    }
+                }
+            }
+            return;
+        }
+        size_t first_essential = 0;
+        while (first_essential < terms_.size() && bound_sums[first_essential] < threshold - epsilon) {
+            ++first_essential;
+        }
+        while (true) {
+            uint32_t internal_id = numeric_limits<uint32_t>::max();
+            for (size_t i = first_essential; i < terms_.size(); ++i) {
+                if (!terms_[i].cursor.AtEnd()) {
+                    internal_id = min(internal_id, terms_[i].cursor.DocumentId());
+                }
+            }
+            if (internal_id == numeric_limits<uint32_t>::max()) {
+                break;
+            }
+            double relevance = 0.0;
+            for (size_t i = first_essential; i < terms_.size(); ++i) {
+                PostingList::Cursor& cursor = terms_[i].cursor;
+                if (!cursor.AtEnd() && cursor.DocumentId() == internal_id) {
+                    relevance += terms_[i].inverse_document_freq * cursor.TermFreq();
+                    cursor.Next();
+                }
+            }
+            if (IsSkipped(internal_id) || !ScoreNonEssential(internal_id, first_essential, bound_sums, threshold, relevance)) {
+                continue;
+            }
+            ++scored_document_count_;
+            const optional<Document> document = make_document(internal_id, relevance);
+            if (!document) {
+                continue;
+            }
+            top_documents.Add(*document);
+            if (top_documents.IsFull()) {
+                threshold = top_documents.GetThreshold();
+                while (first_essential < terms_.size() && bound_sums[first_essential] < threshold - epsilon) {
+                    ++first_essential;
+                }
+            }
+        }
+    }
+
+    // Number of documents that survived pruning and were fully scored
+    size_t GetScoredDocumentCount() const
+    {
+        return scored_document_count_;
+    }
+
+private:
+    struct Term {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double upper_bound;
+    };
+    vector<Term> terms_;
+    vector<const PostingList*> required_;
+    vector<const Bitmap*> excluded_;
+    optional<Bitmap::WordReader> allowed_;
+    const DocumentFilter* filter_ = nullptr;
+    const PersistentVector<DocumentStatus>* statuses_ = nullptr;
+    const PersistentVector<int>* ratings_ = nullptr;
+    // the block the candidates came from last and its filter mask
+    size_t filter_block_ = numeric_limits<size_t>::max();
+    uint64_t filter_mask_ = 0;
+    size_t scored_document_count_ = 0;
+
+    // Adds the scores of the non-essential terms, returns false once the document can't reach the threshold
+    bool ScoreNonEssential(uint32_t internal_id, size_t first_essential, const vector<double>& bound_sums, double threshold, double& relevance)
+    {
+        if (first_essential == 0) {
+            return true;
+        }
+        double block_bound = relevance;
+        for (size_t i = 0; i < first_essential; ++i) {
+            block_bound += terms_[i].inverse_document_freq * terms_[i].cursor.ShallowMaxTermFreq(internal_id);
+        }
+        if (block_bound < threshold - epsilon) {
+            return false;
+        }
+        for (size_t i = first_essential; i-- > 0;) {
+            if (relevance + bound_sums[i] < threshold - epsilon) {
+                return false;
+            }
+            PostingList::Cursor& cursor = terms_[i].cursor;
+            cursor.NextGeq(internal_id);
+            if (!cursor.AtEnd() && cursor.DocumentId() == internal_id) {
+                relevance += terms_[i].inverse_document_freq * cursor.TermFreq();
+            }
+        }
+        return true;
+    }
+
+    bool IsSkipped(uint32_t internal_id)
+    {
+        if ((allowed_ || filter_ != nullptr) && !PassesFilter(internal_id)) {
+            return true;
+        }
+        for (const Bitmap* excluded : excluded_) {
+            if (excluded->Contains(internal_id)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The candidates come in id order, so a block is mostly matched once for all its candidates
+    bool PassesFilter(uint32_t internal_id)
+    {
+        constexpr size_t BLOCK_SIZE = DocumentFilter::BLOCK_SIZE;
+        const size_t block = internal_id / BLOCK_SIZE;
+        if (block != filter_block_) {
+            MatchFilterBlock(block);
+        }
+        return (filter_mask_ >> (internal_id % BLOCK_SIZE)) & 1;
+    }
+
+    void MatchFilterBlock(size_t block)
+    {
+        constexpr size_t BLOCK_SIZE = DocumentFilter::BLOCK_SIZE;
+        const size_t first_id = block * BLOCK_SIZE;
+        filter_block_ = block;
+        filter_mask_ = allowed_ ? allowed_->Read(static_cast<uint32_t>(first_id)) : ~uint64_t{ 0 };
+        if (filter_ == nullptr || filter_mask_ == 0) {
+            return;
+        }
+        const size_t count = min(BLOCK_SIZE, statuses_->Size() - first_id);
+        if (count == BLOCK_SIZE) {
+            filter_mask_ &= filter_->MatchBlock(statuses_->GetLeaf(first_id), ratings_->GetLeaf(first_id), count);
+        }
+        else {
+            // the last block is shorter, MatchBlock reads whole blocks and the rest
+            // of the last leaf may be written by a newer version meanwhile
+            DocumentStatus statuses[BLOCK_SIZE] = {};
+            int ratings[BLOCK_SIZE] = {};
+            copy_n(statuses_->GetLeaf(first_id), count, statuses);
+            copy_n(ratings_->GetLeaf(first_id), count, ratings);
+            filter_mask_ &= filter_->MatchBlock(statuses, ratings, count);
+        }
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include "headers.h"
+#include "Persistent_vector.h"
+using namespace std;
+
+// Hash index of dense ids whose keys live elsewhere: an open-addressing table with
+// linear probing storing only the ids, the caller compares and hashes the keys by id.
+// Stored in a PersistentVector, so copies share it like the vectors holding the keys.
+// An id can't be erased, it is dropped by the next growth once is_live says it is dead.
+class PersistentIdTable {
+public:
+    inline static constexpr uint32_t EMPTY = numeric_limits<uint32_t>::max();
+
+    // The id for which equal(id) is true or EMPTY
+    template <typename Equal>
+    uint32_t Find(size_t hash, Equal equal) const
+    {
+        if (slots_.Empty()) {
+            return EMPTY;
+        }
+        const size_t mask = slots_.Size() - 1;
+        // the probes mostly stay within one leaf
+        for (size_t first_slot = hash & mask & ~(LEAF_SIZE - 1), i = hash % LEAF_SIZE;; first_slot = (first_slot + LEAF_SIZE) & mask, i = 0) {
+            const uint32_t* leaf = slots_.GetLeaf(first_slot);
+            for (; i < LEAF_SIZE; ++i) {
+                if (leaf[i] == EMPTY) {
+                    return EMPTY;
+                }
+                if (equal(leaf[i])) {
+                    return leaf[i];
+                }
+            }
+        }
+    }
+
+    // Adds an id whose key isn't present. On growth get_hash(id) gives the hash
+    // of the stored ids and those with is_live(id) false are dropped.
+    template <typename GetHash, typename IsLive>
+    void Insert(size_t hash, uint32_t id, GetHash get_hash, IsLive is_live)
+    {
+        if ((used_count_ + 1) * 2 > slots_.Size()) {
+            Rebuild(get_hash, is_live);
+        }
+        InsertSlot(hash, id);
+    }
+
+    // Holds the ids [0, id_count) with is_live(id) true
+    template <typename GetHash, typename IsLive>
+    void Assign(uint32_t id_count, GetHash get_hash, IsLive is_live)
+    {
+        size_t live_count = 0;
+        for (uint32_t id = 0; id < id_count; ++id) {
+            live_count += is_live(id) ? 1 : 0;
+        }
+        Reset(live_count);
+        for (uint32_t id = 0; id < id_count; ++id) {
+            if (is_live(id)) {
+                InsertSlot(get_hash(id), id);
+            }
+        }
+    }
+
+    size_t MemoryUsage() const
+    {
+        return slots_.MemoryUsage();
+    }
+
+private:
+    inline static constexpr size_t LEAF_SIZE = PersistentVector<uint32_t>::LEAF_SIZE;
+    // a power of two, at most half full
+    PersistentVector<uint32_t> slots_;
+    // ids stored, dead ones included
+    size_t used_count_ = 0;
+
+    void Reset(size_t id_count)
+    {
+        size_t slot_count = LEAF_SIZE;
+        while (slot_count < id_count * 4) {
+            slot_count *= 2;
+        }
+        slots_ = PersistentVector<uint32_t>(slot_count, EMPTY);
+        used_count_ = 0;
+    }
+
+    void InsertSlot(size_t hash, uint32_t id)
+    {
+        const size_t mask = slots_.Size() - 1;
+        size_t slot = hash & mask;
+        while (slots_[slot] != EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        slots_.Set(slot, id);
+        ++used_count_;
+    }
+
+    template <typename GetHash, typename IsLive>
+    void Rebuild(GetHash get_hash, IsLive is_live)
+    {
+        vector<uint32_t> ids;
+        ids.reserve(used_count_ + 1);
+        slots_.ForEach([&](size_t, uint32_t id) {
+            if (id != EMPTY && is_live(id)) {
+                ids.push_back(id);
+            }
+            });
+        Reset(ids.size() + 1);
+        for (const uint32_t id : ids) {
+            InsertSlot(get_hash(id), id);
+        }
+    }
+};
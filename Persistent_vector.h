@@ -0,0 +1,206 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// Vector whose copies share their storage: a radix tree of leaves of LEAF_SIZE
+// values under inner nodes of FANOUT children. Copying is O(1); changing a value
+// copies the nodes on its path that another copy still holds, so a copy is never
+// changed by the others. Appending writes the new value in place even into shared
+// nodes, the copies sharing them never read past their own size: only the copy
+// that appended last may go on that way, the others copy the path to their tail
+// first. Not synchronized, but a copy can be read while another one is changed.
+template <typename T>
+class PersistentVector {
+public:
+    inline static constexpr size_t LEAF_SIZE = 64;
+
+    PersistentVector() = default;
+    PersistentVector(const PersistentVector&) = default;
+    PersistentVector& operator=(const PersistentVector&) = default;
+
+    PersistentVector(PersistentVector&& other) noexcept
+        : root_(move(other.root_))
+        , frontier_(move(other.frontier_))
+        , depth_(exchange(other.depth_, 0))
+        , size_(exchange(other.size_, 0))
+    {
+    }
+
+    PersistentVector& operator=(PersistentVector&& other) noexcept
+    {
+        if (this != &other) {
+            root_ = move(other.root_);
+            frontier_ = move(other.frontier_);
+            depth_ = exchange(other.depth_, 0);
+            size_ = exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    explicit PersistentVector(size_t size, const T& value = T())
+    {
+        Resize(size, value);
+    }
+
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    bool Empty() const
+    {
+        return size_ == 0;
+    }
+
+    const T& operator[](size_t index) const
+    {
+        return GetLeaf(index)[index % LEAF_SIZE];
+    }
+
+    // The LEAF_SIZE values starting at first_index, a multiple of LEAF_SIZE.
+    // Only those below Size() belong to this copy, another one may be appending to the rest.
+    const T* GetLeaf(size_t first_index) const
+    {
+        const void* node = root_.get();
+        for (size_t level = depth_; level > 0; --level) {
+            node = static_cast<const Inner*>(node)->children[ChildIndex(first_index, level)].get();
+        }
+        return static_cast<const Leaf*>(node)->values.data();
+    }
+
+    // Copies the nodes on the path shared with other copies
+    T& GetMutable(size_t index)
+    {
+        shared_ptr<void>* node = &root_;
+        for (size_t level = depth_; level > 0; --level) {
+            MakeUnique<Inner>(*node);
+            node = &static_cast<Inner*>(node->get())->children[ChildIndex(index, level)];
+        }
+        MakeUnique<Leaf>(*node);
+        return static_cast<Leaf*>(node->get())->values[index % LEAF_SIZE];
+    }
+
+    void Set(size_t index, T value)
+    {
+        GetMutable(index) = move(value);
+    }
+
+    void PushBack(T value)
+    {
+        if (!frontier_ || *frontier_ != size_) {
+            Detach();
+        }
+        if (size_ == GetCapacity()) {
+            auto root = make_shared<Inner>();
+            root->children[0] = move(root_);
+            root_ = move(root);
+            ++depth_;
+        }
+        shared_ptr<void>* node = &root_;
+        for (size_t level = depth_; level > 0; --level) {
+            if (!*node) {
+                *node = make_shared<Inner>();
+            }
+            node = &static_cast<Inner*>(node->get())->children[ChildIndex(size_, level)];
+        }
+        if (!*node) {
+            *node = make_shared<Leaf>();
+        }
+        static_cast<Leaf*>(node->get())->values[size_ % LEAF_SIZE] = move(value);
+        *frontier_ = ++size_;
+    }
+
+    // Appends values up to size, a smaller size leaves the vector as it is
+    void Resize(size_t size, const T& value = T())
+    {
+        while (size_ < size) {
+            PushBack(value);
+        }
+    }
+
+    void Clear()
+    {
+        *this = PersistentVector();
+    }
+
+    // Calls func(index, value) for every value in index order
+    template <typename Func>
+    void ForEach(Func func) const
+    {
+        for (size_t first_index = 0; first_index < size_; first_index += LEAF_SIZE) {
+            const T* values = GetLeaf(first_index);
+            const size_t count = min(LEAF_SIZE, size_ - first_index);
+            for (size_t i = 0; i < count; ++i) {
+                func(first_index + i, values[i]);
+            }
+        }
+    }
+
+    // Bytes of the nodes, those shared with other copies included
+    size_t MemoryUsage() const
+    {
+        const size_t leaf_count = (size_ + LEAF_SIZE - 1) / LEAF_SIZE;
+        return leaf_count * sizeof(Leaf) + (leaf_count + FANOUT - 2) / (FANOUT - 1) * sizeof(Inner);
+    }
+
+private:
+    inline static constexpr size_t FANOUT = 64;
+    inline static constexpr size_t SHIFT = 6;
+    static_assert(LEAF_SIZE == FANOUT && size_t{ 1 } << SHIFT == FANOUT);
+
+    struct Leaf {
+        array<T, LEAF_SIZE> values{};
+    };
+
+    struct Inner {
+        array<shared_ptr<void>, FANOUT> children;
+    };
+
+    shared_ptr<void> root_;
+    // the size of the copy that appended last, shared by the copies of the nodes it appended to
+    shared_ptr<size_t> frontier_;
+    // number of inner levels above the leaves
+    size_t depth_ = 0;
+    size_t size_ = 0;
+
+    static size_t ChildIndex(size_t index, size_t level)
+    {
+        return (index >> (SHIFT * level)) % FANOUT;
+    }
+
+    size_t GetCapacity() const
+    {
+        return size_t{ LEAF_SIZE } << (SHIFT * depth_);
+    }
+
+    template <typename Node>
+    static void MakeUnique(shared_ptr<void>& node)
+    {
+        if (node.use_count() > 1) {
+            node = make_shared<Node>(*static_cast<const Node*>(node.get()));
+        }
+    }
+
+    // Takes own copies of the nodes on the path to the last value without what
+    // other copies appended there, so appending changes no shared node
+    void Detach()
+    {
+        frontier_ = make_shared<size_t>(size_);
+        if (size_ == 0) {
+            root_.reset();
+            depth_ = 0;
+            return;
+        }
+        const size_t last = size_ - 1;
+        shared_ptr<void>* node = &root_;
+        for (size_t level = depth_; level > 0; --level) {
+            auto inner = make_shared<Inner>(*static_cast<const Inner*>(node->get()));
+            fill(inner->children.begin() + ChildIndex(last, level) + 1, inner->children.end(), nullptr);
+            *node = move(inner);
+            node = &static_cast<Inner*>(node->get())->children[ChildIndex(last, level)];
+        }
+        auto leaf = make_shared<Leaf>(*static_cast<const Leaf*>(node->get()));
+        fill(leaf->values.begin() + last % LEAF_SIZE + 1, leaf->values.end(), T());
+        *node = move(leaf);
+    }
+};
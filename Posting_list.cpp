@@ -0,0 +1,396 @@
+#include "Posting_list.h"
+#include "Cpu_features.h"
+#include <array>
+#include <atomic>
+#if defined(SEARCH_SERVER_X86)
+#include <immintrin.h>
+#endif
+
+struct StreamVByteTables {
+    // shuffle masks spreading the packed deltas of a group over 4 uint32 lanes
+    array<array<uint8_t, 16>, 256> shuffles;
+    array<uint8_t, 256> lengths;
+};
+
+static StreamVByteTables MakeStreamVByteTables()
+{
+    StreamVByteTables tables;
+    for (int control = 0; control < 256; ++control) {
+        uint8_t offset = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            const int length = ((control >> (2 * lane)) & 3) + 1;
+            for (int byte = 0; byte < 4; ++byte) {
+                tables.shuffles[control][lane * 4 + byte] = byte < length ? offset + byte : 0x80;
+            }
+            offset += length;
+        }
+        tables.lengths[control] = offset;
+    }
+    return tables;
+}
+
+static const StreamVByteTables stream_vbyte_tables = MakeStreamVByteTables();
+
+// Decodes count deltas starting from base, advances data past the consumed bytes
+static void DecodeScalar(const uint8_t* controls, const uint8_t*& data, size_t first, size_t count, uint32_t& base, uint32_t* document_ids)
+{
+    for (size_t i = first; i < count; ++i) {
+        const int length = ((controls[i / 4] >> (2 * (i % 4))) & 3) + 1;
+        uint32_t delta = 0;
+        for (int byte = 0; byte < length; ++byte) {
+            delta |= static_cast<uint32_t>(data[byte]) << (8 * byte);
+        }
+        data += length;
+        base += delta;
+        document_ids[i] = base;
+    }
+}
+
+#if defined(SEARCH_SERVER_X86)
+// Decodes whole groups of 4 deltas with one shuffle and a vector prefix sum,
+// never reads past data_end, returns the number of decoded ids
+SEARCH_SERVER_TARGET("sse4.1")
+static size_t DecodeSse41(const uint8_t* controls, const uint8_t*& data, const uint8_t* data_end, size_t count, uint32_t& base, uint32_t* document_ids)
+{
+    __m128i previous = _mm_set1_epi32(static_cast<int>(base));
+    size_t decoded = 0;
+    for (; decoded + 4 <= count && data + 16 <= data_end; decoded += 4) {
+        const uint8_t control = controls[decoded / 4];
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stream_vbyte_tables.shuffles[control].data()));
+        __m128i deltas = _mm_shuffle_epi8(packed, shuffle);
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+        previous = _mm_add_epi32(deltas, previous);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(document_ids + decoded), previous);
+        previous = _mm_shuffle_epi32(previous, 0xFF);
+        data += stream_vbyte_tables.lengths[control];
+    }
+    base = static_cast<uint32_t>(_mm_cvtsi128_si32(previous));
+    return decoded;
+}
+#endif
+
+static atomic<bool> vectorized_decoding{ true };
+
+void EnableVectorizedDecoding(bool enable)
+{
+    vectorized_decoding = enable;
+}
+
+PostingList::PostingList(const PostingList& other)
+{
+    *this = other;
+}
+
+PostingList::PostingList(PostingList&& other) noexcept
+{
+    *this = move(other);
+}
+
+PostingList& PostingList::operator=(const PostingList& other)
+{
+    if (this == &other) {
+        return *this;
+    }
+    controls_ = other.controls_;
+    data_ = other.data_;
+    term_freqs_ = other.term_freqs_;
+    blocks_ = other.blocks_;
+    owned_ = other.owned_;
+    view_ = other.view_;
+    if (owned_) {
+        UpdateView();
+    }
+    return *this;
+}
+
+PostingList& PostingList::operator=(PostingList&& other) noexcept
+{
+    if (this == &other) {
+        return *this;
+    }
+    // the buffers move with the vectors, so the view stays valid
+    controls_ = move(other.controls_);
+    data_ = move(other.data_);
+    term_freqs_ = move(other.term_freqs_);
+    blocks_ = move(other.blocks_);
+    owned_ = other.owned_;
+    view_ = other.view_;
+    other.controls_.clear();
+    other.data_.clear();
+    other.term_freqs_.clear();
+    other.blocks_.clear();
+    other.owned_ = true;
+    other.view_ = View();
+    return *this;
+}
+
+PostingList PostingList::FromView(const View& view)
+{
+    PostingList postings;
+    postings.view_ = view;
+    postings.owned_ = false;
+    return postings;
+}
+
+void PostingList::Add(uint32_t document_id, double term_freq)
+{
+    if (Empty() || document_id > BlockLastDocumentId(BlockCount() - 1)) {
+        Append(document_id, term_freq);
+        return;
+    }
+    vector<uint32_t> document_ids = DecodeAll();
+    vector<double> term_freqs(view_.term_freqs, view_.term_freqs + view_.size);
+    const auto it = lower_bound(document_ids.begin(), document_ids.end(), document_id);
+    const size_t index = it - document_ids.begin();
+    if (it != document_ids.end() && *it == document_id) {
+        term_freqs[index] += term_freq;
+    }
+    else {
+        document_ids.insert(it, document_id);
+        term_freqs.insert(term_freqs.begin() + index, term_freq);
+    }
+    Assign(document_ids, term_freqs);
+}
+
+void PostingList::Remove(uint32_t document_id)
+{
+    vector<uint32_t> document_ids = DecodeAll();
+    const auto it = lower_bound(document_ids.begin(), document_ids.end(), document_id);
+    if (it == document_ids.end() || *it != document_id) {
+        return;
+    }
+    vector<double> term_freqs(view_.term_freqs, view_.term_freqs + view_.size);
+    term_freqs.erase(term_freqs.begin() + (it - document_ids.begin()));
+    document_ids.erase(it);
+    Assign(document_ids, term_freqs);
+}
+
+void PostingList::Remap(const vector<uint32_t>& new_ids)
+{
+    const vector<uint32_t> old_document_ids = DecodeAll();
+    const vector<double> old_term_freqs(view_.term_freqs, view_.term_freqs + view_.size);
+    vector<uint32_t> document_ids;
+    vector<double> term_freqs;
+    for (size_t i = 0; i < old_document_ids.size(); ++i) {
+        const uint32_t document_id = new_ids[old_document_ids[i]];
+        if (document_id != numeric_limits<uint32_t>::max()) {
+            document_ids.push_back(document_id);
+            term_freqs.push_back(old_term_freqs[i]);
+        }
+    }
+    Assign(document_ids, term_freqs);
+}
+
+size_t PostingList::DecodeBlock(size_t block, uint32_t* document_ids) const
+{
+    const size_t count = min(BLOCK_SIZE, Size() - block * BLOCK_SIZE);
+    const uint8_t* controls = view_.controls + block * BLOCK_SIZE / 4;
+    const uint8_t* data = view_.data + view_.blocks[block].data_offset;
+    uint32_t base = block > 0 ? view_.blocks[block - 1].last_document_id : 0;
+    size_t decoded = 0;
+#if defined(SEARCH_SERVER_X86)
+    if (GetCpuFeatures().sse41 && vectorized_decoding.load(memory_order_relaxed)) {
+        decoded = DecodeSse41(controls, data, view_.data + view_.data_size, count, base, document_ids);
+    }
+#endif
+    DecodeScalar(controls, data, decoded, count, base, document_ids);
+    return count;
+}
+
+size_t PostingList::MemoryUsage() const
+{
+    return sizeof(*this) + controls_.capacity() + data_.capacity()
+        + term_freqs_.capacity() * sizeof(double) + blocks_.capacity() * sizeof(Block);
+}
+
+void PostingList::ShrinkToFit()
+{
+    controls_.shrink_to_fit();
+    data_.shrink_to_fit();
+    term_freqs_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+    if (owned_) {
+        UpdateView();
+    }
+}
+
+void PostingList::MakeOwned()
+{
+    if (owned_) {
+        return;
+    }
+    controls_.assign(view_.controls, view_.controls + view_.controls_size);
+    data_.assign(view_.data, view_.data + view_.data_size);
+    term_freqs_.assign(view_.term_freqs, view_.term_freqs + view_.size);
+    blocks_.assign(view_.blocks, view_.blocks + view_.block_count);
+    owned_ = true;
+    UpdateView();
+}
+
+void PostingList::UpdateView()
+{
+    view_.controls = controls_.data();
+    view_.controls_size = controls_.size();
+    view_.data = data_.data();
+    view_.data_size = data_.size();
+    view_.term_freqs = term_freqs_.data();
+    view_.size = term_freqs_.size();
+    view_.blocks = blocks_.data();
+    view_.block_count = blocks_.size();
+}
+
+void PostingList::Append(uint32_t document_id, double term_freq)
+{
+    MakeOwned();
+    const size_t index = Size();
+    const uint32_t delta = blocks_.empty() ? document_id : document_id - blocks_.back().last_document_id;
+    if (index % BLOCK_SIZE == 0) {
+        blocks_.push_back({ document_id, static_cast<uint32_t>(data_.size()), term_freq });
+    }
+    else {
+        blocks_.back().last_document_id = document_id;
+        blocks_.back().max_term_freq = max(blocks_.back().max_term_freq, term_freq);
+    }
+    view_.max_term_freq = max(view_.max_term_freq, term_freq);
+    if (index % 4 == 0) {
+        controls_.push_back(0);
+    }
+    const int length = delta < (1u << 8) ? 1 : delta < (1u << 16) ? 2 : delta < (1u << 24) ? 3 : 4;
+    controls_.back() |= static_cast<uint8_t>((length - 1) << (2 * (index % 4)));
+    for (int byte = 0; byte < length; ++byte) {
+        data_.push_back(static_cast<uint8_t>(delta >> (8 * byte)));
+    }
+    term_freqs_.push_back(term_freq);
+    UpdateView();
+}
+
+void PostingList::Assign(const vector<uint32_t>& document_ids, const vector<double>& term_freqs)
+{
+    controls_.clear();
+    data_.clear();
+    term_freqs_.clear();
+    blocks_.clear();
+    owned_ = true;
+    view_ = View();
+    UpdateView();
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        Append(document_ids[i], term_freqs[i]);
+    }
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+    : postings_(&postings)
+{
+    LoadBlock(0);
+}
+
+void PostingList::Cursor::Next()
+{
+    if (++position_ == count_) {
+        LoadBlock(block_ + 1);
+    }
+}
+
+void PostingList::Cursor::NextGeq(uint32_t document_id)
+{
+    if (AtEnd() || DocumentId() >= document_id) {
+        return;
+    }
+    if (postings_->BlockLastDocumentId(block_) < document_id) {
+        const size_t block_count = postings_->BlockCount();
+        size_t first = max(block_ + 1, shallow_block_);
+        size_t step = 1;
+        while (first + step <= block_count && postings_->BlockLastDocumentId(first + step - 1) < document_id) {
+            first += step;
+            step *= 2;
+        }
+        size_t last = min(first + step, block_count);
+        // the target block is in [first, last)
+        while (first < last) {
+            const size_t middle = first + (last - first) / 2;
+            if (postings_->BlockLastDocumentId(middle) < document_id) {
+                first = middle + 1;
+            }
+            else {
+                last = middle;
+            }
+        }
+        LoadBlock(first);
+        if (AtEnd()) {
+            return;
+        }
+    }
+    size_t step = 1;
+    while (position_ + step < count_ && document_ids_[position_ + step] < document_id) {
+        position_ += step;
+        step *= 2;
+    }
+    position_ = lower_bound(document_ids_ + position_, document_ids_ + min(position_ + step + 1, count_), document_id) - document_ids_;
+}
+
+double PostingList::Cursor::ShallowMaxTermFreq(uint32_t document_id)
+{
+    shallow_block_ = max(shallow_block_, block_);
+    while (shallow_block_ < postings_->BlockCount() && postings_->BlockLastDocumentId(shallow_block_) < document_id) {
+        ++shallow_block_;
+    }
+    return shallow_block_ < postings_->BlockCount() ? postings_->BlockMaxTermFreq(shallow_block_) : 0.0;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block)
+{
+    block_ = block;
+    position_ = 0;
+    count_ = block < postings_->BlockCount() ? postings_->DecodeBlock(block, document_ids_) : 0;
+}
+
+vector<uint32_t> IntersectPostings(vector<const PostingList*> postings)
+{
+    vector<uint32_t> document_ids;
+    if (postings.empty()) {
+        return document_ids;
+    }
+    sort(postings.begin(), postings.end(), [](const PostingList* lhs, const PostingList* rhs) {
+        return lhs->Size() < rhs->Size();
+        });
+    vector<PostingList::Cursor> cursors;
+    cursors.reserve(postings.size());
+    for (const PostingList* posting_list : postings) {
+        cursors.emplace_back(*posting_list);
+    }
+    PostingList::Cursor& rarest = cursors.front();
+    while (!rarest.AtEnd()) {
+        uint32_t document_id = rarest.DocumentId();
+        bool matched = true;
+        for (size_t i = 1; i < cursors.size(); ++i) {
+            cursors[i].NextGeq(document_id);
+            if (cursors[i].AtEnd()) {
+                return document_ids;
+            }
+            if (cursors[i].DocumentId() != document_id) {
+                document_id = cursors[i].DocumentId();
+                matched = false;
+                break;
+            }
+        }
+        if (matched) {
+            document_ids.push_back(document_id);
+            rarest.Next();
+        }
+        else {
+            rarest.NextGeq(document_id);
+        }
+    }
+    return document_ids;
+}
+
+vector<uint32_t> PostingList::DecodeAll() const
+{
+    vector<uint32_t> document_ids(Size());
+    for (size_t block = 0; block < BlockCount(); ++block) {
+        DecodeBlock(block, document_ids.data() + block * BLOCK_SIZE);
+    }
+    return document_ids;
+}
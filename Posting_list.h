@@ -0,0 +1,170 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// Postings of one term: ascending document ids with their term frequencies.
+// The ids are stored as deltas in the StreamVByte layout: every control byte
+// holds the byte lengths of 4 deltas, the deltas are packed into data_.
+// Postings are split into blocks of BLOCK_SIZE ids that decode independently.
+// A list either owns its arrays or views arrays owned by someone else,
+// such as a mapped index file; changing a viewing list copies the arrays first.
+class PostingList {
+public:
+    inline static constexpr size_t BLOCK_SIZE = 128;
+
+    struct Block {
+        uint32_t last_document_id;
+        uint32_t data_offset;
+        double max_term_freq;
+    };
+
+    // The arrays the list is read from
+    struct View {
+        const uint8_t* controls = nullptr;
+        size_t controls_size = 0;
+        const uint8_t* data = nullptr;
+        size_t data_size = 0;
+        const double* term_freqs = nullptr;
+        size_t size = 0;
+        const Block* blocks = nullptr;
+        size_t block_count = 0;
+        double max_term_freq = 0.0;
+    };
+
+    PostingList() = default;
+    PostingList(const PostingList& other);
+    PostingList(PostingList&& other) noexcept;
+    PostingList& operator=(const PostingList& other);
+    PostingList& operator=(PostingList&& other) noexcept;
+
+    // A list reading the arrays of the view in place, they must outlive it
+    static PostingList FromView(const View& view);
+
+    const View& GetView() const
+    {
+        return view_;
+    }
+
+    // Appending an id greater than all stored ones is O(1),
+    // any other id rebuilds the list.
+    void Add(uint32_t document_id, double term_freq);
+    void Remove(uint32_t document_id);
+    // Renumbers the ids by new_ids[old id], the renumbering must keep their order.
+    // Ids mapped to numeric_limits<uint32_t>::max() are dropped.
+    void Remap(const vector<uint32_t>& new_ids);
+
+    size_t Size() const
+    {
+        return view_.size;
+    }
+
+    bool Empty() const
+    {
+        return view_.size == 0;
+    }
+
+    size_t BlockCount() const
+    {
+        return view_.block_count;
+    }
+
+    // Decodes the ids of the block into document_ids, returns their count
+    size_t DecodeBlock(size_t block, uint32_t* document_ids) const;
+
+    const double* BlockTermFreqs(size_t block) const
+    {
+        return view_.term_freqs + block * BLOCK_SIZE;
+    }
+
+    uint32_t BlockLastDocumentId(size_t block) const
+    {
+        return view_.blocks[block].last_document_id;
+    }
+
+    double BlockMaxTermFreq(size_t block) const
+    {
+        return view_.blocks[block].max_term_freq;
+    }
+
+    double MaxTermFreq() const
+    {
+        return view_.max_term_freq;
+    }
+
+    // Walks the postings in document id order decoding one block at a time
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList& postings);
+
+        bool AtEnd() const
+        {
+            return block_ >= postings_->BlockCount();
+        }
+
+        uint32_t DocumentId() const
+        {
+            return document_ids_[position_];
+        }
+
+        double TermFreq() const
+        {
+            return postings_->BlockTermFreqs(block_)[position_];
+        }
+
+        void Next();
+        // Moves to the first document id not less than document_id,
+        // gallops over the last ids of the blocks and then inside the block
+        void NextGeq(uint32_t document_id);
+        // Upper bound of the term frequency of document_id, reads no postings
+        double ShallowMaxTermFreq(uint32_t document_id);
+
+    private:
+        const PostingList* postings_;
+        size_t block_ = 0;
+        size_t shallow_block_ = 0;
+        size_t position_ = 0;
+        size_t count_ = 0;
+        uint32_t document_ids_[BLOCK_SIZE];
+
+        void LoadBlock(size_t block);
+    };
+
+    template <typename Func>
+    void ForEach(Func func) const
+    {
+        uint32_t document_ids[BLOCK_SIZE];
+        for (size_t block = 0; block < BlockCount(); ++block) {
+            const size_t count = DecodeBlock(block, document_ids);
+            const double* term_freqs = BlockTermFreqs(block);
+            for (size_t i = 0; i < count; ++i) {
+                func(document_ids[i], term_freqs[i]);
+            }
+        }
+    }
+
+    // Memory owned by the list, viewed arrays excluded
+    size_t MemoryUsage() const;
+    void ShrinkToFit();
+
+private:
+    vector<uint8_t> controls_;
+    vector<uint8_t> data_;
+    vector<double> term_freqs_;
+    vector<Block> blocks_;
+    View view_;
+    bool owned_ = true;
+
+    void MakeOwned();
+    void UpdateView();
+    void Append(uint32_t document_id, double term_freq);
+    void Assign(const vector<uint32_t>& document_ids, const vector<double>& term_freqs);
+    vector<uint32_t> DecodeAll() const;
+};
+
+// Ids present in all the postings. The postings are walked from the shortest,
+// the others only skip to its ids, so the cost follows the shortest list.
+vector<uint32_t> IntersectPostings(vector<const PostingList*> postings);
+
+// Switches between the vectorized and the scalar decoder,
+// the vectorized one is used by default when the CPU supports it
+void EnableVectorizedDecoding(bool enable);
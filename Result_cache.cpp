@@ -0,0 +1,210 @@
+#include "Result_cache.h"
+
+void FrequencySketch::Resize(size_t capacity)
+{
+    size_t width = 16;
+    while (width < capacity) {
+        width *= 2;
+    }
+    counters_.assign(width * ROW_COUNT, 0);
+    row_mask_ = width - 1;
+    sample_size_ = max<size_t>(capacity, 1) * 10;
+    additions_ = 0;
+}
+
+size_t FrequencySketch::GetIndex(uint64_t hash, size_t row) const
+{
+    // every row takes other bits of a remixed hash
+    static constexpr array<uint64_t, ROW_COUNT> SEEDS = { 0xC3A5C85C97CB3127ull, 0xB492B66FBE98F273ull, 0x9AE16A3B2F90404Full, 0xCBF29CE484222325ull };
+    uint64_t value = (hash + SEEDS[row]) * 0x9E3779B97F4A7C15ull;
+    value ^= value >> 32;
+    return row * (row_mask_ + 1) + (value & row_mask_);
+}
+
+void FrequencySketch::Increment(uint64_t hash)
+{
+    if (counters_.empty()) {
+        return;
+    }
+    bool added = false;
+    for (size_t row = 0; row < ROW_COUNT; ++row) {
+        uint8_t& counter = counters_[GetIndex(hash, row)];
+        if (counter < MAX_COUNT) {
+            ++counter;
+            added = true;
+        }
+    }
+    if (added && ++additions_ >= sample_size_) {
+        for (uint8_t& counter : counters_) {
+            counter >>= 1;
+        }
+        additions_ /= 2;
+    }
+}
+
+int FrequencySketch::Estimate(uint64_t hash) const
+{
+    if (counters_.empty()) {
+        return 0;
+    }
+    int estimate = MAX_COUNT;
+    for (size_t row = 0; row < ROW_COUNT; ++row) {
+        estimate = min<int>(estimate, counters_[GetIndex(hash, row)]);
+    }
+    return estimate;
+}
+
+size_t ResultCache::KeyHash::operator()(const Key& key) const
+{
+    const uint64_t combined = hash<string_view>{}(key.query)
+        ^ (static_cast<uint64_t>(key.document_count) * 0x9E3779B97F4A7C15ull)
+        ^ (static_cast<uint64_t>(key.status) << 56);
+    return FlatHash<uint64_t>::Mix(combined);
+}
+
+ResultCache::ResultCache(size_t capacity, size_t shard_count)
+    : capacity_(0)
+{
+    if (shard_count == 0) {
+        throw invalid_argument("result cache needs a shard"s);
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(make_unique<Shard>());
+    }
+    SetCapacity(capacity);
+}
+
+void ResultCache::SetCapacity(size_t capacity)
+{
+    const size_t shard_capacity = (capacity + shards_.size() - 1) / shards_.size();
+    for (const unique_ptr<Shard>& shard : shards_) {
+        lock_guard<mutex> guard(shard->lock);
+        shard->positions.clear();
+        shard->window.clear();
+        shard->probation.clear();
+        shard->protected_entries.clear();
+        // 1% of the entries in the window, 80% of the main part protected
+        shard->window_capacity = shard_capacity > 0 ? max<size_t>(shard_capacity / 100, 1) : 0;
+        shard->main_capacity = shard_capacity - shard->window_capacity;
+        shard->protected_capacity = shard->main_capacity * 4 / 5;
+        shard->sketch.Resize(shard_capacity);
+    }
+    capacity_ = capacity;
+}
+
+ResultCache::Shard& ResultCache::GetShard(size_t hash)
+{
+    // the table uses the low bits, the shard is picked by the high ones
+    return *shards_[(hash >> 32) % shards_.size()];
+}
+
+list<ResultCache::Entry>& ResultCache::GetList(Shard& shard, Part part)
+{
+    switch (part) {
+    case Part::WINDOW:
+        return shard.window;
+    case Part::PROBATION:
+        return shard.probation;
+    default:
+        return shard.protected_entries;
+    }
+}
+
+void ResultCache::Erase(Shard& shard, list<Entry>::iterator entry)
+{
+    shard.positions.erase(Key{ entry->query, entry->status, entry->document_count });
+    GetList(shard, entry->part).erase(entry);
+}
+
+optional<vector<Document>> ResultCache::Find(const Key& key, uint64_t epoch)
+{
+    if (!IsEnabled()) {
+        return nullopt;
+    }
+    const size_t hash = KeyHash{}(key);
+    Shard& shard = GetShard(hash);
+    lock_guard<mutex> guard(shard.lock);
+    // misses count too, so a query asked again is admitted
+    shard.sketch.Increment(hash);
+    const auto position = shard.positions.find(key);
+    if (position == shard.positions.end()) {
+        ++misses_;
+        return nullopt;
+    }
+    const list<Entry>::iterator entry = position->second;
+    if (entry->epoch != epoch) {
+        Erase(shard, entry);
+        ++misses_;
+        return nullopt;
+    }
+    if (entry->part == Part::WINDOW) {
+        shard.window.splice(shard.window.begin(), shard.window, entry);
+    }
+    else {
+        // found again in the main part: protected, the oldest protected entry goes back to probation
+        shard.protected_entries.splice(shard.protected_entries.begin(), GetList(shard, entry->part), entry);
+        entry->part = Part::PROTECTED;
+        if (shard.protected_entries.size() > shard.protected_capacity) {
+            const auto oldest = prev(shard.protected_entries.end());
+            oldest->part = Part::PROBATION;
+            shard.probation.splice(shard.probation.begin(), shard.protected_entries, oldest);
+        }
+    }
+    ++hits_;
+    return entry->documents;
+}
+
+void ResultCache::Insert(const Key& key, uint64_t epoch, vector<Document> documents)
+{
+    if (!IsEnabled()) {
+        return;
+    }
+    const size_t hash = KeyHash{}(key);
+    Shard& shard = GetShard(hash);
+    lock_guard<mutex> guard(shard.lock);
+    if (shard.window_capacity == 0) {
+        return;
+    }
+    const auto position = shard.positions.find(key);
+    if (position != shard.positions.end()) {
+        // another thread found it meanwhile
+        position->second->epoch = epoch;
+        position->second->documents = move(documents);
+        return;
+    }
+    shard.window.push_front({ string(key.query), key.status, key.document_count, hash, epoch, move(documents), Part::WINDOW });
+    const Entry& entry = shard.window.front();
+    shard.positions.emplace(Key{ entry.query, entry.status, entry.document_count }, shard.window.begin());
+    EvictFromWindow(shard);
+}
+
+void ResultCache::EvictFromWindow(Shard& shard)
+{
+    while (shard.window.size() > shard.window_capacity) {
+        const list<Entry>::iterator candidate = prev(shard.window.end());
+        if (shard.probation.size() + shard.protected_entries.size() < shard.main_capacity) {
+            candidate->part = Part::PROBATION;
+            shard.probation.splice(shard.probation.begin(), shard.window, candidate);
+            continue;
+        }
+        list<Entry>& victims = shard.probation.empty() ? shard.protected_entries : shard.probation;
+        if (victims.empty()) {
+            Erase(shard, candidate);
+            continue;
+        }
+        const list<Entry>::iterator victim = prev(victims.end());
+        if (shard.sketch.Estimate(candidate->hash) > shard.sketch.Estimate(victim->hash)) {
+            Erase(shard, victim);
+            candidate->part = Part::PROBATION;
+            shard.probation.splice(shard.probation.begin(), shard.window, candidate);
+        }
+        else {
+            Erase(shard, candidate);
+        }
+    }
+}
+
+ResultCache::Stats ResultCache::GetStats() const
+{
+    return { hits_.load(), misses_.load() };
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "headers.h"
+#include "Document.h"
+#include "Flat_hash_map.h"
+#include <list>
+using namespace std;
+
+// Count-min sketch of how often hashes were seen lately: 4 rows of counters
+// saturating at 15, all halved after every sample of 10 * capacity increments
+// so old popularity fades.
+class FrequencySketch {
+public:
+    void Resize(size_t capacity);
+    void Increment(uint64_t hash);
+    int Estimate(uint64_t hash) const;
+
+private:
+    inline static constexpr size_t ROW_COUNT = 4;
+    inline static constexpr uint8_t MAX_COUNT = 15;
+    vector<uint8_t> counters_;
+    size_t row_mask_ = 0;
+    size_t sample_size_ = 0;
+    size_t additions_ = 0;
+
+    size_t GetIndex(uint64_t hash, size_t row) const;
+};
+
+// Top documents of FindTopDocuments by query, status and number of documents.
+// Every entry is stamped with the epoch of the index it was found in and an
+// entry of an older epoch is dropped when looked up, so changing the index only
+// bumps the epoch. The keys are spread over shards locked separately; a shard
+// admits in the W-TinyLFU way: new entries wait in a small LRU window and an
+// entry leaving it replaces the least recently used entry of the main part only
+// if the sketch saw it more often, so a scan of one-off queries can't evict hot ones.
+// The main part is a segmented LRU: entries found again move to its protected part.
+class ResultCache {
+public:
+    struct Key {
+        string_view query;
+        DocumentStatus status;
+        size_t document_count;
+
+        bool operator==(const Key& other) const
+        {
+            return query == other.query && status == other.status && document_count == other.document_count;
+        }
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    inline static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+
+    // A zero capacity keeps nothing
+    explicit ResultCache(size_t capacity = 0, size_t shard_count = DEFAULT_SHARD_COUNT);
+
+    // Drops all the entries, the capacity is split between the shards
+    void SetCapacity(size_t capacity);
+
+    bool IsEnabled() const
+    {
+        return capacity_.load(memory_order_relaxed) > 0;
+    }
+
+    // nullopt when the key is missing or its entry is older than epoch
+    optional<vector<Document>> Find(const Key& key, uint64_t epoch);
+    void Insert(const Key& key, uint64_t epoch, vector<Document> documents);
+    Stats GetStats() const;
+
+private:
+    enum class Part {
+        WINDOW,
+        PROBATION,
+        PROTECTED,
+    };
+
+    struct Entry {
+        string query;
+        DocumentStatus status;
+        size_t document_count;
+        uint64_t hash;
+        uint64_t epoch;
+        vector<Document> documents;
+        Part part;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Shard {
+        mutex lock;
+        size_t window_capacity = 0;
+        size_t main_capacity = 0;
+        size_t protected_capacity = 0;
+        // most recently used first
+        list<Entry> window;
+        list<Entry> probation;
+        list<Entry> protected_entries;
+        // the keys view the queries of the entries
+        FlatHashMap<Key, list<Entry>::iterator, KeyHash> positions;
+        FrequencySketch sketch;
+    };
+
+    atomic<size_t> capacity_;
+    vector<unique_ptr<Shard>> shards_;
+    atomic<uint64_t> hits_{ 0 };
+    atomic<uint64_t> misses_{ 0 };
+
+    Shard& GetShard(size_t hash);
+    static list<Entry>& GetList(Shard& shard, Part part);
+    static void Erase(Shard& shard, list<Entry>::iterator entry);
+    // Moves the window entries above its capacity to the main part or drops them
+    static void EvictFromWindow(Shard& shard);
+};
@@ -1,35 +1,31 @@
 ﻿#pragma once
 #include "headers.h"
 #include "Log_duration.h"
+#include "Concurrent_map.h"
+#include "Flat_hash_map.h"
+#include "Small_vector.h"
+#include "Lru_cache.h"
+#include "Result_cache.h"
+#include "Term_dictionary.h"
+#include "Posting_list.h"
+#include "Idf_cache.h"
+#include "Document_id_map.h"
+#include "Document_filter.h"
+#include "Max_score.h"
+#include "Top_documents.h"
+#include "Bitmap.h"
+#include "Segment.h"
+#include "Mapped_file.h"
+#include "Index_file.h"
+#include "Write_ahead_log.h"
+#include "Search_index.h"
+#include "Versioned.h"
 using namespace std;
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double epsilon = 1e-6;
-struct Document {
-    int id;
-    double relevance;
-    int rating;
-    Document() {
-        id = 0;
-        relevance = 0.0;
-        rating = 0;
-    }
-    Document(int id, double relevance, int rating)
-        : id(id)
-        , relevance(relevance)
-        , rating(rating) {
-    }
-};
-
-enum class DocumentStatus {
-    ACTUAL,
-    IRRELEVANT,
-    BANNED,
-    REMOVED,
-};
 template <typename StringContainer>
-set<string> MakeUniqueNonEmptyStrings(const StringContainer& strings)
+FlatHashSet<string> MakeUniqueNonEmptyStrings(const StringContainer& strings)
 {
-    set<string> non_empty_strings;
+    FlatHashSet<string> non_empty_strings;
     for (const auto& str : strings) {
         if (!str.empty()) {
             non_empty_strings.insert(string(str));
@@ -51,9 +47,9 @@ public:
 
     template <typename StringContainer>
     SearchServer(const StringContainer& stop_words)
-        : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+        : index_(MakeUniqueNonEmptyStrings(stop_words))
     {
-        for (const auto& stop_word : stop_words_) {
+        for (const auto& stop_word : index_.GetPublished().GetStopWords()) {
             if (!IsValidWord(stop_word)) {
                 throw invalid_argument("wrong stop words"s);
             }
@@ -62,32 +58,27 @@ public:
     explicit SearchServer();
     explicit SearchServer(const string& stop_words_text);
     explicit SearchServer(const string_view stop_words_text);
+    ~SearchServer();
     void AddDocument(int document_id, const string_view document, const DocumentStatus& status, const vector<int>& ratings);
+    // Adds all the documents or none: throws like AddDocument before changing anything.
+    // The parallel version tokenizes the documents in chunks on all cores,
+    // every chunk interns its words once when the chunks are merged into the index.
+    void AddDocuments(const vector<DocumentInput>& documents);
+    void AddDocuments(const std::execution::sequenced_policy&, const vector<DocumentInput>& documents);
+    void AddDocuments(const std::execution::parallel_policy&, const vector<DocumentInput>& documents);
 
     template <typename Func>
     vector<Document> FindTopDocuments(string_view raw_query, const Func& func) const
     {
-        const Query query = ParseQuery(raw_query);
-        auto matched_documents = FindAllDocuments(query, func);
-        sort(matched_documents.begin(), matched_documents.end(),
-            [](const Document& lhs, const Document& rhs) {
-                if (abs(lhs.relevance - rhs.relevance) < epsilon) {
-                    return lhs.rating > rhs.rating;
-                }
-                else {
-                    return lhs.relevance > rhs.relevance;
-                }
-            });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
-        return matched_documents;
+        // the published contents stay pinned, writers meanwhile publish new versions
+        const auto index = index_.Read();
+        return FindTopDocuments(*index, GetQuery(*index, raw_query), func, GetMaxResultDocumentCount());
     }
 
     template <typename ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
         if constexpr (is_same_v<ExecutionPolicy, execution::sequenced_policy>) {
-            return FindTopDocumentsSeq(raw_query, document_predicate);
+            return FindTopDocuments(raw_query, document_predicate);
         }
         else {
             return FindTopDocumentsPar(policy, raw_query, document_predicate);
@@ -102,199 +93,434 @@ public:
             return FindTopDocuments(raw_query, status);
         }
         else {
-            return FindTopDocumentsPar(policy, raw_query, [status](int document_id, DocumentStatus statuss, int rating)
-                { return statuss == status; });
+            return FindCachedTopDocuments(raw_query, status, [&](const SearchIndex& index, const Query& query, size_t document_count) {
+                return FindTopDocuments(policy, index, query, DocumentFilter{ status, RatingRange{} }, document_count);
+                });
         }
     }
 
     vector<Document> FindTopDocuments(string_view raw_query) const; //*
 
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status, RatingRange rating_range) const;
+
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query) const { //*
         if constexpr (is_same_v<ExecutionPolicy, execution::sequenced_policy>) {
             return FindTopDocuments(raw_query);
         }
         else {
-            return FindTopDocumentsPar(policy, raw_query, [](int document_id, DocumentStatus status, int rating)
-                { return status == DocumentStatus::ACTUAL; });
+            return FindCachedTopDocuments(raw_query, DocumentStatus::ACTUAL, [&](const SearchIndex& index, const Query& query, size_t document_count) {
+                return FindTopDocuments(policy, index, query, DocumentFilter{ DocumentStatus::ACTUAL, RatingRange{} }, document_count);
+                });
         }
     }
     
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocumentsPar(const std::execution::parallel_policy& par, std::string_view raw_query, DocumentPredicate document_predicate) const {
-        const Query query = ParseQuery(par, raw_query);
-        auto matched_documents = FindAllDocuments(par, query, document_predicate);
-        sort(matched_documents.begin(), matched_documents.end(),
-            [](const Document& lhs, const Document& rhs) {
-                if (abs(lhs.relevance - rhs.relevance) < epsilon) {
-                    return lhs.rating > rhs.rating;
-                }
-                else {
-                    return lhs.relevance > rhs.relevance;
-                }
-            });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
-        return matched_documents;
+        const auto index = index_.Read();
+        const Query query = GetQuery(*index, raw_query);
+        return FindTopDocuments(par, *index, query, document_predicate, GetMaxResultDocumentCount());
     }
       
     tuple<vector<string_view>, DocumentStatus> MatchDocument(const string_view raw_query, int document_id) const;
     tuple<vector<string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy seq, const string_view raw_query, int document_id) const;
     tuple<vector<string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy par, const string_view raw_query, int document_id) const;
+    // The ids of the documents in ascending order. Unlike the queries they don't pin the
+    // contents: iterate only while no documents are added, removed or loaded, a writer
+    // running meanwhile can leave the iterators dangling.
     auto begin()
     {
-        return document_ids_.begin();
+        return index_.GetPublished().GetDocumentIds().begin();
     }
 
     auto end()
     {
-        return document_ids_.end();
+        return index_.GetPublished().GetDocumentIds().end();
     }
 
     auto begin() const
     {
-        return document_ids_.begin();
+        return index_.GetPublished().GetDocumentIds().begin();
     }
 
     auto end() const
     {
-        return document_ids_.end();
+        return index_.GetPublished().GetDocumentIds().end();
     }
     const map<string_view, double> GetWordFrequencies(int document_id) const;
+    // Marks the document as deleted. The background thread drops it from the postings
+    // and renumbers the internal ids once most of them belong to removed documents.
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
     size_t GetDocumentCount() const
     {
-        return documents_.size();
+        return index_.Read()->GetDocumentIds().Size();
+    }
+    // Lets the cached idf of a word lag behind while the number of documents
+    // changes by no more than the given share, 0 keeps the relevance exact
+    void SetIdfTolerance(double tolerance);
+    // Keeps the results of up to this many recent FindTopDocuments calls filtered
+    // by status only, keyed by the normalized query, the status and the number of documents.
+    // Any change of the documents makes them stale. 0, the default, turns the cache off.
+    void SetResultCacheCapacity(size_t capacity)
+    {
+        result_cache_.SetCapacity(capacity);
+    }
+    ResultCache::Stats GetResultCacheStats() const
+    {
+        return result_cache_.GetStats();
     }
+    // Keeps the parsed form of up to this many recent raw queries, malformed ones
+    // with their parse error, the capacity is split between the shards. 0, the default,
+    // turns the cache off and queries skip it without locking.
+    void SetQueryCacheCapacity(size_t capacity);
+    // Number of documents returned by FindTopDocuments, MAX_RESULT_DOCUMENT_COUNT by default
+    void SetMaxResultDocumentCount(size_t count)
+    {
+        max_result_document_count_.store(count, memory_order_relaxed);
+    }
+    size_t GetMaxResultDocumentCount() const
+    {
+        return max_result_document_count_.load(memory_order_relaxed);
+    }
+    // New documents go to a mutable segment sealed once it holds this many documents,
+    // a background thread merges MERGE_FACTOR sealed segments of the same size level
+    void SetSegmentCapacity(size_t document_count);
+    // Removed documents stay in the postings marked as deleted, a background thread
+    // rewrites a sealed segment once this share of its documents is deleted
+    void SetCompactionThreshold(double deleted_ratio);
+    // The internal ids of removed documents stay unused, a background thread renumbers
+    // all documents once this share of the ids is unused
+    void SetIdCompactionThreshold(double unused_ratio);
+    // Number of sealed segments
+    size_t GetSegmentCount() const;
+    // Number of removed documents not yet dropped from the postings
+    size_t GetDeletedDocumentCount() const;
+    // Blocks until no merge is running or due
+    void WaitForMerges();
+    // Writes the documents, the dictionary and the postings merged into one segment
+    // to a read-only index file, throws runtime_error when it can't be written
+    void SaveIndex(const string& path) const;
+    // Replaces the contents of the server by a file written by SaveIndex.
+    // The file is mapped and its postings are searched in place; documents added
+    // afterwards go to new segments. Throws runtime_error when the file can't be
+    // opened and invalid_argument when it isn't an index of this version.
+    void OpenIndex(const string& path);
+    // Writes the whole state of the server: stop words, dictionary, documents,
+    // segments and deleted documents. Queries go on while the postings are written.
+    // Throws runtime_error when the file can't be written.
+    void SaveSnapshot(const string& path) const;
+    // Replaces the contents of the server by a file written by SaveSnapshot,
+    // the sections are checked and read in parallel. Throws runtime_error when
+    // the file can't be opened and invalid_argument when it is corrupted.
+    void LoadSnapshot(const string& path);
+    // Appends every later AddDocument and RemoveDocument to the log at path, they return
+    // once their record is as durable as sync_mode promises. The records newer than the
+    // contents of the server are replayed first, so after a crash the state is recovered
+    // by LoadSnapshot of the latest snapshot (if any) and OpenWriteAheadLog.
+    void OpenWriteAheadLog(const string& path, WriteAheadLog::SyncMode sync_mode = WriteAheadLog::SyncMode::EVERY_COMMIT,
+        chrono::milliseconds sync_interval = DEFAULT_SYNC_INTERVAL);
+    // Saves a snapshot and drops the log records it holds
+    void Checkpoint(const string& snapshot_path);
+    inline static constexpr chrono::milliseconds DEFAULT_SYNC_INTERVAL{ 10 };
+    inline static constexpr size_t DEFAULT_SEGMENT_CAPACITY = SearchIndex::DEFAULT_SEGMENT_CAPACITY;
+    inline static constexpr size_t MERGE_FACTOR = SearchIndex::MERGE_FACTOR;
+    inline static constexpr double DEFAULT_COMPACTION_THRESHOLD = SearchIndex::DEFAULT_COMPACTION_THRESHOLD;
+    inline static constexpr double DEFAULT_ID_COMPACTION_THRESHOLD = SearchIndex::DEFAULT_ID_COMPACTION_THRESHOLD;
 private:
+    // serializes the writers, queries never take it
     mutable mutex global_mutex;
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
+    inline static constexpr size_t CONCURRENT_BUCKET_COUNT = 100;
+    // read by the queries, which take no lock
+    atomic<size_t> max_result_document_count_{ MAX_RESULT_DOCUMENT_COUNT };
+    // queries pin the published version of the contents without locking, a writer
+    // changes a copy sharing all it doesn't touch and publishes it without waiting
+    Versioned<SearchIndex> index_;
+    shared_ptr<WriteAheadLog> write_ahead_log_;
+    // lsn of the last logged change in the contents
+    uint64_t log_position_ = 0;
+    thread merge_thread_;
+    condition_variable merge_condition_;
+    bool merging_ = false;
+    bool stop_merging_ = false;
+    // parsed queries spread over shards locked separately, as the result cache does
+    struct CachedQuery;
+    struct QueryCacheShard {
+        mutex lock;
+        LruCache<shared_ptr<const CachedQuery>> queries;
+    };
+    inline static constexpr size_t QUERY_CACHE_SHARD_COUNT = ResultCache::DEFAULT_SHARD_COUNT;
+    mutable array<QueryCacheShard, QUERY_CACHE_SHARD_COUNT> query_cache_;
+    // zero while the cache is off, checked before locking a shard
+    atomic<size_t> query_cache_capacity_{ 0 };
+    mutable ResultCache result_cache_;
+    // bumped once a change of the results is published, the cached results of older epochs are stale
+    atomic<uint64_t> index_epoch_{ 0 };
+    // Publishes the contents changed by change, global_mutex must be held
+    template <typename Change>
+    void ChangeIndex(Change change)
+    {
+        index_.Write(change);
+    }
+    static bool ContainsTerm(TermFreqsView term_freqs, TermId term);
+    uint32_t GetInternalId(const SearchIndex& index, int document_id) const;
+    // Starts the merge thread once a segment was sealed and wakes it up, global_mutex must be held
+    void StartMerging();
+    void MergeSegments();
+    static bool IsMergeDue(const SearchIndex& index)
+    {
+        return index.IsCompactionDue() || index.FindMerge();
+    }
+    // Renumbers the internal ids densely, the lock is released while the sealed segments are remapped
+    void CompactDocuments(unique_lock<mutex>& lock);
+    // Appends the change to the write-ahead log if there is one,
+    // returns the log and the lsn to sync once the lock is released
+    template <typename WritePayload>
+    pair<shared_ptr<WriteAheadLog>, uint64_t> LogChange(WriteAheadLog::RecordType type, WritePayload write_payload)
+    {
+        if (!write_ahead_log_) {
+            return { nullptr, 0 };
+        }
+        index_file::SectionWriter payload;
+        write_payload(payload);
+        log_position_ = write_ahead_log_->Append(type, payload);
+        return { write_ahead_log_, log_position_ };
+    }
+    void ReplayChange(WriteAheadLog::RecordType type, index_file::SectionReader payload);
+    pair<shared_ptr<WriteAheadLog>, uint64_t> LogAddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings);
+    // Throws invalid_argument when the id can't be given to a new document
+    void CheckNewDocumentId(int document_id) const;
+    // Words of a chunk of documents numbered by first occurrence,
+    // the term frequencies of its documents use these local ids
+    struct TokenizedChunk {
+        vector<string_view> words;
+        vector<TermFreqs> term_freqs;
     };
-    set<string> stop_words_;
-    map<int, map<string, double>> word_to_document_freqs_;
-    map<int, DocumentData> documents_;
-    set<int> document_ids_;
-    bool IsStopWord(const string& word) const;
-    static bool IsValidWord(const string& word);
-    vector<string> SplitIntoWordsNoStop(const string_view text) const;
+    template <typename ExecutionPolicy>
+    void AddDocuments(const ExecutionPolicy& policy, const vector<DocumentInput>& documents, size_t chunk_count);
+    // Returns the log position the snapshot holds
+    uint64_t WriteSnapshot(const string& path) const;
+    static void WriteDictionary(const SearchIndex& index, index_file::SectionWriter& stop_words, index_file::SectionWriter& terms);
+    static void WriteDocuments(const SearchIndex& index, const vector<uint32_t>& internal_ids,
+        index_file::SectionWriter& documents, index_file::SectionWriter& forward_index);
+    static FlatHashSet<string> ReadStopWords(index_file::SectionReader section);
+    static TermDictionary ReadTerms(index_file::SectionReader section);
+    // with_removed allows the holes of removed documents
+    static SearchIndex::DocumentColumns ReadDocuments(index_file::SectionReader section, bool with_removed);
+    // Publishes the contents read from a file in place of the current ones
+    void ReplaceContents(SearchIndex contents);
+    // Evaluates the filter over blocks of candidates and keeps the matched ones in top_documents
+    void FilterDocuments(const SearchIndex& index, const DocumentFilter& filter, const FlatHashMap<uint32_t, double>& document_to_relevance,
+        TopDocuments& top_documents) const;
+    static bool IsValidWord(const string_view word);
+    // Fills the reused buffer words, throws invalid_argument for a control character
+    static void SplitIntoWordsNoStop(const SearchIndex& index, const string_view text, vector<string_view>& words);
     static int ComputeAverageRating(const vector<int>& ratings);
+    // data views the raw query
     struct QueryWord {
-        string data;
+        string_view data;
         bool is_minus;
+        bool is_required;
         bool is_stop;
     };
-    QueryWord ParseQueryWord(string text) const;
+    static QueryWord ParseQueryWord(const SearchIndex& index, string_view text);
+    // Words of the query resolved to term ids, sorted and without duplicates.
+    // Words missing from the dictionary can't match anything and are dropped.
+    // Required words (+word) are plus words every found document must contain.
+    // The terms of a typical query fit the inline storage, so parsing doesn't allocate.
+    using QueryTerms = SmallVector<TermId, 8>;
     struct Query {
-        set<string, less<>> plus_words;
-        set<string, less<>> minus_words;
+        QueryTerms plus_terms;
+        QueryTerms minus_terms;
+        QueryTerms required_terms;
+        // a required word is missing from the dictionary
+        bool matches_nothing = false;
+        // a word is missing from the dictionary, new documents may change the query
+        bool has_unknown_words = false;
+    };
+    // A parsed query or the invalid_argument its parsing threw. The query is current for
+    // contents of the same generation while the dictionary has dictionary_size terms
+    // or no word was unknown.
+    struct CachedQuery {
+        Query query;
+        exception_ptr error;
+        uint64_t generation;
+        size_t dictionary_size;
     };
-    Query ParseQuery(const string_view text) const;
-    Query ParseQuery(std::execution::parallel_policy,const string_view text) const;
-    Query ParseQuery(std::execution::sequenced_policy, const string_view text) const;
+    QueryCacheShard& GetQueryCacheShard(string_view raw_query) const;
+    static void AddQueryWord(const SearchIndex& index, Query& query, const QueryWord& query_word);
+    static void SortUniqueTerms(QueryTerms& terms);
+    // Union of the documents containing the minus words of the query
+    static Bitmap GetExcludedDocuments(const SearchIndex& index, const Query& query);
+    // The document is deleted, outside allowed or in excluded
+    static bool IsSkipped(const SearchIndex& index, uint32_t internal_id, const Bitmap* allowed, const Bitmap& excluded)
+    {
+        return (allowed != nullptr && !allowed->Contains(internal_id))
+            || excluded.Contains(internal_id) || index.GetDeletedDocuments().Contains(internal_id);
+    }
+    static vector<Document> MergeTopDocuments(const vector<TopDocuments>& partial_top_documents, size_t document_count);
+    static Query ParseQuery(const SearchIndex& index, const string_view text);
+    // ParseQuery through the query cache
+    Query GetQuery(const SearchIndex& index, const string_view raw_query) const;
+    // The generation and the sorted plus, required and minus term ids of the query as bytes:
+    // word order, repeated, stop and unknown words don't change it
+    static string GetNormalizedQuery(const SearchIndex& index, const Query& query);
+    // Results of find(index, query, document_count), a search with a status filter only,
+    // through the result cache keyed by the normalized query
+    template <typename Find>
+    vector<Document> FindCachedTopDocuments(string_view raw_query, DocumentStatus status, Find find) const
+    {
+        // the epoch is read before pinning the contents, a change meanwhile only makes the entry stale sooner
+        const uint64_t epoch = index_epoch_.load();
+        const auto index = index_.Read();
+        const Query query = GetQuery(*index, raw_query);
+        // read once, the entry holds as many documents as its key says
+        const size_t document_count = GetMaxResultDocumentCount();
+        if (!result_cache_.IsEnabled() || query.matches_nothing) {
+            return find(*index, query, document_count);
+        }
+        const string normalized_query = GetNormalizedQuery(*index, query);
+        const ResultCache::Key key{ normalized_query, status, document_count };
+        if (optional<vector<Document>> documents = result_cache_.Find(key, epoch)) {
+            return move(*documents);
+        }
+        vector<Document> documents = find(*index, query, document_count);
+        result_cache_.Insert(key, epoch, documents);
+        return documents;
+    }
 
     template <typename Func>
-    vector<Document> FindAllDocuments(const Query& query, const Func& func) const
+    vector<Document> FindTopDocuments(const SearchIndex& index, const Query& query, const Func& func, size_t document_count) const
     {
-        lock_guard<mutex> guard(global_mutex);
-        map<int, double> document_to_relevance;
-        map<string_view, int> id_idf;
-        map<int, map<string_view, double>> id_tdf;
-        // prepare tf-idf
-        for (const auto& id_w_fr : word_to_document_freqs_) {
-            for (const auto& word : query.plus_words) {
-                if (id_w_fr.second.count(string(word))) {
-                    id_idf[word] += 1;
-                    id_tdf[id_w_fr.first][word] = id_w_fr.second.at(string(word));
+        if (query.matches_nothing) {
+            return {};
+        }
+        const Bitmap excluded = GetExcludedDocuments(index, query);
+        // the filter is matched over blocks of candidates before they are scored, a predicate after
+        const auto make_document = [&](uint32_t internal_id, double relevance) -> optional<Document> {
+            const int document_id = index.GetDocumentIds().GetExternal(internal_id);
+            const int rating = index.GetRating(internal_id);
+            if constexpr (!is_same_v<Func, DocumentFilter>) {
+                if (!func(document_id, index.GetStatus(internal_id), rating)) {
+                    return nullopt;
                 }
             }
-
-        }
-        for (const auto& [document_id, w_fr] : id_tdf) {
-            if (func(document_id, documents_.at(document_id).status, documents_.at(document_id).rating)) {
-                for (const auto& word : w_fr) {
-                    document_to_relevance[document_id] +=
-                        (static_cast<double>(log(document_ids_.size() * 1.0 / static_cast<double>(id_idf.at(word.first)))) * word.second);
+            return Document(document_id, relevance, rating);
+        };
+        // the segments are searched in id order, each continues the same top documents
+        TopDocuments top_documents(document_count);
+        for (const Segment* segment : index.GetSegments()) {
+            MaxScoreEvaluator evaluator;
+            for (const TermId term : query.plus_terms) {
+                if (binary_search(query.required_terms.begin(), query.required_terms.end(), term)) {
+                    evaluator.AddRequiredTerm(segment->GetPostings(term), index.GetIdf(term));
+                }
+                else {
+                    evaluator.AddTerm(segment->GetPostings(term), index.GetIdf(term));
                 }
             }
-        }
-        // erase documents with minus words
-        int badid = -1;
-        for (const auto& id_w_fr : word_to_document_freqs_) {
-            for (const auto& word : query.minus_words) {
-                if (id_w_fr.second.count(string(word))) {
-                    badid = id_w_fr.first;
-                    break;
+            evaluator.AddExcludedDocuments(excluded);
+            evaluator.AddExcludedDocuments(index.GetDeletedDocuments());
+            if constexpr (is_same_v<Func, DocumentFilter>) {
+                // the status bitmap narrows the candidates, the columns are matched for a rating range only
+                evaluator.SetAllowedDocuments(index.GetStatusDocuments(func.status));
+                if (!func.rating_range.IsUnbounded()) {
+                    evaluator.SetDocumentFilter(func, index.GetStatuses(), index.GetRatings());
                 }
             }
-            badid >= 0 ? document_to_relevance.erase(badid) : badid = -1;
+            evaluator.FindTopDocuments(top_documents, make_document);
         }
-        vector<Document> matched_documents(document_to_relevance.size());
-        transform(std::execution::par, document_to_relevance.begin(), document_to_relevance.end(), matched_documents.begin(),
-            [&](pair<int, double> id_rel) {
-                return Document(id_rel.first, id_rel.second, documents_.at(id_rel.first).rating);
-            });
-        return matched_documents;
+        return top_documents.Extract();
     }
 
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const {
-        return FindAllDocuments(query, document_predicate);
-    }
-
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& par, const Query& query, DocumentPredicate document_predicate) const {
-        lock_guard<mutex> guard(global_mutex);
-        map<int, double> document_to_relevance;
-        map<string_view, int> id_idf;
-        map<int, map<string_view, double>> id_tdf;
-        // prepare tf-idf
-        std::mutex local_mutex;
-        for_each(par, word_to_document_freqs_.begin(), word_to_document_freqs_.end(), [&](const auto& id_w_fr) 
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& par, const SearchIndex& index, const Query& query,
+        DocumentPredicate document_predicate, size_t document_count) const {
+        const Bitmap excluded = GetExcludedDocuments(index, query);
+        const Bitmap* allowed = nullptr;
+        if constexpr (is_same_v<DocumentPredicate, DocumentFilter>) {
+            allowed = &index.GetStatusDocuments(document_predicate.status);
+        }
+        if (query.matches_nothing) {
+            return {};
+        }
+        if (!query.required_terms.empty()) {
+            return MergeTopDocuments(ScoreConjunction(par, index, query, document_predicate, allowed, excluded, document_count), document_count);
+        }
+        const vector<const Segment*> segments = index.GetSegments();
+        ConcurrentMap<uint32_t, double> document_to_relevance(CONCURRENT_BUCKET_COUNT);
+        for_each(par, query.plus_terms.begin(), query.plus_terms.end(), [&](const TermId term)
             {
-                for_each(par, query.plus_words.begin(), query.plus_words.end(), [&](const auto& word) 
-                    {
-                        if (id_w_fr.second.count(string(word))) {
-                            lock_guard<mutex> local_guard(local_mutex);
-                            id_idf[word] += 1;
-                            id_tdf[id_w_fr.first][word] = id_w_fr.second.at(string(word));
+                const double inverse_document_freq = index.GetIdf(term);
+                for (const Segment* segment : segments) {
+                    segment->GetPostings(term).ForEach([&](uint32_t internal_id, double term_freq) {
+                        if (IsSkipped(index, internal_id, allowed, excluded)) {
+                            return;
+                        }
+                        if constexpr (is_same_v<DocumentPredicate, DocumentFilter>) {
+                            document_to_relevance[internal_id].ref_to_value += term_freq * inverse_document_freq;
+                        }
+                        else if (document_predicate(index.GetDocumentIds().GetExternal(internal_id), index.GetStatus(internal_id), index.GetRating(internal_id))) {
+                            document_to_relevance[internal_id].ref_to_value += term_freq * inverse_document_freq;
                         }
-                    });
-            });  
-
-        for_each(par, id_tdf.begin(), id_tdf.end(), [&](const auto& id_w_fr) 
-            {
-                if (document_predicate(id_w_fr.first, documents_.at(id_w_fr.first).status, documents_.at(id_w_fr.first).rating)) {
-                    for_each(par, id_w_fr.second.begin(), id_w_fr.second.end(), [&](const auto& word)
-                        {
-                            lock_guard<mutex> local_guard(local_mutex);
-                            document_to_relevance[id_w_fr.first] +=
-                                (static_cast<double>(log(document_ids_.size() * 1.0 / static_cast<double>(id_idf.at(word.first)))) * word.second);
                         });
                 }
             });
-        // erase documents with minus words
-
-        for_each(par, word_to_document_freqs_.begin(), word_to_document_freqs_.end(), [&](const auto& id_w_fr) 
-            {
-                int badid = -1;
-                for_each(par, query.minus_words.begin(), query.minus_words.end(), [&](const auto& word) 
-                    {
-                        if (id_w_fr.second.count(string(word))) {
-                            badid = id_w_fr.first;
-                        }
-                    });
-                badid >= 0 ? document_to_relevance.erase(badid) : badid = -1;
+        // every bucket selects its own top documents, then they are merged
+        vector<TopDocuments> bucket_top_documents(document_to_relevance.BucketCount(), TopDocuments(document_count));
+        document_to_relevance.ForEachBucket(par, [&](size_t bucket, const FlatHashMap<uint32_t, double>& relevances) {
+            if constexpr (is_same_v<DocumentPredicate, DocumentFilter>) {
+                FilterDocuments(index, document_predicate, relevances, bucket_top_documents[bucket]);
+            }
+            else {
+                for (const auto& [internal_id, relevance] : relevances) {
+                    bucket_top_documents[bucket].Add(Document(index.GetDocumentIds().GetExternal(internal_id), relevance, index.GetRating(internal_id)));
+                }
+            }
             });
-        vector<Document> matched_documents(document_to_relevance.size());
-        transform(par, document_to_relevance.begin(), document_to_relevance.end(), matched_documents.begin(),
-            [&](pair<int, double> id_rel) {
-                return Document(id_rel.first, id_rel.second, documents_.at(id_rel.first).rating);
+        return MergeTopDocuments(bucket_top_documents, document_count);
+    }
+
+    // Scores the intersection of the required postings of every segment in parallel,
+    // every segment moves its own cursors and selects its own top documents
+    template <typename DocumentPredicate>
+    vector<TopDocuments> ScoreConjunction(const std::execution::parallel_policy& par, const SearchIndex& index, const Query& query,
+        DocumentPredicate document_predicate, const Bitmap* allowed, const Bitmap& excluded, size_t document_count) const
+    {
+        const vector<const Segment*> segments = index.GetSegments();
+        vector<TopDocuments> segment_top_documents(segments.size(), TopDocuments(document_count));
+        vector<size_t> segment_indexes(segments.size());
+        iota(segment_indexes.begin(), segment_indexes.end(), 0);
+        for_each(par, segment_indexes.begin(), segment_indexes.end(), [&](size_t segment_index) {
+            const Segment& segment = *segments[segment_index];
+            vector<const PostingList*> required_postings;
+            for (const TermId term : query.required_terms) {
+                required_postings.push_back(&segment.GetPostings(term));
+            }
+            vector<pair<PostingList::Cursor, double>> cursors;
+            for (const TermId term : query.plus_terms) {
+                cursors.emplace_back(PostingList::Cursor(segment.GetPostings(term)), index.GetIdf(term));
+            }
+            for (const uint32_t internal_id : IntersectPostings(move(required_postings))) {
+                if (IsSkipped(index, internal_id, allowed, excluded)) {
+                    continue;
+                }
+                const int document_id = index.GetDocumentIds().GetExternal(internal_id);
+                const int rating = index.GetRating(internal_id);
+                if (!document_predicate(document_id, index.GetStatus(internal_id), rating)) {
+                    continue;
+                }
+                double relevance = 0.0;
+                for (auto& [cursor, inverse_document_freq] : cursors) {
+                    cursor.NextGeq(internal_id);
+                    if (!cursor.AtEnd() && cursor.DocumentId() == internal_id) {
+                        relevance += inverse_document_freq * cursor.TermFreq();
+                    }
+                }
+                segment_top_documents[segment_index].Add(Document(document_id, relevance, rating));
+            }
             });
-        return matched_documents;
+        return segment_top_documents;
     }
 };
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include "Search_index.h"
+
+SearchIndex::SearchIndex(FlatHashSet<string> stop_words)
+    : stop_words_(make_shared<const FlatHashSet<string>>(move(stop_words)))
+{
+}
+
+SearchIndex::SearchIndex(FlatHashSet<string> stop_words, TermDictionary terms, DocumentColumns documents, ForwardIndex forward_index,
+    const vector<uint32_t>& document_freqs, vector<shared_ptr<const Segment>> segments, Bitmap deleted)
+    : stop_words_(make_shared<const FlatHashSet<string>>(move(stop_words)))
+    , terms_(move(terms))
+    , deleted_documents_(move(deleted))
+    , document_ids_(move(documents.document_ids))
+    , document_ratings_(move(documents.ratings))
+    , document_statuses_(move(documents.statuses))
+    , status_documents_(move(documents.status_documents))
+    , forward_index_(move(forward_index))
+{
+    const size_t document_count = document_ids_.Capacity();
+    if (forward_index_.Size() != document_count || document_freqs.size() > terms_.Size()) {
+        throw invalid_argument("index file sections don't match"s);
+    }
+    uint32_t end_id = 0;
+    for (const shared_ptr<const Segment>& segment : segments) {
+        if (segment->GetFirstId() < end_id || segment->GetEndId() > document_count) {
+            throw invalid_argument("index file sections don't match"s);
+        }
+        end_id = segment->GetEndId();
+    }
+    segments.erase(remove_if(segments.begin(), segments.end(), [](const shared_ptr<const Segment>& segment) {
+        return segment->GetDocumentCount() == 0;
+        }), segments.end());
+    segments_ = move(segments);
+    mutable_segment_ = Segment(static_cast<uint32_t>(document_count));
+    idf_cache_.SetDocumentCount(document_ids_.Size());
+    for (TermId term = 0; term < terms_.Size(); ++term) {
+        idf_cache_.SetDocumentFreq(term, term < document_freqs.size() ? document_freqs[term] : 0);
+    }
+}
+
+void SearchIndex::Inherit(const SearchIndex& previous)
+{
+    generation_ = previous.generation_ + 1;
+    segment_capacity_ = previous.segment_capacity_;
+    compaction_threshold_ = previous.compaction_threshold_;
+    id_compaction_threshold_ = previous.id_compaction_threshold_;
+    idf_cache_.SetTolerance(previous.idf_cache_.GetTolerance());
+}
+
+bool SearchIndex::SetSegmentCapacity(size_t document_count)
+{
+    segment_capacity_ = document_count;
+    if (mutable_segment_.GetDocumentCount() >= segment_capacity_) {
+        SealSegment();
+        return true;
+    }
+    return false;
+}
+
+void SearchIndex::SetCompactionThreshold(double deleted_ratio)
+{
+    compaction_threshold_ = deleted_ratio;
+}
+
+void SearchIndex::SetIdCompactionThreshold(double unused_ratio)
+{
+    id_compaction_threshold_ = unused_ratio;
+}
+
+void SearchIndex::SetIdfTolerance(double tolerance)
+{
+    idf_cache_.SetTolerance(tolerance);
+}
+
+bool SearchIndex::AddDocument(int document_id, DocumentStatus status, int rating, const vector<string_view>& words)
+{
+    const double inv_word_count = 1.0 / words.size();
+    FlatHashMap<TermId, double> term_freqs;
+    term_freqs.reserve(words.size());
+    for (const string_view word : words) {
+        term_freqs[terms_.Intern(word)] += inv_word_count;
+    }
+    TermFreqs document_freqs;
+    document_freqs.reserve(term_freqs.size());
+    for (const auto& [term, freq] : term_freqs) {
+        document_freqs.push_back({ term, freq });
+    }
+    sort(document_freqs.begin(), document_freqs.end());
+    return InsertDocument(document_id, status, rating, document_freqs);
+}
+
+bool SearchIndex::InsertDocument(int document_id, DocumentStatus status, int rating, const TermFreqs& term_freqs)
+{
+    const uint32_t internal_id = document_ids_.Add(document_id);
+    document_ratings_.PushBack(rating);
+    document_statuses_.PushBack(status);
+    status_documents_[static_cast<size_t>(status)].Add(internal_id);
+    idf_cache_.SetDocumentCount(document_ids_.Size());
+    for (const auto& [term, freq] : term_freqs) {
+        idf_cache_.IncrementDocumentFreq(term);
+    }
+    forward_index_.Add(term_freqs);
+    mutable_segment_.AddDocument(internal_id, term_freqs);
+    if (mutable_segment_.GetDocumentCount() >= segment_capacity_) {
+        SealSegment();
+        return true;
+    }
+    return false;
+}
+
+bool SearchIndex::RemoveDocument(int document_id)
+{
+    const uint32_t internal_id = document_ids_.Remove(document_id);
+    if (internal_id == DocumentIdMap::INVALID_INTERNAL_ID) {
+        return false;
+    }
+    status_documents_[static_cast<size_t>(document_statuses_[internal_id])].Remove(internal_id);
+    idf_cache_.SetDocumentCount(document_ids_.Size());
+    for (const auto& [term, freq] : forward_index_.Get(internal_id)) {
+        idf_cache_.DecrementDocumentFreq(term);
+    }
+    forward_index_.Clear(internal_id);
+    // the postings are left as they are, queries skip the deleted id
+    deleted_documents_.Add(internal_id);
+    return true;
+}
+
+bool SearchIndex::IsCompactionDue() const
+{
+    const size_t unused_id_count = document_ids_.Capacity() - document_ids_.Size();
+    return unused_id_count > 0 && unused_id_count >= id_compaction_threshold_ * document_ids_.Capacity();
+}
+
+static uint32_t CountRenumberedIds(const vector<uint32_t>& new_ids, uint32_t first_id, uint32_t end_id)
+{
+    return static_cast<uint32_t>(count_if(new_ids.begin() + first_id, new_ids.begin() + end_id, [](uint32_t new_id) {
+        return new_id != DocumentIdMap::INVALID_INTERNAL_ID;
+        }));
+}
+
+vector<shared_ptr<const Segment>> SearchIndex::RemapSegments(const vector<shared_ptr<const Segment>>& segments, const vector<uint32_t>& new_ids,
+    uint32_t& first_id)
+{
+    vector<shared_ptr<const Segment>> remapped_segments;
+    for (const shared_ptr<const Segment>& segment : segments) {
+        const uint32_t end_id = first_id + CountRenumberedIds(new_ids, segment->GetFirstId(), segment->GetEndId());
+        if (end_id > first_id) {
+            auto remapped = make_shared<Segment>(*segment);
+            remapped->Remap(new_ids, first_id, end_id);
+            remapped_segments.push_back(move(remapped));
+        }
+        first_id = end_id;
+    }
+    return remapped_segments;
+}
+
+bool SearchIndex::ApplyCompaction(uint64_t generation, const vector<shared_ptr<const Segment>>& inputs,
+    const vector<shared_ptr<const Segment>>& remapped, vector<uint32_t> new_ids)
+{
+    if (generation != generation_ || segments_.size() < inputs.size() || !equal(inputs.begin(), inputs.end(), segments_.begin())) {
+        return false;
+    }
+    // the documents added since the ids were computed follow the renumbered ones
+    uint32_t next_id = CountRenumberedIds(new_ids, 0, static_cast<uint32_t>(new_ids.size()));
+    while (new_ids.size() < document_ids_.Capacity()) {
+        new_ids.push_back(next_id++);
+    }
+    document_ids_.Remap(new_ids, next_id);
+    vector<int> ratings(next_id);
+    vector<DocumentStatus> statuses(next_id);
+    for (uint32_t internal_id = 0; internal_id < new_ids.size(); ++internal_id) {
+        const uint32_t new_id = new_ids[internal_id];
+        if (new_id != DocumentIdMap::INVALID_INTERNAL_ID) {
+            ratings[new_id] = document_ratings_[internal_id];
+            statuses[new_id] = document_statuses_[internal_id];
+        }
+    }
+    document_ratings_.Clear();
+    document_statuses_.Clear();
+    for (uint32_t new_id = 0; new_id < next_id; ++new_id) {
+        document_ratings_.PushBack(ratings[new_id]);
+        document_statuses_.PushBack(statuses[new_id]);
+    }
+    forward_index_.Remap(new_ids, next_id);
+    // the documents removed meanwhile keep their postings and stay marked as deleted
+    Bitmap deleted;
+    deleted_documents_.ForEach([&](uint32_t internal_id) {
+        if (new_ids[internal_id] != DocumentIdMap::INVALID_INTERNAL_ID) {
+            deleted.Add(new_ids[internal_id]);
+        }
+        });
+    deleted_documents_ = move(deleted);
+    status_documents_ = {};
+    for (uint32_t internal_id = 0; internal_id < document_statuses_.Size(); ++internal_id) {
+        if (document_ids_.IsLive(internal_id)) {
+            status_documents_[static_cast<size_t>(document_statuses_[internal_id])].Add(internal_id);
+        }
+    }
+    // the segments sealed meanwhile and the mutable segment are renumbered here
+    uint32_t first_id = inputs.empty() ? 0 : CountRenumberedIds(new_ids, 0, inputs.back()->GetEndId());
+    vector<shared_ptr<const Segment>> segments = remapped;
+    const vector<shared_ptr<const Segment>> sealed(segments_.begin() + inputs.size(), segments_.end());
+    for (shared_ptr<const Segment>& segment : RemapSegments(sealed, new_ids, first_id)) {
+        segments.push_back(move(segment));
+    }
+    mutable_segment_.Remap(new_ids, first_id, first_id + CountRenumberedIds(new_ids, mutable_segment_.GetFirstId(), mutable_segment_.GetEndId()));
+    segments_ = move(segments);
+    return true;
+}
+
+vector<const Segment*> SearchIndex::GetSegments() const
+{
+    vector<const Segment*> segments;
+    segments.reserve(segments_.size() + 1);
+    for (const shared_ptr<const Segment>& segment : segments_) {
+        segments.push_back(segment.get());
+    }
+    segments.push_back(&mutable_segment_);
+    return segments;
+}
+
+void SearchIndex::SealSegment()
+{
+    mutable_segment_.Seal();
+    segments_.push_back(make_shared<const Segment>(move(mutable_segment_)));
+    mutable_segment_ = Segment(segments_.back()->GetEndId());
+}
+
+size_t SearchIndex::GetLiveDocumentCount(const Segment& segment) const
+{
+    return segment.GetDocumentCount() - deleted_documents_.Cardinality(segment.GetFirstId(), segment.GetEndId());
+}
+
+optional<pair<size_t, size_t>> SearchIndex::FindMerge() const
+{
+    vector<size_t> live_document_counts(segments_.size());
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        live_document_counts[i] = GetLiveDocumentCount(*segments_[i]);
+        const size_t document_count = segments_[i]->GetDocumentCount();
+        if (document_count > 0 && document_count - live_document_counts[i] >= compaction_threshold_ * document_count) {
+            return pair{ i, i + 1 };
+        }
+    }
+    // a segment of level l holds less than segment_capacity_ * MERGE_FACTOR^(l + 1) live documents
+    const auto level = [&](size_t index) {
+        size_t level = 0;
+        for (size_t size = segment_capacity_ * MERGE_FACTOR; live_document_counts[index] >= size; size *= MERGE_FACTOR) {
+            ++level;
+        }
+        return level;
+    };
+    // the newest run of MERGE_FACTOR segments of the same level
+    for (size_t last = segments_.size(); last >= MERGE_FACTOR; --last) {
+        const size_t first = last - MERGE_FACTOR;
+        const size_t first_level = level(first);
+        bool same_level = true;
+        for (size_t i = first + 1; i < last && same_level; ++i) {
+            same_level = level(i) == first_level;
+        }
+        if (same_level) {
+            return pair{ first, last };
+        }
+    }
+    return nullopt;
+}
+
+void SearchIndex::ApplyMerge(const vector<shared_ptr<const Segment>>& inputs, shared_ptr<const Segment> merged, const Bitmap& deleted)
+{
+    // inputs replaced meanwhile by a compaction drop the result
+    const auto it = search(segments_.begin(), segments_.end(), inputs.begin(), inputs.end());
+    if (it == segments_.end()) {
+        return;
+    }
+    const auto position = segments_.erase(it, it + inputs.size());
+    if (merged->GetDocumentCount() > 0) {
+        segments_.insert(position, move(merged));
+    }
+    // the dropped documents are gone from the postings, their marks aren't needed anymore
+    deleted.ForEach([&](uint32_t internal_id) {
+        if (internal_id >= inputs.front()->GetFirstId() && internal_id < inputs.back()->GetEndId()) {
+            deleted_documents_.Remove(internal_id);
+        }
+        });
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include "headers.h"
+#include "Document.h"
+#include "Flat_hash_map.h"
+#include "Term_dictionary.h"
+#include "Idf_cache.h"
+#include "Document_id_map.h"
+#include "Bitmap.h"
+#include "Segment.h"
+#include "Forward_index.h"
+#include "Persistent_vector.h"
+using namespace std;
+
+// Contents of a search server: stop words, dictionary, documents, forward index
+// and the segments of the inverted index. Not synchronized. Copies share all their
+// parts: the server changes a copy of the published contents and publishes it,
+// the copy duplicates only the nodes and containers the change touches.
+class SearchIndex {
+public:
+    inline static constexpr size_t DEFAULT_SEGMENT_CAPACITY = 4096;
+    inline static constexpr size_t MERGE_FACTOR = 4;
+    inline static constexpr double DEFAULT_COMPACTION_THRESHOLD = 0.2;
+    inline static constexpr double DEFAULT_ID_COMPACTION_THRESHOLD = 0.5;
+
+    // Sections shared by index and snapshot files
+    struct DocumentColumns {
+        DocumentIdMap document_ids;
+        PersistentVector<int> ratings;
+        PersistentVector<DocumentStatus> statuses;
+        array<Bitmap, DOCUMENT_STATUS_COUNT> status_documents;
+    };
+
+    explicit SearchIndex(FlatHashSet<string> stop_words = {});
+    // Contents read from a file, document_freqs holds the number of documents with every term.
+    // Throws invalid_argument when the sections don't fit together.
+    SearchIndex(FlatHashSet<string> stop_words, TermDictionary terms, DocumentColumns documents, ForwardIndex forward_index,
+        const vector<uint32_t>& document_freqs, vector<shared_ptr<const Segment>> segments, Bitmap deleted);
+
+    // Takes the settings of the contents it replaces and the next generation
+    void Inherit(const SearchIndex& previous);
+    // Returns true when the mutable segment was sealed
+    bool SetSegmentCapacity(size_t document_count);
+    void SetCompactionThreshold(double deleted_ratio);
+    void SetIdCompactionThreshold(double unused_ratio);
+    void SetIdfTolerance(double tolerance);
+
+    TermId InternTerm(string_view word)
+    {
+        return terms_.Intern(word);
+    }
+    // Adds a validated document made of the words, the stop words are dropped already.
+    // Returns true when the mutable segment got full and was sealed.
+    bool AddDocument(int document_id, DocumentStatus status, int rating, const vector<string_view>& words);
+    // Adds a validated document with its term frequencies sorted by term id, returns like AddDocument
+    bool InsertDocument(int document_id, DocumentStatus status, int rating, const TermFreqs& term_freqs);
+    // Marks the document as deleted, its internal id stays unused until a compaction.
+    // Returns false when there is no such document.
+    bool RemoveDocument(int document_id);
+    // Replaces the inputs by merged unless a compaction replaced them meanwhile,
+    // deleted holds the documents the merge dropped
+    void ApplyMerge(const vector<shared_ptr<const Segment>>& inputs, shared_ptr<const Segment> merged, const Bitmap& deleted);
+    // Renumbers the documents by new_ids, the compacted ids of the same generation, and replaces
+    // the inputs by remapped, their copies renumbered already. The documents added meanwhile
+    // follow the renumbered ones, those removed meanwhile stay deleted. Returns false without
+    // changing anything when the contents were replaced meanwhile.
+    bool ApplyCompaction(uint64_t generation, const vector<shared_ptr<const Segment>>& inputs,
+        const vector<shared_ptr<const Segment>>& remapped, vector<uint32_t> new_ids);
+    // Replacing the contents moves to the next generation, term ids
+    // of one generation mean nothing in another
+    uint64_t GetGeneration() const
+    {
+        return generation_;
+    }
+
+    bool IsStopWord(string_view word) const
+    {
+        return stop_words_->count(word) > 0;
+    }
+
+    const FlatHashSet<string>& GetStopWords() const
+    {
+        return *stop_words_;
+    }
+
+    const TermDictionary& GetTerms() const
+    {
+        return terms_;
+    }
+
+    double GetIdf(TermId term) const
+    {
+        return idf_cache_.Get(term);
+    }
+
+    // external document ids <-> dense internal ids, the columns are indexed by the internal id
+    const DocumentIdMap& GetDocumentIds() const
+    {
+        return document_ids_;
+    }
+
+    int GetRating(uint32_t internal_id) const
+    {
+        return document_ratings_[internal_id];
+    }
+
+    DocumentStatus GetStatus(uint32_t internal_id) const
+    {
+        return document_statuses_[internal_id];
+    }
+
+    // the columns of all internal ids, for filtering blocks of documents
+    const PersistentVector<int>& GetRatings() const
+    {
+        return document_ratings_;
+    }
+
+    const PersistentVector<DocumentStatus>& GetStatuses() const
+    {
+        return document_statuses_;
+    }
+
+    TermFreqsView GetTermFreqs(uint32_t internal_id) const
+    {
+        return forward_index_.Get(internal_id);
+    }
+
+    const ForwardIndex& GetForwardIndex() const
+    {
+        return forward_index_;
+    }
+
+    const Bitmap& GetStatusDocuments(DocumentStatus status) const
+    {
+        return status_documents_[static_cast<size_t>(status)];
+    }
+
+    // removed documents still present in the postings of a segment
+    const Bitmap& GetDeletedDocuments() const
+    {
+        return deleted_documents_;
+    }
+
+    // All segments in id order, the mutable one last
+    vector<const Segment*> GetSegments() const;
+
+    const vector<shared_ptr<const Segment>>& GetSealedSegments() const
+    {
+        return segments_;
+    }
+
+    const Segment& GetMutableSegment() const
+    {
+        return mutable_segment_;
+    }
+
+    // The share of the internal ids left unused by removed documents reached the id compaction threshold
+    bool IsCompactionDue() const;
+    // Copies of the adjacent segments renumbered by new_ids without those left empty. The first
+    // one starts at first_id, which is moved to the end of the last one.
+    static vector<shared_ptr<const Segment>> RemapSegments(const vector<shared_ptr<const Segment>>& segments,
+        const vector<uint32_t>& new_ids, uint32_t& first_id);
+    // Adjacent sealed segments [first, last) due for merging or a single one due for compaction
+    optional<pair<size_t, size_t>> FindMerge() const;
+    size_t GetLiveDocumentCount(const Segment& segment) const;
+
+private:
+    uint64_t generation_ = 0;
+    // never changed, the copies share them
+    shared_ptr<const FlatHashSet<string>> stop_words_;
+    TermDictionary terms_;
+    // inverted index: the sealed segments in id order and the mutable segment with the newest ids
+    vector<shared_ptr<const Segment>> segments_;
+    Segment mutable_segment_;
+    size_t segment_capacity_ = DEFAULT_SEGMENT_CAPACITY;
+    Bitmap deleted_documents_;
+    double compaction_threshold_ = DEFAULT_COMPACTION_THRESHOLD;
+    double id_compaction_threshold_ = DEFAULT_ID_COMPACTION_THRESHOLD;
+    IdfCache idf_cache_;
+    DocumentIdMap document_ids_;
+    PersistentVector<int> document_ratings_;
+    PersistentVector<DocumentStatus> document_statuses_;
+    // internal ids of the documents with every status
+    array<Bitmap, DOCUMENT_STATUS_COUNT> status_documents_;
+    // forward index: (term id, term frequency) sorted by term id
+    ForwardIndex forward_index_;
+
+    void SealSegment();
+};
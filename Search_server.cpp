@@ -1,4 +1,5 @@
 ﻿#include "Search_Server.h"
+#include "Tokenizer.h"
 extern mutex global_mutex;
 string ReadLine()
 {
@@ -17,10 +18,7 @@ int ReadLineWithNumber()
 
 vector<string_view> SplitIntoWordsView(string_view str) {
     vector<string_view> result;
-    for (size_t pos = 0; pos != str.npos; str.remove_prefix(pos + 1)) {
-        pos = str.find(' ');
-        result.push_back(str.substr(0, pos));
-    }
+    Tokenize(str, result);
     return result;
 }
 vector<string> SplitIntoWords(const string& text)
@@ -47,7 +45,7 @@ SearchServer::SearchServer()
 SearchServer::SearchServer(const string& stop_words_text)
     : SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
 {
-    for (const auto& stop_word : stop_words_) {
+    for (const auto& stop_word : index_.GetPublished().GetStopWords()) {
         if (!IsValidWord(stop_word)) {
             throw invalid_argument("wrong stop words"s);
         }
@@ -56,57 +54,191 @@ SearchServer::SearchServer(const string& stop_words_text)
 SearchServer::SearchServer(const string_view stop_words_text)
     : SearchServer(SplitIntoWordsView(stop_words_text))  // Invoke delegating constructor from string container
 {
-    for (const auto& stop_word : stop_words_) {
+    for (const auto& stop_word : index_.GetPublished().GetStopWords()) {
         if (!IsValidWord(stop_word)) {
             throw invalid_argument("wrong stop words"s);
         }
     }
 }
+SearchServer::~SearchServer()
+{
+    {
+        lock_guard<mutex> guard(global_mutex);
+        stop_merging_ = true;
+    }
+    merge_condition_.notify_all();
+    if (merge_thread_.joinable()) {
+        merge_thread_.join();
+    }
+}
 void SearchServer::AddDocument(int document_id, const string_view document,
     const DocumentStatus& status, const vector<int>& ratings)
 {
-    if (document_id < 0) {
-        throw invalid_argument("try to add document with negative id");
+    unique_lock<mutex> lock(global_mutex);
+    CheckNewDocumentId(document_id);
+
+    vector<string_view> words;
+    SplitIntoWordsNoStop(index_.GetPublished(), document, words);
+    const int rating = ComputeAverageRating(ratings);
+    bool sealed = false;
+    ChangeIndex([&](SearchIndex& index) {
+        sealed = index.AddDocument(document_id, status, rating, words);
+        });
+    ++index_epoch_;
+    if (sealed) {
+        StartMerging();
     }
-    if (documents_.count(document_id) > 0) {
-        throw invalid_argument("duplicate id");
+    const auto [write_ahead_log, lsn] = LogAddDocument(document_id, document, status, ratings);
+    // concurrent changes share the fsync while the lock is free
+    lock.unlock();
+    if (write_ahead_log) {
+        write_ahead_log->Sync(lsn);
+    }
+}
+
+void SearchServer::AddDocuments(const vector<DocumentInput>& documents)
+{
+    AddDocuments(execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const std::execution::sequenced_policy& seq, const vector<DocumentInput>& documents)
+{
+    AddDocuments(seq, documents, 1);
+}
+
+void SearchServer::AddDocuments(const std::execution::parallel_policy& par, const vector<DocumentInput>& documents)
+{
+    // a few chunks per thread even out documents of different length
+    AddDocuments(par, documents, max<size_t>(thread::hardware_concurrency(), 1) * 4);
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::AddDocuments(const ExecutionPolicy& policy, const vector<DocumentInput>& documents, size_t chunk_count)
+{
+    if (documents.empty()) {
+        return;
+    }
+    unique_lock<mutex> lock(global_mutex);
+    FlatHashSet<int> batch_ids;
+    batch_ids.reserve(documents.size());
+    for (const DocumentInput& document : documents) {
+        CheckNewDocumentId(document.id);
+        if (!batch_ids.insert(document.id).second) {
+            throw invalid_argument("duplicate id");
+        }
     }
 
-    const vector<string> words = SplitIntoWordsNoStop(document);
-    const double inv_word_count = 1.0 / words.size();
-    for (const string& word : words) {
-        word_to_document_freqs_[document_id][word] += inv_word_count;
+    // every chunk tokenizes its documents into its own dictionary
+    chunk_count = min(chunk_count, documents.size());
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+    chunk_count = (documents.size() + chunk_size - 1) / chunk_size;
+    const SearchIndex& published = index_.GetPublished();
+    vector<TokenizedChunk> chunks(chunk_count);
+    // an exception must not leave a parallel algorithm, the first one is rethrown
+    vector<exception_ptr> errors(documents.size());
+    vector<size_t> indexes(chunk_count);
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(policy, indexes.begin(), indexes.end(), [&](size_t index) {
+        TokenizedChunk& chunk = chunks[index];
+        FlatHashMap<string_view, TermId> local_ids;
+        FlatHashMap<TermId, double> term_freqs;
+        vector<string_view> words;
+        const size_t end = min(documents.size(), (index + 1) * chunk_size);
+        for (size_t document_index = index * chunk_size; document_index < end; ++document_index) {
+            TermFreqs& document_freqs = chunk.term_freqs.emplace_back();
+            try {
+                SplitIntoWordsNoStop(published, documents[document_index].text, words);
+                const double inv_word_count = 1.0 / words.size();
+                term_freqs.clear();
+                for (const string_view word : words) {
+                    const auto [it, inserted] = local_ids.try_emplace(word, static_cast<TermId>(chunk.words.size()));
+                    if (inserted) {
+                        chunk.words.push_back(word);
+                    }
+                    term_freqs[it->second] += inv_word_count;
+                }
+                document_freqs.reserve(term_freqs.size());
+                for (const auto& [term, freq] : term_freqs) {
+                    document_freqs.push_back({ term, freq });
+                }
+            }
+            catch (...) {
+                errors[document_index] = current_exception();
+            }
+        }
+        });
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
     }
-    documents_.emplace(document_id,
-        DocumentData{
-            ComputeAverageRating(ratings),
-            status
+
+    // merge: every distinct word of a chunk is interned once, then the local ids are replaced
+    bool sealed = false;
+    ChangeIndex([&](SearchIndex& index) {
+        for (TokenizedChunk& chunk : chunks) {
+            vector<TermId> term_ids;
+            term_ids.reserve(chunk.words.size());
+            for (const string_view word : chunk.words) {
+                term_ids.push_back(index.InternTerm(word));
+            }
+            for_each(policy, chunk.term_freqs.begin(), chunk.term_freqs.end(), [&](TermFreqs& document_freqs) {
+                for (auto& [term, freq] : document_freqs) {
+                    term = term_ids[term];
+                }
+                sort(document_freqs.begin(), document_freqs.end());
+                });
+        }
+        for (size_t document_index = 0; document_index < documents.size(); ++document_index) {
+            const DocumentInput& document = documents[document_index];
+            const TermFreqs& term_freqs = chunks[document_index / chunk_size].term_freqs[document_index % chunk_size];
+            sealed = index.InsertDocument(document.id, document.status, ComputeAverageRating(document.ratings), term_freqs) || sealed;
+        }
         });
-    document_ids_.insert(document_id);
+    ++index_epoch_;
+    if (sealed) {
+        StartMerging();
+    }
+    shared_ptr<WriteAheadLog> write_ahead_log;
+    uint64_t lsn = 0;
+    for (const DocumentInput& document : documents) {
+        tie(write_ahead_log, lsn) = LogAddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    // one fsync for the whole batch
+    lock.unlock();
+    if (write_ahead_log) {
+        write_ahead_log->Sync(lsn);
+    }
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id) const
 {
-    lock_guard<mutex> guard(global_mutex);
-    const Query query = ParseQuery(raw_query);
+    const auto index = index_.Read();
+    const Query query = GetQuery(*index, raw_query);
+    const uint32_t internal_id = GetInternalId(*index, document_id);
+    const DocumentStatus status = index->GetStatus(internal_id);
+    const TermFreqsView term_freqs = index->GetTermFreqs(internal_id);
     vector<string_view> matched_words;
-    if (word_to_document_freqs_.count(document_id)) {
-        for (const auto& word : query.minus_words) {
-            if ((word_to_document_freqs_.at(document_id).count(string(word))) == 0) {
-                continue;
-            }
-            matched_words.clear();
-            return { matched_words, documents_.at(document_id).status };
-        }
-        for (const auto& word : query.plus_words) {
-            auto& word_freqs = word_to_document_freqs_.at(document_id);
-            auto it = word_freqs.find(string(word));
-            if (it != word_freqs.end()) {
-                matched_words.push_back(it->first);
-            }
+    if (query.matches_nothing) {
+        return { matched_words, status };
+    }
+    for (const TermId term : query.minus_terms) {
+        if (ContainsTerm(term_freqs, term)) {
+            return { matched_words, status };
+        }
+    }
+    for (const TermId term : query.required_terms) {
+        if (!ContainsTerm(term_freqs, term)) {
+            return { matched_words, status };
         }
     }
-    return { matched_words, documents_.at(document_id).status };
+    for (const TermId term : query.plus_terms) {
+        if (ContainsTerm(term_freqs, term)) {
+            matched_words.push_back(index->GetTerms().GetText(term));
+        }
+    }
+    sort(matched_words.begin(), matched_words.end());
+    return { matched_words, status };
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy seq, const string_view raw_query, int document_id) const
@@ -115,47 +247,67 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::exec
 }
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy par, const string_view raw_query, int document_id) const
 {
-    lock_guard<mutex> guard(global_mutex);
-    const Query query = ParseQuery(par, raw_query);
-    vector<string_view> matched_words;
-    if (word_to_document_freqs_.count(document_id)) {
-       const map<string, double>& word_freqs = word_to_document_freqs_.at(document_id);
-        std::for_each(par, query.plus_words.begin(), query.plus_words.end(), [&](auto& word) 
-            {
-                auto it = word_freqs.find(word);
-                if (it != word_freqs.end())
-                    matched_words.push_back((it->first));
-            });
-
-        if (std::any_of(par, query.minus_words.begin(), query.minus_words.end(), [&](auto& word) {
-            return word_freqs.count(word);
-            }))
-        {
-            matched_words.clear();
-        }
+    const auto index = index_.Read();
+    const Query query = GetQuery(*index, raw_query);
+    const uint32_t internal_id = GetInternalId(*index, document_id);
+    const DocumentStatus status = index->GetStatus(internal_id);
+    const TermFreqsView term_freqs = index->GetTermFreqs(internal_id);
+    if (query.matches_nothing || std::any_of(par, query.minus_terms.begin(), query.minus_terms.end(), [&](const TermId term) {
+        return ContainsTerm(term_freqs, term);
+        }) || !std::all_of(par, query.required_terms.begin(), query.required_terms.end(), [&](const TermId term) {
+        return ContainsTerm(term_freqs, term);
+        }))
+    {
+        return { vector<string_view>(), status };
     }
-    return { matched_words, documents_.at(document_id).status };
+    vector<string_view> matched_words(query.plus_terms.size());
+    const auto matched_end = std::transform(par, query.plus_terms.begin(), query.plus_terms.end(), matched_words.begin(), [&](const TermId term)
+        {
+            return ContainsTerm(term_freqs, term) ? index->GetTerms().GetText(term) : string_view();
+        });
+    matched_words.erase(std::remove(matched_words.begin(), matched_end, string_view()), matched_words.end());
+    sort(matched_words.begin(), matched_words.end());
+    return { matched_words, status };
 }
 //private
 
 const map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const
 {
     map<string_view, double> res;
-    if (word_to_document_freqs_.count(document_id)) {
-        for (const auto& [word, freq] : word_to_document_freqs_.at(document_id)) {
-            res[word] = freq;
+    const auto index = index_.Read();
+    const uint32_t internal_id = index->GetDocumentIds().Find(document_id);
+    if (internal_id != DocumentIdMap::INVALID_INTERNAL_ID) {
+        for (const auto& [term, freq] : index->GetTermFreqs(internal_id)) {
+            res[index->GetTerms().GetText(term)] = freq;
         }
     }
-    //res = word_to_document_freqs_.at(document_id);
     return res;
 }
 
 void SearchServer::RemoveDocument(int document_id)
 {
-    lock_guard<mutex> guard(global_mutex);
-    word_to_document_freqs_.erase(document_id);
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
+    unique_lock<mutex> lock(global_mutex);
+    if (index_.GetPublished().GetDocumentIds().Find(document_id) == DocumentIdMap::INVALID_INTERNAL_ID) {
+        return;
+    }
+    ChangeIndex([&](SearchIndex& index) {
+        index.RemoveDocument(document_id);
+        });
+    ++index_epoch_;
+    // the merge thread renumbers the documents once enough of the internal ids are unused
+    if (index_.GetPublished().IsCompactionDue()) {
+        StartMerging();
+    }
+    else {
+        merge_condition_.notify_all();
+    }
+    const auto [write_ahead_log, lsn] = LogChange(WriteAheadLog::RecordType::REMOVE_DOCUMENT, [&](index_file::SectionWriter& payload) {
+        payload.Write(static_cast<int32_t>(document_id));
+        });
+    lock.unlock();
+    if (write_ahead_log) {
+        write_ahead_log->Sync(lsn);
+    }
 }
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
     RemoveDocument(document_id);
@@ -163,42 +315,584 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int d
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
     RemoveDocument(document_id);
 }
-bool SearchServer::IsStopWord(const string& word) const
+void SearchServer::CheckNewDocumentId(int document_id) const
+{
+    if (document_id < 0) {
+        throw invalid_argument("try to add document with negative id");
+    }
+    if (index_.GetPublished().GetDocumentIds().Find(document_id) != DocumentIdMap::INVALID_INTERNAL_ID) {
+        throw invalid_argument("duplicate id");
+    }
+}
+bool SearchServer::ContainsTerm(TermFreqsView term_freqs, TermId term)
 {
-    return stop_words_.count(word) > 0;
+    const auto it = lower_bound(term_freqs.begin(), term_freqs.end(), term,
+        [](const TermFreq& term_freq, TermId term) { return term_freq.term < term; });
+    return it != term_freqs.end() && it->term == term;
 }
-bool SearchServer::IsValidWord(const string& word)
+uint32_t SearchServer::GetInternalId(const SearchIndex& index, int document_id) const
+{
+    const uint32_t internal_id = index.GetDocumentIds().Find(document_id);
+    if (internal_id == DocumentIdMap::INVALID_INTERNAL_ID) {
+        throw out_of_range("no document with id "s + to_string(document_id));
+    }
+    return internal_id;
+}
+bool SearchServer::IsValidWord(const string_view word)
 {
     // A valid word must not contain special characters
-    return none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
+    return HasNoControlChars(word);
+}
+void SearchServer::SplitIntoWordsNoStop(const SearchIndex& index, const string_view text, vector<string_view>& words)
+{
+    words.clear();
+    if (!Tokenize(text, words)) {
+        throw invalid_argument("Spec symvol in stop words");
+    }
+    if (!index.GetStopWords().empty()) {
+        words.erase(remove_if(words.begin(), words.end(), [&](string_view word) {
+            return index.IsStopWord(word);
+            }), words.end());
+    }
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, const DocumentStatus& status) const
+{
+    return FindCachedTopDocuments(raw_query, status, [&](const SearchIndex& index, const Query& query, size_t document_count) {
+        return FindTopDocuments(index, query, DocumentFilter{ status, RatingRange{} }, document_count);
         });
 }
-vector<string> SearchServer::SplitIntoWordsNoStop(const string_view text) const
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const
+{
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, RatingRange rating_range) const
 {
-    vector<string> words;
-    for (const string_view word : SplitIntoWordsView(text)) {
-        if (!IsValidWord(string(word))) {
-            throw invalid_argument("Spec symvol in stop words");
+    return FindTopDocuments(raw_query, DocumentFilter{ status, rating_range });
+}
+
+void SearchServer::FilterDocuments(const SearchIndex& index, const DocumentFilter& filter, const FlatHashMap<uint32_t, double>& document_to_relevance,
+    TopDocuments& top_documents) const
+{
+    uint32_t internal_ids[DocumentFilter::BLOCK_SIZE] = {};
+    double relevances[DocumentFilter::BLOCK_SIZE] = {};
+    DocumentStatus statuses[DocumentFilter::BLOCK_SIZE] = {};
+    int ratings[DocumentFilter::BLOCK_SIZE] = {};
+    size_t count = 0;
+    const auto match_block = [&]() {
+        const uint64_t mask = filter.MatchBlock(statuses, ratings, count);
+        for (size_t i = 0; i < count; ++i) {
+            if ((mask >> i) & 1) {
+                top_documents.Add(Document(index.GetDocumentIds().GetExternal(internal_ids[i]), relevances[i], ratings[i]));
+            }
         }
-        if (!IsStopWord(string(word))) {
-            words.push_back(string(word));
+        count = 0;
+    };
+    for (const auto& [internal_id, relevance] : document_to_relevance) {
+        internal_ids[count] = internal_id;
+        relevances[count] = relevance;
+        statuses[count] = index.GetStatus(internal_id);
+        ratings[count] = index.GetRating(internal_id);
+        if (++count == DocumentFilter::BLOCK_SIZE) {
+            match_block();
         }
     }
-    return words;
+    match_block();
 }
 
+Bitmap SearchServer::GetExcludedDocuments(const SearchIndex& index, const Query& query)
+{
+    const vector<const Segment*> segments = index.GetSegments();
+    Bitmap excluded;
+    for (const TermId term : query.minus_terms) {
+        Bitmap term_documents;
+        for (const Segment* segment : segments) {
+            segment->GetPostings(term).ForEach([&](uint32_t internal_id, double) {
+                term_documents.Add(internal_id);
+                });
+        }
+        excluded |= term_documents;
+    }
+    return excluded;
+}
 
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query, const DocumentStatus& status) const
+void SearchServer::SetSegmentCapacity(size_t document_count)
 {
-    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus statuss, int rating)
-        { return statuss == status; });
+    if (document_count == 0) {
+        throw invalid_argument("segment capacity must be positive"s);
+    }
+    lock_guard<mutex> guard(global_mutex);
+    bool sealed = false;
+    ChangeIndex([&](SearchIndex& index) {
+        sealed = index.SetSegmentCapacity(document_count);
+        });
+    if (sealed) {
+        StartMerging();
+    }
 }
 
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const
+void SearchServer::SetCompactionThreshold(double deleted_ratio)
 {
-    return FindTopDocuments(raw_query, [](int document_id, DocumentStatus status, int rating)
-        { return status == DocumentStatus::ACTUAL; });
+    if (deleted_ratio <= 0.0 || deleted_ratio > 1.0) {
+        throw invalid_argument("compaction threshold must be in (0, 1]"s);
+    }
+    lock_guard<mutex> guard(global_mutex);
+    ChangeIndex([&](SearchIndex& index) {
+        index.SetCompactionThreshold(deleted_ratio);
+        });
+    merge_condition_.notify_all();
+}
+
+void SearchServer::SetIdCompactionThreshold(double unused_ratio)
+{
+    if (unused_ratio <= 0.0 || unused_ratio > 1.0) {
+        throw invalid_argument("id compaction threshold must be in (0, 1]"s);
+    }
+    lock_guard<mutex> guard(global_mutex);
+    ChangeIndex([&](SearchIndex& index) {
+        index.SetIdCompactionThreshold(unused_ratio);
+        });
+    if (index_.GetPublished().IsCompactionDue()) {
+        StartMerging();
+    }
+}
+
+void SearchServer::SetIdfTolerance(double tolerance)
+{
+    if (tolerance < 0.0) {
+        throw invalid_argument("negative idf tolerance"s);
+    }
+    lock_guard<mutex> guard(global_mutex);
+    ChangeIndex([&](SearchIndex& index) {
+        index.SetIdfTolerance(tolerance);
+        });
+    ++index_epoch_;
+}
+
+size_t SearchServer::GetSegmentCount() const
+{
+    return index_.Read()->GetSealedSegments().size();
+}
+
+size_t SearchServer::GetDeletedDocumentCount() const
+{
+    return index_.Read()->GetDeletedDocuments().Cardinality();
+}
+
+void SearchServer::WaitForMerges()
+{
+    unique_lock<mutex> lock(global_mutex);
+    merge_condition_.wait(lock, [&]() {
+        return !merging_ && (!merge_thread_.joinable() || !IsMergeDue(index_.GetPublished()));
+        });
+}
+
+void SearchServer::SaveIndex(const string& path) const
+{
+    index_file::SectionWriter stop_words(index_file::SectionType::STOP_WORDS);
+    index_file::SectionWriter terms(index_file::SectionType::TERMS);
+    index_file::SectionWriter documents(index_file::SectionType::DOCUMENTS);
+    index_file::SectionWriter forward_index(index_file::SectionType::FORWARD_INDEX);
+    // the version stays pinned while it is written, the queries and the writers go on.
+    // The copies of its parts must go before it.
+    const auto index = index_.Read();
+    WriteDictionary(*index, stop_words, terms);
+    // the live documents get dense ids in their order
+    vector<uint32_t> new_ids(index->GetDocumentIds().Capacity(), DocumentIdMap::INVALID_INTERNAL_ID);
+    vector<uint32_t> live_ids;
+    for (uint32_t internal_id = 0; internal_id < new_ids.size(); ++internal_id) {
+        if (index->GetDocumentIds().IsLive(internal_id)) {
+            new_ids[internal_id] = static_cast<uint32_t>(live_ids.size());
+            live_ids.push_back(internal_id);
+        }
+    }
+    WriteDocuments(*index, live_ids, documents, forward_index);
+    vector<shared_ptr<const Segment>> segments = index->GetSealedSegments();
+    segments.push_back(make_shared<const Segment>(index->GetMutableSegment()));
+    Segment merged = Segment::Merge(segments, index->GetDeletedDocuments());
+    merged.Remap(new_ids, 0, static_cast<uint32_t>(live_ids.size()));
+    index_file::SectionWriter postings(index_file::SectionType::POSTINGS);
+    merged.Write(postings);
+
+    index_file::Writer writer(path, index_file::FileKind::INDEX);
+    for (const index_file::SectionWriter* section : { &stop_words, &terms, &documents, &forward_index, &postings }) {
+        writer.WriteSection(*section);
+    }
+    writer.Finish();
+}
+
+void SearchServer::OpenIndex(const string& path)
+{
+    // everything is read before the server changes, a malformed file leaves it as it was
+    const index_file::Reader reader(MappedFile::Open(path), index_file::FileKind::INDEX);
+    vector<shared_ptr<const Segment>> segments;
+    segments.push_back(make_shared<const Segment>(Segment::Read(reader.GetSection(index_file::SectionType::POSTINGS), reader.GetFile())));
+    vector<uint32_t> document_freqs;
+    ForwardIndex forward_index = ForwardIndex::Read(reader.GetSection(index_file::SectionType::FORWARD_INDEX), reader.GetFile(), document_freqs);
+    ReplaceContents(SearchIndex(ReadStopWords(reader.GetSection(index_file::SectionType::STOP_WORDS)),
+        ReadTerms(reader.GetSection(index_file::SectionType::TERMS)),
+        ReadDocuments(reader.GetSection(index_file::SectionType::DOCUMENTS), false),
+        move(forward_index), document_freqs, move(segments), Bitmap()));
+}
+
+void SearchServer::SaveSnapshot(const string& path) const
+{
+    WriteSnapshot(path);
+}
+
+uint64_t SearchServer::WriteSnapshot(const string& path) const
+{
+    index_file::SectionWriter stop_words(index_file::SectionType::STOP_WORDS);
+    index_file::SectionWriter terms(index_file::SectionType::TERMS);
+    index_file::SectionWriter documents(index_file::SectionType::DOCUMENTS);
+    index_file::SectionWriter forward_index(index_file::SectionType::FORWARD_INDEX);
+    index_file::SectionWriter deleted(index_file::SectionType::DELETED_DOCUMENTS);
+    index_file::SectionWriter log_position(index_file::SectionType::LOG_POSITION);
+    uint64_t lsn = 0;
+    // the version of the last logged change stays pinned while it is written, the queries
+    // and the writers go on. The copies of its parts must go before it.
+    const auto index = [&]() {
+        lock_guard<mutex> guard(global_mutex);
+        lsn = log_position_;
+        return index_.Read();
+    }();
+    log_position.Write(lsn);
+    WriteDictionary(*index, stop_words, terms);
+    vector<uint32_t> internal_ids(index->GetDocumentIds().Capacity());
+    iota(internal_ids.begin(), internal_ids.end(), 0);
+    WriteDocuments(*index, internal_ids, documents, forward_index);
+    vector<uint32_t> deleted_ids;
+    deleted_ids.reserve(index->GetDeletedDocuments().Cardinality());
+    index->GetDeletedDocuments().ForEach([&](uint32_t internal_id) {
+        deleted_ids.push_back(internal_id);
+        });
+    deleted.Write(static_cast<uint64_t>(deleted_ids.size()));
+    deleted.Write(deleted_ids.data(), deleted_ids.size());
+    vector<shared_ptr<const Segment>> segments = index->GetSealedSegments();
+    Segment mutable_segment = index->GetMutableSegment();
+    // the mutable segment is restored as a sealed one
+    if (mutable_segment.GetDocumentCount() > 0) {
+        mutable_segment.Seal();
+        segments.push_back(make_shared<const Segment>(move(mutable_segment)));
+    }
+    vector<index_file::SectionWriter> postings(segments.size(), index_file::SectionWriter(index_file::SectionType::POSTINGS));
+    vector<size_t> indexes(segments.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(execution::par, indexes.begin(), indexes.end(), [&](size_t index) {
+        segments[index]->Write(postings[index]);
+        });
+
+    index_file::Writer writer(path, index_file::FileKind::SNAPSHOT);
+    for (const index_file::SectionWriter* section : { &stop_words, &terms, &documents, &forward_index, &deleted, &log_position }) {
+        writer.WriteSection(*section);
+    }
+    for (const index_file::SectionWriter& section : postings) {
+        writer.WriteSection(section);
+    }
+    writer.Finish();
+    return lsn;
+}
+
+void SearchServer::LoadSnapshot(const string& path)
+{
+    const index_file::Reader reader(MappedFile::Open(path), index_file::FileKind::SNAPSHOT);
+    FlatHashSet<string> stop_words;
+    TermDictionary terms;
+    SearchIndex::DocumentColumns documents;
+    ForwardIndex forward_index;
+    vector<uint32_t> document_freqs;
+    Bitmap deleted;
+    index_file::SectionReader log_position = reader.GetSection(index_file::SectionType::LOG_POSITION);
+    log_position.VerifyChecksum();
+    const uint64_t lsn = log_position.Read<uint64_t>();
+    const vector<index_file::SectionReader> postings = reader.GetSections(index_file::SectionType::POSTINGS);
+    vector<shared_ptr<const Segment>> segments(postings.size());
+    // every section is verified and read by its own task
+    vector<function<void()>> tasks = {
+        [&, section = reader.GetSection(index_file::SectionType::STOP_WORDS)]() {
+            section.VerifyChecksum();
+            stop_words = ReadStopWords(section);
+        },
+        [&, section = reader.GetSection(index_file::SectionType::TERMS)]() {
+            section.VerifyChecksum();
+            terms = ReadTerms(section);
+        },
+        [&, section = reader.GetSection(index_file::SectionType::DOCUMENTS)]() {
+            section.VerifyChecksum();
+            documents = ReadDocuments(section, true);
+        },
+        [&, section = reader.GetSection(index_file::SectionType::FORWARD_INDEX)]() {
+            section.VerifyChecksum();
+            forward_index = ForwardIndex::Read(section, reader.GetFile(), document_freqs);
+        },
+        [&, section = reader.GetSection(index_file::SectionType::DELETED_DOCUMENTS)]() mutable {
+            section.VerifyChecksum();
+            const uint64_t count = section.Read<uint64_t>();
+            const uint32_t* deleted_ids = section.Read<uint32_t>(static_cast<size_t>(count));
+            for (uint64_t i = 0; i < count; ++i) {
+                deleted.Add(deleted_ids[i]);
+            }
+        },
+    };
+    for (size_t index = 0; index < postings.size(); ++index) {
+        tasks.push_back([&, index]() {
+            postings[index].VerifyChecksum();
+            segments[index] = make_shared<const Segment>(Segment::Read(postings[index], reader.GetFile()));
+            });
+    }
+    // an exception must not leave a parallel algorithm, the first one is rethrown
+    vector<exception_ptr> errors(tasks.size());
+    vector<size_t> indexes(tasks.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(execution::par, indexes.begin(), indexes.end(), [&](size_t index) {
+        try {
+            tasks[index]();
+        }
+        catch (...) {
+            errors[index] = current_exception();
+        }
+        });
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+    ReplaceContents(SearchIndex(move(stop_words), move(terms), move(documents), move(forward_index), document_freqs,
+        move(segments), move(deleted)));
+    lock_guard<mutex> guard(global_mutex);
+    log_position_ = lsn;
+}
+
+void SearchServer::OpenWriteAheadLog(const string& path, WriteAheadLog::SyncMode sync_mode, chrono::milliseconds sync_interval)
+{
+    uint64_t after_lsn = 0;
+    {
+        // the replayed changes must not be logged again
+        lock_guard<mutex> guard(global_mutex);
+        write_ahead_log_.reset();
+        after_lsn = log_position_;
+    }
+    auto write_ahead_log = make_shared<WriteAheadLog>(path, sync_mode, sync_interval, after_lsn,
+        [&](uint64_t, WriteAheadLog::RecordType type, index_file::SectionReader payload) {
+            ReplayChange(type, payload);
+        });
+    lock_guard<mutex> guard(global_mutex);
+    log_position_ = write_ahead_log->GetLastLsn();
+    write_ahead_log_ = move(write_ahead_log);
+}
+
+void SearchServer::Checkpoint(const string& snapshot_path)
+{
+    const uint64_t lsn = WriteSnapshot(snapshot_path);
+    shared_ptr<WriteAheadLog> write_ahead_log;
+    {
+        lock_guard<mutex> guard(global_mutex);
+        write_ahead_log = write_ahead_log_;
+    }
+    if (write_ahead_log) {
+        write_ahead_log->DropThrough(lsn);
+    }
+}
+
+void SearchServer::ReplayChange(WriteAheadLog::RecordType type, index_file::SectionReader payload)
+{
+    const int document_id = payload.Read<int32_t>();
+    if (type == WriteAheadLog::RecordType::ADD_DOCUMENT) {
+        const DocumentStatus status = static_cast<DocumentStatus>(payload.Read<uint32_t>());
+        const size_t rating_count = static_cast<size_t>(payload.Read<uint64_t>());
+        const int32_t* ratings = payload.Read<int32_t>(rating_count);
+        const size_t text_size = static_cast<size_t>(payload.Read<uint64_t>());
+        const char* text = payload.Read<char>(text_size);
+        AddDocument(document_id, string_view(text, text_size), status, vector<int>(ratings, ratings + rating_count));
+    }
+    else if (type == WriteAheadLog::RecordType::REMOVE_DOCUMENT) {
+        RemoveDocument(document_id);
+    }
+}
+
+pair<shared_ptr<WriteAheadLog>, uint64_t> SearchServer::LogAddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings)
+{
+    return LogChange(WriteAheadLog::RecordType::ADD_DOCUMENT, [&](index_file::SectionWriter& payload) {
+        payload.Write(static_cast<int32_t>(document_id));
+        payload.Write(static_cast<uint32_t>(status));
+        payload.Write(static_cast<uint64_t>(ratings.size()));
+        payload.Write(ratings.data(), ratings.size());
+        payload.Write(static_cast<uint64_t>(document.size()));
+        payload.Write(document.data(), document.size());
+        });
+}
+
+void SearchServer::WriteDictionary(const SearchIndex& index, index_file::SectionWriter& stop_words, index_file::SectionWriter& terms)
+{
+    stop_words.WriteStrings(index.GetStopWords());
+    const TermDictionary& dictionary = index.GetTerms();
+    vector<string_view> texts;
+    texts.reserve(dictionary.Size());
+    for (TermId term = 0; term < dictionary.Size(); ++term) {
+        texts.push_back(dictionary.GetText(term));
+    }
+    terms.WriteStrings(texts);
+}
+
+void SearchServer::WriteDocuments(const SearchIndex& index, const vector<uint32_t>& internal_ids,
+    index_file::SectionWriter& documents, index_file::SectionWriter& forward_index)
+{
+    vector<int32_t> document_ids;
+    vector<int32_t> ratings;
+    vector<uint8_t> statuses;
+    for (const uint32_t internal_id : internal_ids) {
+        document_ids.push_back(index.GetDocumentIds().GetExternal(internal_id));
+        ratings.push_back(index.GetRating(internal_id));
+        statuses.push_back(static_cast<uint8_t>(index.GetStatus(internal_id)));
+    }
+    documents.Write(static_cast<uint64_t>(internal_ids.size()));
+    documents.Write(document_ids.data(), document_ids.size());
+    documents.Write(ratings.data(), ratings.size());
+    documents.Write(statuses.data(), statuses.size());
+    index.GetForwardIndex().Write(internal_ids, forward_index);
+}
+
+FlatHashSet<string> SearchServer::ReadStopWords(index_file::SectionReader section)
+{
+    FlatHashSet<string> stop_words;
+    for (const string_view stop_word : section.ReadStrings()) {
+        stop_words.emplace(stop_word);
+    }
+    return stop_words;
+}
+
+TermDictionary SearchServer::ReadTerms(index_file::SectionReader section)
+{
+    TermDictionary terms;
+    for (const string_view text : section.ReadStrings()) {
+        const size_t term_count = terms.Size();
+        if (terms.Intern(text) != term_count) {
+            throw invalid_argument("index file has duplicate terms"s);
+        }
+    }
+    return terms;
+}
+
+SearchIndex::DocumentColumns SearchServer::ReadDocuments(index_file::SectionReader section, bool with_removed)
+{
+    const size_t document_count = static_cast<size_t>(section.Read<uint64_t>());
+    const int32_t* external_ids = section.Read<int32_t>(document_count);
+    const int32_t* ratings = section.Read<int32_t>(document_count);
+    const uint8_t* statuses = section.Read<uint8_t>(document_count);
+    SearchIndex::DocumentColumns documents;
+    for (uint32_t internal_id = 0; internal_id < document_count; ++internal_id) {
+        const int external_id = external_ids[internal_id];
+        if (statuses[internal_id] >= DOCUMENT_STATUS_COUNT) {
+            throw invalid_argument("index file has malformed documents"s);
+        }
+        documents.ratings.PushBack(ratings[internal_id]);
+        documents.statuses.PushBack(static_cast<DocumentStatus>(statuses[internal_id]));
+        if (external_id == SearchServer::INVALID_DOCUMENT_ID && with_removed) {
+            documents.document_ids.AddRemoved();
+            continue;
+        }
+        const size_t live_count = documents.document_ids.Size();
+        if (external_id < 0) {
+            throw invalid_argument("index file has malformed documents"s);
+        }
+        // a duplicate id leaves the map as it was, saves the second lookup
+        documents.document_ids.Add(external_id);
+        if (documents.document_ids.Size() == live_count) {
+            throw invalid_argument("index file has malformed documents"s);
+        }
+        documents.status_documents[statuses[internal_id]].Add(internal_id);
+    }
+    return documents;
+}
+
+void SearchServer::ReplaceContents(SearchIndex contents)
+{
+    {
+        lock_guard<mutex> guard(global_mutex);
+        contents.Inherit(index_.GetPublished());
+        // the old contents are freed once their queries are done
+        index_.Reset(move(contents));
+        ++index_epoch_;
+        // a merge running over the old segments drops its result
+        merge_condition_.notify_all();
+    }
+    // the queries of the old generation are stale, queries of the new one don't use them
+    for (QueryCacheShard& shard : query_cache_) {
+        lock_guard<mutex> cache_guard(shard.lock);
+        shard.queries.Clear();
+    }
+}
+
+void SearchServer::StartMerging()
+{
+    if (!merge_thread_.joinable()) {
+        merge_thread_ = thread([this]() {
+            MergeSegments();
+            });
+    }
+    merge_condition_.notify_all();
+}
+
+void SearchServer::MergeSegments()
+{
+    unique_lock<mutex> lock(global_mutex);
+    while (true) {
+        merge_condition_.wait(lock, [&]() {
+            return stop_merging_ || IsMergeDue(index_.GetPublished());
+            });
+        if (stop_merging_) {
+            return;
+        }
+        const SearchIndex& index = index_.GetPublished();
+        if (index.IsCompactionDue()) {
+            CompactDocuments(lock);
+            continue;
+        }
+        const auto [first, last] = *index.FindMerge();
+        const vector<shared_ptr<const Segment>> inputs(index.GetSealedSegments().begin() + first, index.GetSealedSegments().begin() + last);
+        const Bitmap deleted = index.GetDeletedDocuments();
+        merging_ = true;
+        // the inputs are immutable, queries and updates go on while they are merged
+        lock.unlock();
+        const auto merged = make_shared<const Segment>(Segment::Merge(inputs, deleted));
+        lock.lock();
+        merging_ = false;
+        ChangeIndex([&](SearchIndex& changed) {
+            changed.ApplyMerge(inputs, merged, deleted);
+            });
+        merge_condition_.notify_all();
+    }
+}
+
+void SearchServer::CompactDocuments(unique_lock<mutex>& lock)
+{
+    const SearchIndex& index = index_.GetPublished();
+    const uint64_t generation = index.GetGeneration();
+    const vector<shared_ptr<const Segment>> inputs = index.GetSealedSegments();
+    const vector<uint32_t> new_ids = index.GetDocumentIds().GetCompactedIds();
+    merging_ = true;
+    // the sealed segments are renumbered while queries and updates go on,
+    // the documents changed meanwhile are renumbered when the result is applied
+    lock.unlock();
+    uint32_t first_id = 0;
+    const vector<shared_ptr<const Segment>> remapped = SearchIndex::RemapSegments(inputs, new_ids, first_id);
+    lock.lock();
+    merging_ = false;
+    ChangeIndex([&](SearchIndex& changed) {
+        changed.ApplyCompaction(generation, inputs, remapped, new_ids);
+        });
+    merge_condition_.notify_all();
+}
+
+vector<Document> SearchServer::MergeTopDocuments(const vector<TopDocuments>& partial_top_documents, size_t document_count)
+{
+    TopDocuments top_documents(document_count);
+    for (const TopDocuments& partial_top : partial_top_documents) {
+        top_documents.Merge(partial_top);
+    }
+    return top_documents.Extract();
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings)
@@ -206,7 +900,7 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings)
     return ratings.size() > 0 ? (accumulate(ratings.begin(), ratings.end(), 0)
         / static_cast<int>(ratings.size())) : 0;
 }
-SearchServer::QueryWord SearchServer::ParseQueryWord(string text) const
+SearchServer::QueryWord SearchServer::ParseQueryWord(const SearchIndex& index, string_view text)
 {
     if (text.empty()) {
         throw invalid_argument("Empty query"s);
@@ -214,7 +908,7 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string text) const
     bool is_minus = false;
     if (text[0] == '-') {
         is_minus = true;
-        text = text.substr(1);
+        text.remove_prefix(1);
         if (text.empty()) {
             throw invalid_argument("Minus word can't be empty"s);
         }
@@ -222,52 +916,133 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string text) const
     if (text[0] == '-') {
         throw invalid_argument("Double minus in minus word"s);
     }
+    bool is_required = false;
+    if (text[0] == '+') {
+        if (is_minus) {
+            throw invalid_argument("Minus word can't be required"s);
+        }
+        is_required = true;
+        text.remove_prefix(1);
+        if (text.empty() || text[0] == '+' || text[0] == '-') {
+            throw invalid_argument("Wrong required word"s);
+        }
+    }
     if (!IsValidWord(text)) {
         throw invalid_argument("Spec symvol"s);
     }
     return {
         text,
         is_minus,
-        IsStopWord(text)
+        is_required,
+        index.IsStopWord(text)
     };
 }
-SearchServer::Query SearchServer::ParseQuery(const string_view text) const
+void SearchServer::AddQueryWord(const SearchIndex& index, Query& query, const QueryWord& query_word)
 {
-    Query query;
-    for (const string_view word : SplitIntoWordsView(text)) {
-        const QueryWord query_word = ParseQueryWord(string(word));
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.insert(query_word.data);
-            }
-            else {
-                query.plus_words.insert(query_word.data);
-            }
+    if (query_word.is_stop) {
+        return;
+    }
+    const TermId term = index.GetTerms().Find(query_word.data);
+    if (term == TermDictionary::INVALID_TERM_ID) {
+        query.has_unknown_words = true;
+        query.matches_nothing = query.matches_nothing || query_word.is_required;
+        return;
+    }
+    if (query_word.is_minus) {
+        query.minus_terms.push_back(term);
+    }
+    else {
+        query.plus_terms.push_back(term);
+        if (query_word.is_required) {
+            query.required_terms.push_back(term);
         }
     }
-    return query;
 }
-SearchServer::Query SearchServer::ParseQuery(std::execution::sequenced_policy, const string_view text) const {
-    return ParseQuery(text);
+SearchServer::QueryCacheShard& SearchServer::GetQueryCacheShard(const string_view raw_query) const
+{
+    // the table of a shard uses the low bits, the shard is picked by the high ones
+    return query_cache_[(FlatHash<uint64_t>::Mix(hash<string_view>{}(raw_query)) >> 32) % QUERY_CACHE_SHARD_COUNT];
 }
-SearchServer::Query SearchServer::ParseQuery(std::execution::parallel_policy, const string_view text) const
+SearchServer::Query SearchServer::GetQuery(const SearchIndex& index, const string_view raw_query) const
 {
-    Query query;
-    vector<string_view> words = SplitIntoWordsView(text);
-    vector<QueryWord> query_words(words.size());
-    transform(execution::par, words.begin(), words.end(), query_words.begin(), [&](auto& w) {return ParseQueryWord(string(w)); });
-    for (auto& query_word : query_words) {
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.insert(query_word.data);
+    if (query_cache_capacity_.load(memory_order_relaxed) == 0) {
+        return ParseQuery(index, raw_query);
+    }
+    QueryCacheShard& shard = GetQueryCacheShard(raw_query);
+    {
+        lock_guard<mutex> guard(shard.lock);
+        const shared_ptr<const CachedQuery>* cached = shard.queries.Find(raw_query);
+        if (cached != nullptr) {
+            const CachedQuery& cached_query = **cached;
+            if (cached_query.error) {
+                rethrow_exception(cached_query.error);
             }
-            else {
-                query.plus_words.insert(query_word.data);
+            // the copy of a query may lag behind the one the entry was parsed on, its
+            // dictionary can miss the term ids of the entry
+            const size_t dictionary_size = index.GetTerms().Size();
+            if (cached_query.generation == index.GetGeneration() && cached_query.dictionary_size <= dictionary_size
+                && (!cached_query.query.has_unknown_words || cached_query.dictionary_size == dictionary_size)) {
+                return cached_query.query;
             }
         }
     }
+    auto cached_query = make_shared<CachedQuery>();
+    cached_query->generation = index.GetGeneration();
+    cached_query->dictionary_size = index.GetTerms().Size();
+    try {
+        cached_query->query = ParseQuery(index, raw_query);
+    }
+    catch (const invalid_argument&) {
+        cached_query->error = current_exception();
+    }
+    lock_guard<mutex> guard(shard.lock);
+    shard.queries.Insert(raw_query, cached_query);
+    if (cached_query->error) {
+        rethrow_exception(cached_query->error);
+    }
+    return cached_query->query;
+}
+void SearchServer::SetQueryCacheCapacity(size_t capacity)
+{
+    const size_t shard_capacity = (capacity + QUERY_CACHE_SHARD_COUNT - 1) / QUERY_CACHE_SHARD_COUNT;
+    for (QueryCacheShard& shard : query_cache_) {
+        lock_guard<mutex> guard(shard.lock);
+        shard.queries.SetCapacity(shard_capacity);
+    }
+    query_cache_capacity_.store(capacity, memory_order_relaxed);
+}
+void SearchServer::SortUniqueTerms(QueryTerms& terms)
+{
+    sort(terms.begin(), terms.end());
+    terms.erase(unique(terms.begin(), terms.end()), terms.end());
+}
+string SearchServer::GetNormalizedQuery(const SearchIndex& index, const Query& query)
+{
+    string normalized_query;
+    const auto append = [&](auto value) {
+        normalized_query.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    append(index.GetGeneration());
+    // every list is led by its length, so the lists can't run into each other
+    for (const QueryTerms* terms : { &query.plus_terms, &query.required_terms, &query.minus_terms }) {
+        append(static_cast<uint32_t>(terms->size()));
+        for (const TermId term : *terms) {
+            append(term);
+        }
+    }
+    return normalized_query;
+}
+SearchServer::Query SearchServer::ParseQuery(const SearchIndex& index, const string_view text)
+{
+    // the words are taken one by one, no list of them is built
+    Query query;
+    string_view rest = text;
+    for (size_t pos = 0; pos != rest.npos; rest.remove_prefix(pos + 1)) {
+        pos = rest.find(' ');
+        AddQueryWord(index, query, ParseQueryWord(index, rest.substr(0, pos)));
+    }
+    SortUniqueTerms(query.plus_terms);
+    SortUniqueTerms(query.minus_terms);
+    SortUniqueTerms(query.required_terms);
     return query;
 }
-
-
-
@@ -0,0 +1,162 @@
+#include "Segment.h"
+
+void Segment::AddDocument(uint32_t internal_id, const TermFreqs& term_freqs)
+{
+    for (const auto& [term, freq] : term_freqs) {
+        mutable_postings_.Resize(term + 1);
+        shared_ptr<PostingList>& postings = mutable_postings_.GetMutable(term);
+        if (!postings) {
+            postings = make_shared<PostingList>();
+        }
+        else if (postings.use_count() > 1) {
+            // a copy of the segment reads the list
+            postings = make_shared<PostingList>(*postings);
+        }
+        postings->Add(internal_id, freq);
+    }
+    end_id_ = max(end_id_, internal_id + 1);
+    ++document_count_;
+}
+
+void Segment::Seal()
+{
+    // the lists may be shared with copies, the sealed segment takes its own
+    mutable_postings_.ForEach([&](size_t term, const shared_ptr<PostingList>& postings) {
+        if (postings) {
+            term_postings_.emplace_back(static_cast<TermId>(term), *postings);
+        }
+        });
+    mutable_postings_.Clear();
+    term_postings_.erase(remove_if(term_postings_.begin(), term_postings_.end(), [](const pair<TermId, PostingList>& term_postings) {
+        return term_postings.second.Empty();
+        }), term_postings_.end());
+    sort(term_postings_.begin(), term_postings_.end(), [](const pair<TermId, PostingList>& lhs, const pair<TermId, PostingList>& rhs) {
+        return lhs.first < rhs.first;
+        });
+    for (auto& [term, postings] : term_postings_) {
+        postings.ShrinkToFit();
+    }
+    term_postings_.shrink_to_fit();
+    sealed_ = true;
+}
+
+void Segment::Remap(const vector<uint32_t>& new_ids, uint32_t first_id, uint32_t end_id)
+{
+    for (auto& [term, postings] : term_postings_) {
+        postings.Remap(new_ids);
+    }
+    for (size_t term = 0; term < mutable_postings_.Size(); ++term) {
+        if (!mutable_postings_[term]) {
+            continue;
+        }
+        shared_ptr<PostingList>& postings = mutable_postings_.GetMutable(term);
+        if (postings.use_count() > 1) {
+            postings = make_shared<PostingList>(*postings);
+        }
+        postings->Remap(new_ids);
+    }
+    first_id_ = first_id;
+    end_id_ = end_id;
+    document_count_ = end_id - first_id;
+}
+
+Segment Segment::Merge(const vector<shared_ptr<const Segment>>& segments, const Bitmap& deleted)
+{
+    Segment merged(segments.front()->first_id_);
+    // Seal sorts the terms
+    FlatHashMap<TermId, PostingList> term_postings;
+    for (const shared_ptr<const Segment>& segment : segments) {
+        segment->ForEachPostings([&](TermId term, const PostingList& postings) {
+            PostingList& merged_postings = term_postings[term];
+            postings.ForEach([&](uint32_t internal_id, double term_freq) {
+                if (!deleted.Contains(internal_id)) {
+                    merged_postings.Add(internal_id, term_freq);
+                }
+                });
+            });
+        merged.end_id_ = segment->end_id_;
+        merged.document_count_ += segment->document_count_ - deleted.Cardinality(segment->first_id_, segment->end_id_);
+    }
+    merged.term_postings_.reserve(term_postings.size());
+    for (auto& [term, postings] : term_postings) {
+        merged.term_postings_.emplace_back(term, move(postings));
+    }
+    merged.Seal();
+    return merged;
+}
+
+void Segment::Write(index_file::SectionWriter& section) const
+{
+    section.Write(static_cast<uint64_t>(first_id_));
+    section.Write(static_cast<uint64_t>(end_id_));
+    section.Write(static_cast<uint64_t>(document_count_));
+    section.Write(static_cast<uint64_t>(term_postings_.size()));
+    for (const auto& [term, postings] : term_postings_) {
+        const PostingList::View& view = postings.GetView();
+        section.Write(PostingsHeader{ term, 0, view.size, view.controls_size, view.data_size, view.block_count, view.max_term_freq });
+        section.Write(view.controls, view.controls_size);
+        section.Write(view.data, view.data_size);
+        section.Write(view.term_freqs, view.size);
+        section.Write(view.blocks, view.block_count);
+    }
+}
+
+Segment Segment::Read(index_file::SectionReader section, shared_ptr<const MappedFile> file)
+{
+    const uint64_t first_id = section.Read<uint64_t>();
+    const uint64_t end_id = section.Read<uint64_t>();
+    if (first_id > end_id || end_id > numeric_limits<uint32_t>::max()) {
+        throw invalid_argument("index file has wrong segment ids"s);
+    }
+    Segment segment(static_cast<uint32_t>(first_id));
+    segment.end_id_ = static_cast<uint32_t>(end_id);
+    segment.document_count_ = static_cast<size_t>(section.Read<uint64_t>());
+    const uint64_t term_count = section.Read<uint64_t>();
+    for (uint64_t i = 0; i < term_count; ++i) {
+        const PostingsHeader header = section.Read<PostingsHeader>();
+        PostingList::View view;
+        view.size = static_cast<size_t>(header.size);
+        view.controls_size = static_cast<size_t>(header.controls_size);
+        view.data_size = static_cast<size_t>(header.data_size);
+        view.block_count = static_cast<size_t>(header.block_count);
+        view.max_term_freq = header.max_term_freq;
+        view.controls = section.Read<uint8_t>(view.controls_size);
+        view.data = section.Read<uint8_t>(view.data_size);
+        view.term_freqs = section.Read<double>(view.size);
+        view.blocks = section.Read<PostingList::Block>(view.block_count);
+        if (view.size == 0 || view.controls_size != (view.size + 3) / 4
+            || view.block_count != (view.size + PostingList::BLOCK_SIZE - 1) / PostingList::BLOCK_SIZE
+            || view.blocks[view.block_count - 1].last_document_id < first_id
+            || view.blocks[view.block_count - 1].last_document_id >= end_id
+            || any_of(view.blocks, view.blocks + view.block_count, [&](const PostingList::Block& block) {
+                return block.data_offset >= view.data_size;
+                })) {
+            throw invalid_argument("index file has malformed postings"s);
+        }
+        if (!segment.term_postings_.empty() && segment.term_postings_.back().first >= header.term) {
+            throw invalid_argument("index file has unsorted terms"s);
+        }
+        segment.term_postings_.emplace_back(header.term, PostingList::FromView(view));
+    }
+    segment.sealed_ = true;
+    segment.file_ = move(file);
+    return segment;
+}
+
+const PostingList& Segment::GetPostings(TermId term) const
+{
+    static const PostingList empty_postings;
+    const PostingList* postings = FindPostings(term);
+    return postings != nullptr ? *postings : empty_postings;
+}
+
+const PostingList* Segment::FindPostings(TermId term) const
+{
+    if (!sealed_) {
+        return term < mutable_postings_.Size() ? mutable_postings_[term].get() : nullptr;
+    }
+    const auto it = lower_bound(term_postings_.begin(), term_postings_.end(), term, [](const pair<TermId, PostingList>& term_postings, TermId term) {
+        return term_postings.first < term;
+        });
+    return it != term_postings_.end() && it->first == term ? &it->second : nullptr;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "headers.h"
+#include "Term_dictionary.h"
+#include "Posting_list.h"
+#include "Bitmap.h"
+#include "Index_file.h"
+#include "Persistent_vector.h"
+using namespace std;
+
+// Frequency of a term in one document, also an entry of a forward index section
+struct TermFreq {
+    TermId term;
+    double freq;
+};
+
+inline bool operator<(const TermFreq& lhs, const TermFreq& rhs)
+{
+    return lhs.term < rhs.term;
+}
+
+// (term id, term frequency) of one document sorted by term id
+using TermFreqs = vector<TermFreq>;
+
+// Inverted index of the documents with internal ids in [first id, end id).
+// A segment is filled while mutable and sealed once full: sealing compacts
+// the postings and sorts the terms for binary search. Sealed segments are
+// shared as shared_ptr<const Segment>, changing one means replacing it. Copies
+// of a mutable segment share its posting lists, adding a document to a copy
+// copies the lists it changes.
+// Removed documents stay in the postings until a merge drops them.
+// A segment read from a mapped index file views its postings in the file.
+class Segment {
+public:
+    explicit Segment(uint32_t first_id = 0)
+        : first_id_(first_id)
+        , end_id_(first_id)
+    {
+    }
+
+    // Internal ids must be added in ascending order, only to a mutable segment
+    void AddDocument(uint32_t internal_id, const TermFreqs& term_freqs);
+    void Seal();
+    // Renumbers the ids by new_ids[old id] dropping the removed documents,
+    // the live documents get the range [first_id, end_id)
+    void Remap(const vector<uint32_t>& new_ids, uint32_t first_id, uint32_t end_id);
+
+    // Concatenates adjacent segments given in id order into a sealed segment
+    // without the deleted documents
+    static Segment Merge(const vector<shared_ptr<const Segment>>& segments, const Bitmap& deleted);
+
+    // Writes the postings of a sealed segment as a postings section
+    void Write(index_file::SectionWriter& section) const;
+    // A sealed segment viewing the postings section of the mapped file,
+    // throws invalid_argument when the section is malformed
+    static Segment Read(index_file::SectionReader section, shared_ptr<const MappedFile> file);
+
+    // Empty postings for a term the segment doesn't have
+    const PostingList& GetPostings(TermId term) const;
+
+    uint32_t GetFirstId() const
+    {
+        return first_id_;
+    }
+
+    uint32_t GetEndId() const
+    {
+        return end_id_;
+    }
+
+    // Number of documents in the postings, deleted ones included
+    size_t GetDocumentCount() const
+    {
+        return document_count_;
+    }
+
+    bool IsSealed() const
+    {
+        return sealed_;
+    }
+
+private:
+    uint32_t first_id_;
+    uint32_t end_id_;
+    size_t document_count_ = 0;
+    bool sealed_ = false;
+    // sorted by term id, empty while mutable
+    vector<pair<TermId, PostingList>> term_postings_;
+    // the postings by term id while mutable, null for the terms without any
+    PersistentVector<shared_ptr<PostingList>> mutable_postings_;
+    // keeps the viewed postings mapped
+    shared_ptr<const MappedFile> file_;
+
+    struct PostingsHeader {
+        TermId term;
+        uint32_t reserved;
+        uint64_t size;
+        uint64_t controls_size;
+        uint64_t data_size;
+        uint64_t block_count;
+        double max_term_freq;
+    };
+
+    const PostingList* FindPostings(TermId term) const;
+
+    // Calls func(term, postings) for the postings of every term
+    template <typename Func>
+    void ForEachPostings(Func func) const
+    {
+        for (const auto& [term, postings] : term_postings_) {
+            func(term, postings);
+        }
+        mutable_postings_.ForEach([&](size_t term, const shared_ptr<PostingList>& postings) {
+            if (postings) {
+                func(static_cast<TermId>(term), *postings);
+            }
+            });
+    }
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// Vector of trivially copyable values keeping up to N of them inline, so a short
+// one never allocates. Past N the values move to the heap like a vector's.
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(is_trivially_copyable_v<T>, "SmallVector holds trivially copyable values");
+
+public:
+    SmallVector() = default;
+    SmallVector(const SmallVector&) = default;
+    SmallVector& operator=(const SmallVector&) = default;
+
+    SmallVector(SmallVector&& other) noexcept
+        : inline_(other.inline_)
+        , heap_(move(other.heap_))
+        , size_(exchange(other.size_, 0))
+    {
+        other.heap_.clear();
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept
+    {
+        if (this != &other) {
+            inline_ = other.inline_;
+            heap_ = move(other.heap_);
+            other.heap_.clear();
+            size_ = exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    void push_back(T value)
+    {
+        if (heap_.empty() && size_ < N) {
+            inline_[size_++] = value;
+            return;
+        }
+        if (heap_.empty()) {
+            heap_.reserve(N * 2);
+            heap_.assign(inline_.begin(), inline_.begin() + size_);
+        }
+        heap_.push_back(value);
+        ++size_;
+    }
+
+    T* erase(T* first, T* last)
+    {
+        const size_t from = first - data();
+        const size_t to = last - data();
+        if (heap_.empty()) {
+            copy(inline_.begin() + to, inline_.begin() + size_, inline_.begin() + from);
+        }
+        else {
+            heap_.erase(heap_.begin() + from, heap_.begin() + to);
+        }
+        size_ -= to - from;
+        return data() + from;
+    }
+
+    void clear()
+    {
+        heap_.clear();
+        size_ = 0;
+    }
+
+    T* data()
+    {
+        return heap_.empty() ? inline_.data() : heap_.data();
+    }
+
+    const T* data() const
+    {
+        return heap_.empty() ? inline_.data() : heap_.data();
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    T& operator[](size_t index)
+    {
+        return data()[index];
+    }
+
+    const T& operator[](size_t index) const
+    {
+        return data()[index];
+    }
+
+    T* begin()
+    {
+        return data();
+    }
+
+    T* end()
+    {
+        return data() + size_;
+    }
+
+    const T* begin() const
+    {
+        return data();
+    }
+
+    const T* end() const
+    {
+        return data() + size_;
+    }
+
+private:
+    array<T, N> inline_{};
+    // holds all the values once there were more than N of them
+    vector<T> heap_;
+    size_t size_ = 0;
+};
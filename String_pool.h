@@ -0,0 +1,65 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// Monotonic arena of strings: stored texts are copied back to back into large
+// chunks and never move or get freed before the pool, so their string_views
+// stay valid for its whole lifetime. Storing allocates only when a chunk is full.
+class StringPool {
+public:
+    inline static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+    // the moved-from pool is left empty, its free space belongs to the new owner
+    StringPool(StringPool&& other) noexcept
+        : chunks_(move(other.chunks_))
+        , free_(exchange(other.free_, nullptr))
+        , free_size_(exchange(other.free_size_, 0))
+        , allocated_size_(exchange(other.allocated_size_, 0))
+    {
+        other.chunks_.clear();
+    }
+
+    StringPool& operator=(StringPool&& other) noexcept
+    {
+        if (this != &other) {
+            chunks_ = move(other.chunks_);
+            other.chunks_.clear();
+            free_ = exchange(other.free_, nullptr);
+            free_size_ = exchange(other.free_size_, 0);
+            allocated_size_ = exchange(other.allocated_size_, 0);
+        }
+        return *this;
+    }
+
+    string_view Store(string_view text)
+    {
+        if (text.size() > free_size_) {
+            // a text longer than a chunk gets a chunk of its own
+            const size_t chunk_size = max(CHUNK_SIZE, text.size());
+            chunks_.push_back(make_unique<char[]>(chunk_size));
+            free_ = chunks_.back().get();
+            free_size_ = chunk_size;
+            allocated_size_ += chunk_size;
+        }
+        char* stored = free_;
+        copy(text.begin(), text.end(), stored);
+        free_ += text.size();
+        free_size_ -= text.size();
+        return string_view(stored, text.size());
+    }
+
+    // Bytes allocated for the chunks
+    size_t MemoryUsage() const
+    {
+        return allocated_size_ + chunks_.capacity() * sizeof(unique_ptr<char[]>);
+    }
+
+private:
+    vector<unique_ptr<char[]>> chunks_;
+    char* free_ = nullptr;
+    size_t free_size_ = 0;
+    size_t allocated_size_ = 0;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include "headers.h"
+#include "Flat_hash_map.h"
+#include "String_pool.h"
+#include "Persistent_vector.h"
+#include "Persistent_id_table.h"
+using namespace std;
+
+using TermId = uint32_t;
+
+// Interns every distinct word once and hands out dense term ids 0, 1, 2, ...
+// The texts are kept in a string pool and never move. Copies share the pool, the
+// texts and the hash index, a copy interning a word stores it in the pool once and
+// copies only the nodes it changes. The string_views returned by GetText stay
+// valid as long as any copy of the dictionary lives; one copy interns at a time.
+class TermDictionary {
+public:
+    inline static constexpr TermId INVALID_TERM_ID = numeric_limits<TermId>::max();
+
+    TermId Intern(string_view word)
+    {
+        const size_t hash = FlatHash<string_view>{}(word);
+        const TermId found = Find(word, hash);
+        if (found != INVALID_TERM_ID) {
+            return found;
+        }
+        const TermId id = static_cast<TermId>(texts_.Size());
+        texts_.PushBack(pool_->Store(word));
+        ids_.Insert(hash, id, [&](TermId term) {
+            return FlatHash<string_view>{}(texts_[term]);
+            }, [](TermId) {
+                return true;
+            });
+        return id;
+    }
+
+    TermId Find(string_view word) const
+    {
+        return Find(word, FlatHash<string_view>{}(word));
+    }
+
+    string_view GetText(TermId id) const
+    {
+        return texts_[id];
+    }
+
+    size_t Size() const
+    {
+        return texts_.Size();
+    }
+
+    size_t MemoryUsage() const
+    {
+        return pool_->MemoryUsage() + texts_.MemoryUsage() + ids_.MemoryUsage();
+    }
+
+private:
+    shared_ptr<StringPool> pool_ = make_shared<StringPool>();
+    PersistentVector<string_view> texts_;
+    PersistentIdTable ids_;
+
+    TermId Find(string_view word, size_t hash) const
+    {
+        const uint32_t id = ids_.Find(hash, [&](TermId term) {
+            return texts_[term] == word;
+            });
+        return id != PersistentIdTable::EMPTY ? id : INVALID_TERM_ID;
+    }
+};
@@ -1,4 +1,10 @@
 #include "Tests.h"
+#include "Corpus_ingest.h"
+#include "Tokenizer.h"
+#include <atomic>
+#include <random>
+#include <filesystem>
+#include <fstream>
 template <typename Tfirst, typename Tsecond>
 ostream& operator<<(ostream& out, const pair<Tfirst, Tsecond>& container)
 {
@@ -241,6 +247,1453 @@ void TestPredicate()
     ASSERT_EQUAL_HINT(rate, rate_input, "Invalid sampling by ratings"s);
 }
 
+// Removing documents.
+// A removed document must disappear from the inverted index:
+// it is neither found nor taken into account in the relevance of the rest.
+
+void TestRemoveDocument()
+{
+    SearchServer search_server("and in on"s);
+    search_server.AddDocument(0, "white cat and fashion collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    search_server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    search_server.AddDocument(2, "well-groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    search_server.AddDocument(3, "fluffy dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.RemoveDocument(3);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 3u);
+    ASSERT_HINT(search_server.GetWordFrequencies(3).empty(), "Removed document must not have words"s);
+    const auto found_docs = search_server.FindTopDocuments("fluffy well-groomed cat"s);
+    ASSERT_EQUAL(found_docs.size(), 3u);
+    ASSERT_EQUAL_HINT(found_docs[0].id, 1, "Removed document must not affect relevance"s);
+    ASSERT_HINT((abs(found_docs[0].relevance - 0.650672) < epsilon), "Removed document must not affect relevance"s);
+    const auto found_docs_par = search_server.FindTopDocuments(execution::par, "fluffy well-groomed cat -collar"s);
+    ASSERT_EQUAL(found_docs_par.size(), 2u);
+    ASSERT_EQUAL(found_docs_par[0].id, 1);
+    ASSERT_EQUAL(found_docs_par[1].id, 2);
+}
+
+// Query words are resolved to term ids.
+// Repeated words are counted once, words unknown to the index match nothing
+// and matched words are returned in lexicographic order.
+
+void TestQueryTerms()
+{
+    SearchServer search_server("and in on"s);
+    search_server.AddDocument(0, "white cat and fashion collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    search_server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    const auto found_once = search_server.FindTopDocuments("fluffy"s);
+    const auto found_twice = search_server.FindTopDocuments("fluffy fluffy unknown -missing"s);
+    ASSERT_EQUAL(found_twice.size(), 1u);
+    ASSERT_HINT(abs(found_once[0].relevance - found_twice[0].relevance) < epsilon, "Repeated query word must be counted once"s);
+    const auto [words, status] = search_server.MatchDocument("tail unknown cat fluffy"s, 1);
+    const vector<string_view> expected = { "cat"sv, "fluffy"sv, "tail"sv };
+    ASSERT_HINT(words == expected, "Matched words must be sorted"s);
+}
+
+// Compressed postings.
+// Ids decoded by the vectorized and the scalar decoder must be equal,
+// including ids added out of order and removed ones.
+
+void TestPostingList()
+{
+    PostingList postings;
+    vector<int> expected;
+    for (int id = 0; id < 1000; ++id) {
+        const int document_id = id * id * 37 + (id % 7);
+        if (id % 3 != 0) {
+            postings.Add(document_id, 1.0 / (id + 1));
+            expected.push_back(document_id);
+        }
+    }
+    postings.Add(1, 0.5);
+    expected.insert(upper_bound(expected.begin(), expected.end(), 1), 1);
+    postings.Remove(expected[200]);
+    expected.erase(expected.begin() + 200);
+    for (const bool vectorized : { true, false }) {
+        EnableVectorizedDecoding(vectorized);
+        vector<int> decoded;
+        postings.ForEach([&decoded](int document_id, double) { decoded.push_back(document_id); });
+        ASSERT_EQUAL_HINT(decoded, expected, vectorized ? "Vectorized decoding"s : "Scalar decoding"s);
+    }
+    EnableVectorizedDecoding(true);
+}
+
+// Cached inverse document frequency.
+// With zero tolerance relevance follows every change of the corpus,
+// otherwise the idf of a word is kept while the corpus changes within the tolerance.
+
+void TestIdfTolerance()
+{
+    for (const double tolerance : { 0.0, 0.5 }) {
+        SearchServer search_server(""s);
+        search_server.SetIdfTolerance(tolerance);
+        search_server.AddDocument(0, "cat"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.AddDocument(1, "dog"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, { 1 });
+        // "dog" was cached for 2 documents, 3 documents are within 50%
+        const double expected = tolerance > 0.0 ? log(2.0) : log(3.0);
+        ASSERT_HINT(abs(search_server.FindTopDocuments("dog"s)[0].relevance - expected) < epsilon, "Idf must follow the tolerance"s);
+        search_server.AddDocument(3, "parrot"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(abs(search_server.FindTopDocuments("dog"s)[0].relevance - log(4.0)) < epsilon, "Idf must be refreshed out of the tolerance"s);
+    }
+}
+
+// Dense internal ids.
+// After most of the documents are removed the rest are renumbered,
+// search, matching and iteration keep working with the ids of the caller.
+
+void TestDocumentIdCompaction()
+{
+    SearchServer search_server(""s);
+    for (int id = 0; id < 100; ++id) {
+        search_server.AddDocument(id * 10, (id % 2 == 0 ? "even number "s : "odd number "s) + to_string(id), DocumentStatus::ACTUAL, { id });
+    }
+    for (int id = 0; id < 100; ++id) {
+        if (id % 10 != 0) {
+            search_server.RemoveDocument(id * 10);
+        }
+    }
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 10u);
+    search_server.WaitForMerges();
+    ASSERT_HINT(search_server.GetDeletedDocumentCount() <= search_server.GetDocumentCount(),
+        "Most internal ids of removed documents must be renumbered in the background"s);
+    const vector<int> expected_ids = { 0, 100, 200, 300, 400, 500, 600, 700, 800, 900 };
+    ASSERT_EQUAL(vector<int>(search_server.begin(), search_server.end()), expected_ids);
+    search_server.AddDocument(5, "even number new"s, DocumentStatus::ACTUAL, { 100 });
+    const auto found_docs = search_server.FindTopDocuments("even"s);
+    ASSERT_EQUAL(found_docs.size(), 5u);
+    ASSERT_EQUAL_HINT(found_docs[0].id, 5, "New document must have the best rating"s);
+    ASSERT_EQUAL(found_docs[1].id, 900);
+    const auto [words, status] = search_server.MatchDocument("number 70"s, 700);
+    ASSERT_EQUAL(words.size(), 2u);
+}
+
+// Built-in status and rating filter.
+// Evaluated over blocks of candidates it must select the same documents
+// as the equivalent user predicate.
+
+void TestDocumentFilter()
+{
+    SearchServer search_server(""s);
+    const DocumentStatus statuses[] = { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED };
+    for (int id = 0; id < 300; ++id) {
+        search_server.AddDocument(id, "common word"s + (id % 3 == 0 ? " rare"s : ""s), statuses[id % 4], { id % 50 - 25 });
+    }
+    const RatingRange rating_range{ -5, 10 };
+    for (const DocumentStatus status : statuses) {
+        const DocumentFilter filter{ status, rating_range };
+        const auto predicate = [status, rating_range](int, DocumentStatus document_status, int rating) {
+            return document_status == status && rating >= rating_range.min_rating && rating <= rating_range.max_rating;
+        };
+        for (const string& query : { "common"s, "word -rare"s }) {
+            vector<int> filtered;
+            for (const Document& document : search_server.FindTopDocuments(query, status, rating_range)) {
+                filtered.push_back(document.id);
+            }
+            vector<int> expected;
+            for (const Document& document : search_server.FindTopDocuments(query, predicate)) {
+                expected.push_back(document.id);
+            }
+            ASSERT_EQUAL_HINT(filtered, expected, "Filter must select the same documents as the predicate"s);
+            vector<int> filtered_par;
+            for (const Document& document : search_server.FindTopDocuments(execution::par, query, filter)) {
+                filtered_par.push_back(document.id);
+            }
+            ASSERT_EQUAL(filtered_par, expected);
+        }
+    }
+}
+
+// Top-k pruning.
+// The pruned search must return the same documents as exhaustive scoring
+// while fully scoring only a part of the candidates.
+
+void TestMaxScorePruning()
+{
+    SearchServer search_server(""s);
+    const vector<string> words = { "common"s, "frequent"s, "usual"s, "rare"s, "unique"s };
+    for (int id = 0; id < 2000; ++id) {
+        string text = "common"s;
+        for (size_t word = 1; word < words.size(); ++word) {
+            if (id % (word * word * 3) == 0) {
+                text += " "s + words[word];
+            }
+        }
+        text += id % 7 == 0 ? " common"s : " filler"s;
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+    }
+    for (const string& query : { "common rare"s, "frequent usual unique"s, "common frequent rare unique -usual"s }) {
+        const auto pruned = search_server.FindTopDocuments(query);
+        const auto exhaustive = search_server.FindTopDocuments(execution::par, query);
+        ASSERT_EQUAL(pruned.size(), exhaustive.size());
+        for (size_t i = 0; i < pruned.size(); ++i) {
+            ASSERT_EQUAL_HINT(pruned[i].id, exhaustive[i].id, "Pruned search must return the exhaustive top"s);
+            ASSERT(abs(pruned[i].relevance - exhaustive[i].relevance) < epsilon);
+        }
+    }
+
+    PostingList common;
+    PostingList rare;
+    for (uint32_t id = 0; id < 10000; ++id) {
+        common.Add(id, 0.1);
+        if (id % 10 == 0) {
+            rare.Add(id, 0.5);
+        }
+    }
+    MaxScoreEvaluator evaluator;
+    evaluator.AddTerm(common, 0.01);
+    evaluator.AddTerm(rare, 2.3);
+    const auto top = evaluator.FindTopDocuments(5, [](uint32_t id, double relevance) -> optional<Document> {
+        return Document(static_cast<int>(id), relevance, 0);
+        });
+    ASSERT_EQUAL(top.size(), 5u);
+    ASSERT_HINT(evaluator.GetScoredDocumentCount() < 2000u, "Documents without the rare word must be skipped"s);
+}
+
+// Result count.
+// FindTopDocuments must return the configured number of the most relevant documents,
+// the same ones for the sequential and the parallel search.
+
+void TestResultDocumentCount()
+{
+    SearchServer search_server(""s);
+    for (int id = 0; id < 500; ++id) {
+        const string text = id % 3 == 0 ? "cat dog"s : id % 3 == 1 ? "cat cat bird"s : "bird fish"s;
+        search_server.AddDocument(id, text, id % 4 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id });
+    }
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    search_server.SetMaxResultDocumentCount(100);
+    ASSERT_EQUAL(search_server.GetMaxResultDocumentCount(), 100u);
+    const auto seq = search_server.FindTopDocuments("cat bird -fish"s);
+    const auto par = search_server.FindTopDocuments(execution::par, "cat bird -fish"s);
+    ASSERT_EQUAL(seq.size(), 100u);
+    ASSERT_EQUAL(par.size(), 100u);
+    ASSERT(is_sorted(seq.begin(), seq.end(), IsMoreRelevant));
+    for (size_t i = 0; i < seq.size(); ++i) {
+        ASSERT_EQUAL_HINT(seq[i].id, par[i].id, "Parallel search must select the same top documents"s);
+    }
+    ASSERT_EQUAL(search_server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::BANNED).size(), 84u);
+
+    search_server.SetMaxResultDocumentCount(0);
+    ASSERT(search_server.FindTopDocuments("cat"s).empty());
+    ASSERT(search_server.FindTopDocuments(execution::par, "cat"s).empty());
+}
+
+// Bitmaps.
+// The compressed bitmaps must behave like sets of ids in both container layouts,
+// and documents with any of the minus words must be excluded.
+
+void TestBitmap()
+{
+    Bitmap dense;
+    Bitmap sparse;
+    set<uint32_t> dense_ids;
+    set<uint32_t> sparse_ids;
+    for (uint32_t id = 0; id < 200000; id += 3) {
+        dense.Add(id);
+        dense_ids.insert(id);
+    }
+    for (uint32_t id = 199999; id > 101; id -= 101) {
+        sparse.Add(id);
+        sparse_ids.insert(id);
+    }
+    dense.Remove(3);
+    dense_ids.erase(3);
+    ASSERT_EQUAL(dense.Cardinality(), dense_ids.size());
+    ASSERT(dense.Contains(6) && !dense.Contains(3) && !dense.Contains(7));
+
+    const auto to_set = [](const Bitmap& bitmap) {
+        set<uint32_t> ids;
+        bitmap.ForEach([&](uint32_t id) {
+            ids.insert(id);
+            });
+        return ids;
+    };
+    ASSERT(to_set(sparse) == sparse_ids);
+    for (const auto& [bitmap, ids] : { pair{ &dense, &dense_ids }, pair{ &sparse, &sparse_ids } }) {
+        // the second pass starts over from a smaller id
+        Bitmap::WordReader reader(*bitmap);
+        for (int pass = 0; pass < 2; ++pass) {
+            for (uint32_t first_id = 0; first_id < 200000; first_id += 64 * 37) {
+                uint64_t word = 0;
+                for (uint32_t i = 0; i < 64; ++i) {
+                    word |= uint64_t{ ids->count(first_id + i) } << i;
+                }
+                ASSERT_EQUAL(reader.Read(first_id), word);
+            }
+        }
+    }
+
+    set<uint32_t> expected;
+    Bitmap united = dense;
+    united |= sparse;
+    set_union(dense_ids.begin(), dense_ids.end(), sparse_ids.begin(), sparse_ids.end(), inserter(expected, expected.end()));
+    ASSERT_EQUAL(united.Cardinality(), expected.size());
+    ASSERT(to_set(united) == expected);
+
+    expected.clear();
+    Bitmap intersected = dense;
+    intersected &= sparse;
+    set_intersection(dense_ids.begin(), dense_ids.end(), sparse_ids.begin(), sparse_ids.end(), inserter(expected, expected.end()));
+    ASSERT(to_set(intersected) == expected);
+
+    expected.clear();
+    Bitmap difference = united;
+    difference -= dense;
+    set_difference(sparse_ids.begin(), sparse_ids.end(), dense_ids.begin(), dense_ids.end(), inserter(expected, expected.end()));
+    ASSERT(to_set(difference) == expected);
+    difference -= sparse;
+    ASSERT(difference.Empty());
+
+    SearchServer search_server(""s);
+    const vector<string> spam_words = { "spam"s, "ads"s, "promo"s, "offer"s };
+    for (int id = 0; id < 1000; ++id) {
+        search_server.AddDocument(id, "news "s + spam_words[id % spam_words.size()], DocumentStatus::ACTUAL, { id });
+    }
+    search_server.SetMaxResultDocumentCount(1000);
+    ASSERT_EQUAL(search_server.FindTopDocuments("news -spam -ads"s).size(), 500u);
+    const auto par = search_server.FindTopDocuments(execution::par, "news -spam -ads -promo"s);
+    ASSERT_EQUAL(par.size(), 250u);
+    for (const Document& document : par) {
+        ASSERT_EQUAL_HINT(document.id % 4, 3, "Documents with minus words must be excluded"s);
+    }
+}
+
+// Status bitmaps.
+// Searches by status must return exactly the documents with that status
+// after documents are removed and the internal ids are compacted.
+
+void TestStatusDocuments()
+{
+    SearchServer search_server(""s);
+    const vector<DocumentStatus> statuses = { DocumentStatus::BANNED, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::ACTUAL };
+    for (int id = 0; id < 400; ++id) {
+        search_server.AddDocument(id, "white cat"s, statuses[id % statuses.size()], { id });
+    }
+    search_server.SetMaxResultDocumentCount(400);
+    const auto check = [&](DocumentStatus status, size_t expected_count) {
+        const auto seq = search_server.FindTopDocuments("cat"s, status);
+        const auto par = search_server.FindTopDocuments(execution::par, "cat"s, status);
+        ASSERT_EQUAL(seq.size(), expected_count);
+        ASSERT_EQUAL(par.size(), expected_count);
+        for (const Document& document : seq) {
+            ASSERT_HINT(statuses[document.id % statuses.size()] == status, "Only documents with the status must be found"s);
+        }
+    };
+    check(DocumentStatus::ACTUAL, 100);
+    check(DocumentStatus::BANNED, 200);
+    check(DocumentStatus::REMOVED, 0);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 100u);
+
+    // removing every other document compacts the internal ids
+    for (int id = 0; id < 400; id += 2) {
+        search_server.RemoveDocument(id);
+    }
+    search_server.RemoveDocument(3);
+    check(DocumentStatus::ACTUAL, 99);
+    check(DocumentStatus::IRRELEVANT, 100);
+    check(DocumentStatus::BANNED, 0);
+}
+
+// Required words.
+// Documents found for a query with +words must contain all of them,
+// and the postings intersection must agree with the set intersection.
+
+void TestRequiredWords()
+{
+    vector<uint32_t> every_third;
+    vector<uint32_t> every_fifth;
+    vector<uint32_t> rare = { 15, 16, 2986, 45000, 99990 };
+    PostingList every_third_postings;
+    PostingList every_fifth_postings;
+    PostingList rare_postings;
+    for (uint32_t id = 0; id < 100000; ++id) {
+        if (id % 3 == 0) {
+            every_third.push_back(id);
+            every_third_postings.Add(id, 0.1);
+        }
+        if (id % 5 == 0) {
+            every_fifth.push_back(id);
+            every_fifth_postings.Add(id, 0.1);
+        }
+    }
+    for (const uint32_t id : rare) {
+        rare_postings.Add(id, 0.1);
+    }
+    vector<uint32_t> expected;
+    set_intersection(every_third.begin(), every_third.end(), every_fifth.begin(), every_fifth.end(), back_inserter(expected));
+    ASSERT(IntersectPostings({ &every_third_postings, &every_fifth_postings }) == expected);
+    ASSERT((IntersectPostings({ &every_third_postings, &rare_postings, &every_fifth_postings }) == vector<uint32_t>{ 15, 45000, 99990 }));
+
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "red shoes size 42"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "red shoes size 40"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "red hat size 42"s, DocumentStatus::ACTUAL, { 3 });
+    search_server.AddDocument(4, "blue shoes and red laces"s, DocumentStatus::ACTUAL, { 4 });
+    search_server.AddDocument(5, "green shoes size 42"s, DocumentStatus::ACTUAL, { 5 });
+    for (const string& query : { "+red +shoes size 42"s, "+red +shoes +size 42"s, "+42 +red -hat"s }) {
+        const auto seq = search_server.FindTopDocuments(query);
+        const auto par = search_server.FindTopDocuments(execution::par, query);
+        ASSERT_EQUAL(seq.size(), par.size());
+        for (size_t i = 0; i < seq.size(); ++i) {
+            ASSERT_EQUAL(seq[i].id, par[i].id);
+            ASSERT(abs(seq[i].relevance - par[i].relevance) < epsilon);
+        }
+    }
+    const auto found = search_server.FindTopDocuments("+red +shoes size 42"s);
+    ASSERT_EQUAL(found.size(), 3u);
+    ASSERT_EQUAL(found[0].id, 1);
+    ASSERT_EQUAL(search_server.FindTopDocuments("+red +shoes +size 42"s).size(), 2u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("+42 +red -hat"s).size(), 1u);
+    ASSERT_HINT(search_server.FindTopDocuments("+red +boots"s).empty(), "An unknown required word matches nothing"s);
+    ASSERT_EQUAL(search_server.FindTopDocuments("+red +and"s).size(), 4u);
+
+    ASSERT(get<0>(search_server.MatchDocument("+shoes red"s, 3)).empty());
+    ASSERT_EQUAL(get<0>(search_server.MatchDocument(execution::par, "+shoes red"s, 4)).size(), 2u);
+
+    for (const string& query : { "+"s, "++red"s, "-+red"s, "+-red"s }) {
+        try {
+            search_server.FindTopDocuments(query);
+            ASSERT_HINT(false, "Malformed required word must throw"s);
+        }
+        catch (const invalid_argument&) {
+        }
+    }
+}
+
+// Segments.
+// A server with many small merged segments must return the same documents
+// as a server keeping everything in one segment, also after removals.
+
+void TestSegments()
+{
+    SearchServer segmented(""s);
+    SearchServer single(""s);
+    segmented.SetSegmentCapacity(10);
+    const vector<string> words = { "cat"s, "dog"s, "bird"s, "fish"s, "mouse"s, "horse"s, "cow"s };
+    const auto make_text = [&](int id) {
+        string text;
+        for (size_t word = 0; word < words.size(); ++word) {
+            if ((id * 7 + 3) % (word + 2) == 0) {
+                text += words[word] + " "s;
+            }
+        }
+        return text + "pet"s;
+    };
+    for (int id = 0; id < 600; ++id) {
+        const DocumentStatus status = id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        segmented.AddDocument(id, make_text(id), status, { id });
+        single.AddDocument(id, make_text(id), status, { id });
+    }
+    segmented.WaitForMerges();
+    ASSERT_HINT(segmented.GetSegmentCount() < 20u, "Sealed segments must be merged"s);
+    ASSERT_EQUAL(single.GetSegmentCount(), 0u);
+
+    const auto check = [&]() {
+        segmented.SetMaxResultDocumentCount(50);
+        single.SetMaxResultDocumentCount(50);
+        for (const string& query : { "cat dog"s, "bird -fish pet"s, "+cat +dog horse"s, "mouse cow -pet"s }) {
+            for (const auto& [lhs, rhs] : { pair{ segmented.FindTopDocuments(query), single.FindTopDocuments(query) },
+                pair{ segmented.FindTopDocuments(execution::par, query), single.FindTopDocuments(query) },
+                pair{ segmented.FindTopDocuments(query, DocumentStatus::BANNED), single.FindTopDocuments(execution::par, query, DocumentStatus::BANNED) } }) {
+                ASSERT_EQUAL(lhs.size(), rhs.size());
+                for (size_t i = 0; i < lhs.size(); ++i) {
+                    ASSERT_EQUAL_HINT(lhs[i].id, rhs[i].id, "Segments must not change the results"s);
+                    ASSERT(abs(lhs[i].relevance - rhs[i].relevance) < epsilon);
+                }
+            }
+        }
+    };
+    check();
+    for (int id = 0; id < 600; id += 3) {
+        segmented.RemoveDocument(id);
+        single.RemoveDocument(id);
+    }
+    segmented.WaitForMerges();
+    check();
+    // removing most documents compacts the internal ids of all segments
+    for (int id = 1; id < 600; id += 3) {
+        segmented.RemoveDocument(id);
+        single.RemoveDocument(id);
+    }
+    check();
+    for (int id = 600; id < 700; ++id) {
+        segmented.AddDocument(id, make_text(id), DocumentStatus::ACTUAL, { id });
+        single.AddDocument(id, make_text(id), DocumentStatus::ACTUAL, { id });
+    }
+    segmented.WaitForMerges();
+    check();
+}
+
+// Deleted documents.
+// Removed documents must not be found while they are still in the postings,
+// and the background compaction must drop them from the segments.
+
+void TestDeletedDocuments()
+{
+    SearchServer search_server(""s);
+    SearchServer live_server(""s);
+    search_server.SetSegmentCapacity(10);
+    // a single removed document makes any segment of up to 1000 documents due,
+    // also one merged while the last documents were removed
+    search_server.SetCompactionThreshold(0.001);
+    search_server.SetMaxResultDocumentCount(100);
+    live_server.SetMaxResultDocumentCount(100);
+    for (int id = 0; id < 200; ++id) {
+        const string text = id % 2 == 0 ? "red shoes"s : "red hat"s;
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        if (id % 3 != 0) {
+            live_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        }
+    }
+    search_server.WaitForMerges();
+    for (int id = 0; id < 200; id += 3) {
+        search_server.RemoveDocument(id);
+    }
+    search_server.RemoveDocument(execution::par, 3);
+    search_server.RemoveDocument(execution::par, 3);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), live_server.GetDocumentCount());
+
+    const auto check = [&]() {
+        for (const string& query : { "red"s, "shoes -hat"s, "+red +shoes"s }) {
+            const auto lhs = search_server.FindTopDocuments(query, [](int, DocumentStatus, int) { return true; });
+            const auto par = search_server.FindTopDocuments(execution::par, query);
+            const auto rhs = live_server.FindTopDocuments(query);
+            ASSERT_EQUAL(lhs.size(), rhs.size());
+            ASSERT_EQUAL(par.size(), rhs.size());
+            for (size_t i = 0; i < lhs.size(); ++i) {
+                ASSERT_HINT(lhs[i].id % 3 != 0 && par[i].id % 3 != 0, "Removed documents must not be found"s);
+                ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+                ASSERT_EQUAL(par[i].id, rhs[i].id);
+            }
+        }
+    };
+    check();
+    search_server.WaitForMerges();
+    ASSERT_EQUAL_HINT(search_server.GetDeletedDocumentCount(), 0u, "Compaction must drop the removed documents"s);
+    check();
+}
+
+// Id compaction.
+// The documents must be renumbered once the set share of the internal ids is unused, not before.
+
+void TestIdCompaction()
+{
+    SearchServer search_server(""s);
+    search_server.SetSegmentCapacity(10);
+    // only a segment without live documents is rewritten
+    search_server.SetCompactionThreshold(1.0);
+    search_server.SetIdCompactionThreshold(0.25);
+    for (int id = 0; id < 40; ++id) {
+        search_server.AddDocument(id, "red "s + (id % 2 == 0 ? "shoes"s : "hat"s), DocumentStatus::ACTUAL, { id });
+    }
+    search_server.WaitForMerges();
+    for (int id = 0; id < 36; id += 4) {
+        search_server.RemoveDocument(id);
+    }
+    search_server.WaitForMerges();
+    ASSERT_EQUAL_HINT(search_server.GetDeletedDocumentCount(), 9u, "Less than a quarter of the ids is unused"s);
+    search_server.RemoveDocument(36);
+    search_server.WaitForMerges();
+    ASSERT_EQUAL_HINT(search_server.GetDeletedDocumentCount(), 0u, "A quarter of the ids is unused"s);
+    const vector<Document> documents = search_server.FindTopDocuments("shoes"s);
+    ASSERT_EQUAL(documents.size(), 5u);
+    for (const Document& document : documents) {
+        ASSERT(document.id % 4 == 2);
+    }
+    search_server.AddDocument(100, "red shoes"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(search_server.FindTopDocuments("shoes"s).size(), 5u);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 31u);
+}
+
+// Index files.
+// A server opened from a saved index must find the same documents as the saved one
+// and keep working when documents are added and removed afterwards.
+
+void TestIndexFile()
+{
+    const string path = (filesystem::temp_directory_path() / "search_server_test.index"s).string();
+    SearchServer saved_server("and in"s);
+    saved_server.SetSegmentCapacity(16);
+    saved_server.SetMaxResultDocumentCount(50);
+    for (int id = 0; id < 300; ++id) {
+        const string text = "cat "s + to_string(id % 7) + (id % 2 == 0 ? " and dog"s : " in hat"s);
+        saved_server.AddDocument(id * 2, text, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id });
+    }
+    for (int id = 0; id < 300; id += 4) {
+        saved_server.RemoveDocument(id * 2);
+    }
+    saved_server.SaveIndex(path);
+
+    SearchServer opened_server;
+    opened_server.SetMaxResultDocumentCount(50);
+    opened_server.OpenIndex(path);
+    ASSERT_EQUAL(opened_server.GetDocumentCount(), saved_server.GetDocumentCount());
+    ASSERT(equal(opened_server.begin(), opened_server.end(), saved_server.begin(), saved_server.end()));
+    for (const string& query : { "cat"s, "dog -3"s, "+hat +5 cat"s, "in and"s }) {
+        const auto expected = saved_server.FindTopDocuments(query);
+        const auto found = opened_server.FindTopDocuments(query);
+        const auto found_par = opened_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL);
+        ASSERT_EQUAL(found.size(), expected.size());
+        ASSERT_EQUAL(found_par.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].rating, expected[i].rating);
+            ASSERT(abs(found[i].relevance - expected[i].relevance) < epsilon);
+            ASSERT_EQUAL(found_par[i].id, expected[i].id);
+        }
+        ASSERT_EQUAL(opened_server.FindTopDocuments(query, DocumentStatus::BANNED).size(),
+            saved_server.FindTopDocuments(query, DocumentStatus::BANNED).size());
+    }
+    const auto [words, status] = opened_server.MatchDocument("dog cat in"s, 4);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT(status == DocumentStatus::ACTUAL);
+    ASSERT(opened_server.GetWordFrequencies(2) == saved_server.GetWordFrequencies(2));
+
+    opened_server.AddDocument(1000, "parrot and cat"s, DocumentStatus::ACTUAL, { 9 });
+    opened_server.RemoveDocument(2);
+    ASSERT_EQUAL(opened_server.FindTopDocuments("parrot"s).size(), 1u);
+    for (const Document& document : opened_server.FindTopDocuments("cat 1"s)) {
+        ASSERT_HINT(document.id != 2, "Removed documents must not be found"s);
+    }
+
+    {
+        ofstream file(path, ios::binary | ios::trunc);
+        file << "not an index"s;
+    }
+    try {
+        opened_server.OpenIndex(path);
+        ASSERT_HINT(false, "A malformed index file must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(opened_server.FindTopDocuments("parrot"s).size(), 1u);
+    filesystem::remove(path);
+}
+// Snapshots.
+// A loaded snapshot must restore the documents, the removed ones included,
+// saving must not stop concurrent queries and a corrupted file must be rejected.
+
+void TestSnapshot()
+{
+    const string path = (filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+    const string corrupted_path = path + ".corrupted"s;
+    SearchServer saved_server("and in"s);
+    saved_server.SetSegmentCapacity(32);
+    saved_server.SetMaxResultDocumentCount(40);
+    for (int id = 0; id < 500; ++id) {
+        const string text = "bird "s + to_string(id % 9) + (id % 3 == 0 ? " and cage"s : " in sky"s);
+        saved_server.AddDocument(id, text, id % 4 == 0 ? DocumentStatus::IRRELEVANT : DocumentStatus::ACTUAL, { id });
+    }
+    for (int id = 0; id < 500; id += 7) {
+        saved_server.RemoveDocument(id);
+    }
+    atomic_bool saving = true;
+    thread reader([&]() {
+        while (saving) {
+            ASSERT(!saved_server.FindTopDocuments("bird"s).empty());
+        }
+        });
+    saved_server.SaveSnapshot(path);
+    saving = false;
+    reader.join();
+
+    SearchServer loaded_server;
+    loaded_server.SetMaxResultDocumentCount(40);
+    loaded_server.LoadSnapshot(path);
+    ASSERT_EQUAL(loaded_server.GetDocumentCount(), saved_server.GetDocumentCount());
+    ASSERT(equal(loaded_server.begin(), loaded_server.end(), saved_server.begin(), saved_server.end()));
+    for (const string& query : { "bird"s, "cage -4"s, "+sky +2 bird"s, "and 7"s }) {
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT }) {
+            const auto expected = saved_server.FindTopDocuments(query, status);
+            const auto found = loaded_server.FindTopDocuments(query, status);
+            const auto found_par = loaded_server.FindTopDocuments(execution::par, query, status);
+            ASSERT_EQUAL(found.size(), expected.size());
+            ASSERT_EQUAL(found_par.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected[i].id);
+                ASSERT(abs(found[i].relevance - expected[i].relevance) < epsilon);
+                ASSERT_EQUAL(found_par[i].id, expected[i].id);
+            }
+        }
+    }
+    ASSERT(loaded_server.GetWordFrequencies(5) == saved_server.GetWordFrequencies(5));
+
+    // the snapshot can be replaced while the loaded server still uses it
+    loaded_server.AddDocument(7, "bird of paradise"s, DocumentStatus::ACTUAL, { 1 });
+    loaded_server.RemoveDocument(8);
+    loaded_server.SaveSnapshot(path);
+    ASSERT_EQUAL(loaded_server.FindTopDocuments("paradise"s).size(), 1u);
+    SearchServer reloaded_server;
+    reloaded_server.LoadSnapshot(path);
+    ASSERT_EQUAL(reloaded_server.GetDocumentCount(), loaded_server.GetDocumentCount());
+    ASSERT_EQUAL(reloaded_server.FindTopDocuments("paradise"s).size(), 1u);
+
+    {
+        ifstream input(path, ios::binary);
+        string contents((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+        contents[contents.size() - 20] ^= 1;
+        ofstream output(corrupted_path, ios::binary | ios::trunc);
+        output << contents;
+    }
+    try {
+        reloaded_server.LoadSnapshot(corrupted_path);
+        ASSERT_HINT(false, "A corrupted snapshot must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(reloaded_server.FindTopDocuments("paradise"s).size(), 1u);
+    filesystem::remove(path);
+    filesystem::remove(corrupted_path);
+}
+// Write-ahead log.
+// The changes logged after the latest snapshot must be replayed on recovery,
+// a torn record at the end of the log must be ignored.
+
+void TestWriteAheadLog()
+{
+    const string snapshot_path = (filesystem::temp_directory_path() / "search_server_test_wal.snapshot"s).string();
+    const string log_path = (filesystem::temp_directory_path() / "search_server_test.wal"s).string();
+    filesystem::remove(snapshot_path);
+    filesystem::remove(log_path);
+    const auto text = [](int id) {
+        return "fox "s + to_string(id % 13) + (id % 2 == 0 ? " jumps"s : " sleeps"s);
+    };
+    SearchServer expected_server("over"s);
+    expected_server.SetMaxResultDocumentCount(1000);
+    for (int id = 0; id < 400; ++id) {
+        if (id % 5 != 0) {
+            expected_server.AddDocument(id, text(id), DocumentStatus::ACTUAL, { id });
+        }
+    }
+    const auto check = [&](const SearchServer& search_server) {
+        ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount());
+        ASSERT(equal(search_server.begin(), search_server.end(), expected_server.begin(), expected_server.end()));
+        for (const string& query : { "fox"s, "jumps -3"s, "+sleeps 7"s }) {
+            const auto found = search_server.FindTopDocuments(query);
+            const auto expected = expected_server.FindTopDocuments(query);
+            ASSERT_EQUAL(found.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected[i].id);
+            }
+        }
+    };
+    {
+        SearchServer search_server("over"s);
+        search_server.SetMaxResultDocumentCount(1000);
+        search_server.SetSegmentCapacity(64);
+        search_server.OpenWriteAheadLog(log_path);
+        // concurrent writers share the fsync of their records
+        vector<thread> writers;
+        for (int writer = 0; writer < 4; ++writer) {
+            writers.emplace_back([&, writer]() {
+                for (int id = writer; id < 200; id += 4) {
+                    search_server.AddDocument(id, text(id), DocumentStatus::ACTUAL, { id });
+                }
+                });
+        }
+        for (thread& writer : writers) {
+            writer.join();
+        }
+        search_server.Checkpoint(snapshot_path);
+        for (int id = 200; id < 400; ++id) {
+            search_server.AddDocument(id, text(id), DocumentStatus::ACTUAL, { id });
+        }
+        for (int id = 0; id < 400; id += 5) {
+            search_server.RemoveDocument(id);
+        }
+        check(search_server);
+    }
+    {
+        // a record torn by a crash
+        ofstream log(log_path, ios::binary | ios::app);
+        log << "torn record"s;
+    }
+    {
+        SearchServer search_server;
+        search_server.SetMaxResultDocumentCount(1000);
+        search_server.LoadSnapshot(snapshot_path);
+        search_server.OpenWriteAheadLog(log_path, WriteAheadLog::SyncMode::PERIODIC, 1ms);
+        check(search_server);
+        search_server.AddDocument(1000, "fox 1000"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.Checkpoint(snapshot_path);
+        search_server.RemoveDocument(1000);
+    }
+    {
+        SearchServer search_server;
+        search_server.SetMaxResultDocumentCount(1000);
+        search_server.LoadSnapshot(snapshot_path);
+        ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount() + 1);
+        search_server.OpenWriteAheadLog(log_path, WriteAheadLog::SyncMode::NONE);
+        check(search_server);
+    }
+    filesystem::remove(snapshot_path);
+    filesystem::remove(log_path);
+}
+// Flat hash tables.
+// Random inserts and erases must leave the table with the contents of std::unordered_map,
+// string keys must be found by string_view.
+
+void TestFlatHashMap()
+{
+    FlatHashMap<uint32_t, int> table;
+    unordered_map<uint32_t, int> expected;
+    mt19937 generator(7);
+    uniform_int_distribution<uint32_t> key(0, 5000);
+    for (int i = 0; i < 100'000; ++i) {
+        const uint32_t k = key(generator);
+        if (i % 3 == 0) {
+            ASSERT_EQUAL(table.erase(k), expected.erase(k));
+        }
+        else {
+            table[k] += i;
+            expected[k] += i;
+        }
+    }
+    ASSERT_EQUAL(table.size(), expected.size());
+    size_t count = 0;
+    for (const auto& [k, value] : table) {
+        ASSERT_EQUAL(value, expected.at(k));
+        ++count;
+    }
+    ASSERT_EQUAL(count, expected.size());
+    for (uint32_t k = 0; k <= 5000; ++k) {
+        ASSERT_EQUAL(table.contains(k), expected.count(k) > 0);
+    }
+    FlatHashMap<uint32_t, int> copy = table;
+    table.clear();
+    ASSERT(table.empty() && table.find(1u) == table.end());
+    ASSERT_EQUAL(copy.size(), expected.size());
+
+    FlatHashSet<string> words = { "cat"s, "dog"s };
+    ASSERT(words.insert("cat"s).second == false);
+    ASSERT(words.contains("dog"sv));
+    ASSERT(!words.contains("parrot"sv));
+    ASSERT_EQUAL(words.erase("cat"sv), 1u);
+    ASSERT_EQUAL(words.size(), 1u);
+}
+// String pool.
+// Stored texts must keep their contents and addresses while the pool grows.
+
+void TestStringPool()
+{
+    StringPool pool;
+    vector<string> texts;
+    vector<string_view> stored;
+    for (int i = 0; i < 50'000; ++i) {
+        texts.push_back("word"s + to_string(i));
+        stored.push_back(pool.Store(texts.back()));
+    }
+    const string long_text(StringPool::CHUNK_SIZE * 2, 'x');
+    const string_view stored_long_text = pool.Store(long_text);
+    const string_view empty_text = pool.Store(""sv);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        ASSERT_EQUAL(stored[i], texts[i]);
+    }
+    ASSERT_EQUAL(stored_long_text, long_text);
+    ASSERT(empty_text.empty());
+    StringPool moved_pool = move(pool);
+    ASSERT_EQUAL(pool.Store("fresh"sv), "fresh"s);
+    ASSERT_EQUAL(moved_pool.Store("after move"sv), "after move"s);
+    ASSERT_EQUAL(stored.front(), texts.front());
+
+    TermDictionary terms;
+    const TermId cat = terms.Intern("cat"sv);
+    const string_view cat_text = terms.GetText(cat);
+    for (int i = 0; i < 10'000; ++i) {
+        terms.Intern("term"s + to_string(i));
+    }
+    ASSERT_EQUAL(terms.Intern("cat"s), cat);
+    ASSERT_HINT(terms.GetText(cat).data() == cat_text.data(), "Interned texts must not move"s);
+    TermDictionary moved_terms = move(terms);
+    ASSERT_EQUAL(moved_terms.Find("term9999"sv), cat + 10'000);
+    ASSERT(moved_terms.GetText(cat).data() == cat_text.data());
+    string_view dog_text;
+    {
+        TermDictionary copied_terms = moved_terms;
+        ASSERT(copied_terms.GetText(cat).data() == cat_text.data());
+        dog_text = copied_terms.GetText(copied_terms.Intern("dog"sv));
+    }
+    // the words interned by a copy outlive it in the shared pool
+    ASSERT_EQUAL(dog_text, "dog"sv);
+    ASSERT_EQUAL(moved_terms.Find("dog"sv), TermDictionary::INVALID_TERM_ID);
+}
+
+// Persistent vectors.
+// Copies must share the values but never see each other's changes and appends,
+// the id map of a copy must not find what the other one added or removed.
+
+void TestPersistentVector()
+{
+    PersistentVector<int> numbers;
+    for (int i = 0; i < 5000; ++i) {
+        numbers.PushBack(i);
+    }
+    PersistentVector<int> copy = numbers;
+    copy.Set(10, -1);
+    copy.PushBack(5000);
+    ASSERT_EQUAL(numbers[10], 10);
+    ASSERT_EQUAL(copy[10], -1);
+    // the copy appended last, the original appends to nodes of its own
+    numbers.PushBack(-5000);
+    ASSERT_EQUAL(copy[5000], 5000);
+    ASSERT_EQUAL(numbers[5000], -5000);
+    for (int i = 5001; i < 300'000; ++i) {
+        copy.PushBack(i);
+    }
+    ASSERT_EQUAL(copy.Size(), 300'000u);
+    ASSERT_EQUAL(copy[299'999], 299'999);
+    ASSERT_EQUAL(copy.GetLeaf(128)[5], 133);
+    ASSERT_EQUAL(numbers.Size(), 5001u);
+    long long sum = 0;
+    numbers.ForEach([&](size_t index, int value) {
+        ASSERT_EQUAL(numbers[index], value);
+        sum += value;
+        });
+    ASSERT_EQUAL(sum, 4999LL * 5000 / 2 - 5000);
+
+    DocumentIdMap ids;
+    for (int id = 0; id < 1000; ++id) {
+        ids.Add(id * 7);
+    }
+    DocumentIdMap copied_ids = ids;
+    copied_ids.Remove(7);
+    copied_ids.Add(100'000);
+    ASSERT_EQUAL(ids.Find(7), 1u);
+    ASSERT_EQUAL(copied_ids.Find(7), DocumentIdMap::INVALID_INTERNAL_ID);
+    ASSERT_EQUAL(ids.Find(100'000), DocumentIdMap::INVALID_INTERNAL_ID);
+    ASSERT_EQUAL(copied_ids.Find(100'000), 1000u);
+    ASSERT_EQUAL(ids.Add(14), DocumentIdMap::INVALID_INTERNAL_ID);
+    ASSERT_EQUAL(vector<int>(ids.begin(), ids.end()).size(), 1000u);
+    ASSERT(is_sorted(copied_ids.begin(), copied_ids.end()));
+    ASSERT_EQUAL(copied_ids.Size(), 1000u);
+}
+
+// Batch of documents.
+// AddDocuments must index like AddDocument one by one and add nothing when it throws.
+
+void TestAddDocuments()
+{
+    vector<string> texts;
+    vector<DocumentInput> documents;
+    for (int id = 0; id < 3000; ++id) {
+        texts.push_back("cat "s + to_string(id % 13) + (id % 5 == 0 ? " in city"s : " dog dog"s) + " w"s + to_string(id));
+    }
+    for (int id = 0; id < 3000; ++id) {
+        documents.push_back({ id, texts[id], id % 4 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id, 1 } });
+    }
+    SearchServer expected_server("in"s);
+    SearchServer server("in"s);
+    SearchServer par_server("in"s);
+    for (SearchServer* search_server : { &expected_server, &server, &par_server }) {
+        search_server->SetSegmentCapacity(256);
+        search_server->SetMaxResultDocumentCount(50);
+    }
+    for (const DocumentInput& document : documents) {
+        expected_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    server.AddDocuments(documents);
+    par_server.AddDocuments(execution::par, vector<DocumentInput>(documents.begin(), documents.begin() + 1000));
+    par_server.AddDocuments(execution::par, vector<DocumentInput>(documents.begin() + 1000, documents.end()));
+    for (const SearchServer* search_server : { &server, &par_server }) {
+        ASSERT_EQUAL(search_server->GetDocumentCount(), expected_server.GetDocumentCount());
+        ASSERT(search_server->GetWordFrequencies(25) == expected_server.GetWordFrequencies(25));
+        for (const string& query : { "cat"s, "dog -7"s, "+city 5 w10"s }) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto expected = expected_server.FindTopDocuments(query, status);
+                const auto found = search_server->FindTopDocuments(query, status);
+                ASSERT_EQUAL(found.size(), expected.size());
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    ASSERT_EQUAL(found[i].id, expected[i].id);
+                    ASSERT(abs(found[i].relevance - expected[i].relevance) < epsilon);
+                    ASSERT_EQUAL(found[i].rating, expected[i].rating);
+                }
+            }
+        }
+    }
+
+    const auto assert_rejected = [&](const vector<DocumentInput>& batch) {
+        try {
+            par_server.AddDocuments(execution::par, batch);
+            ASSERT_HINT(false, "AddDocuments must throw invalid_argument"s);
+        }
+        catch (const invalid_argument&) {
+        }
+        ASSERT_EQUAL(par_server.GetDocumentCount(), 3000u);
+        ASSERT(par_server.FindTopDocuments("fresh"s).empty());
+    };
+    assert_rejected({ { 5000, "fresh"sv, DocumentStatus::ACTUAL, {} }, { -1, "fresh"sv, DocumentStatus::ACTUAL, {} } });
+    assert_rejected({ { 5000, "fresh"sv, DocumentStatus::ACTUAL, {} }, { 7, "fresh"sv, DocumentStatus::ACTUAL, {} } });
+    assert_rejected({ { 5000, "fresh"sv, DocumentStatus::ACTUAL, {} }, { 5000, "fresh"sv, DocumentStatus::ACTUAL, {} } });
+    assert_rejected({ { 5000, "fresh"sv, DocumentStatus::ACTUAL, {} }, { 5001, "fresh \x12"sv, DocumentStatus::ACTUAL, {} } });
+}
+
+// Corpus ingest.
+// Every line of the file must be indexed as by AddDocument, whatever the block size.
+
+void TestCorpusIngest()
+{
+    const string path = (filesystem::temp_directory_path() / "search_server_test.corpus"s).string();
+    const auto write_file = [&](const string& contents) {
+        ofstream out(path, ios::binary);
+        out << contents;
+    };
+    SearchServer expected_server;
+    string tsv;
+    for (int id = 0; id < 500; ++id) {
+        const string text = "cat "s + to_string(id % 7) + (id % 3 == 0 ? " in a hat"s : " on mat"s) + (id == 42 ? string(300, 'z') : ""s);
+        const DocumentStatus status = id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        expected_server.AddDocument(id, text, status, { id, -id % 4 });
+        tsv += to_string(id) + (status == DocumentStatus::BANNED ? "\tBANNED\t"s : "\tACTUAL\t"s)
+            + to_string(id) + " "s + to_string(-id % 4) + "\t"s + text + (id % 10 == 0 ? "\r\n\n"s : "\n"s);
+    }
+    tsv += "500\tACTUAL\t\tlast line";
+    expected_server.AddDocument(500, "last line"s, DocumentStatus::ACTUAL, {});
+    write_file(tsv);
+    for (const size_t block_size : { 64u, 4096u, 1u << 22 }) {
+        SearchServer server;
+        IngestOptions options;
+        options.block_size = block_size;
+        options.queue_capacity = 1;
+        const IngestStats stats = IngestCorpus(server, path, options);
+        ASSERT_EQUAL(stats.document_count, 501u);
+        ASSERT_EQUAL(stats.byte_count, tsv.size());
+        ASSERT(equal(server.begin(), server.end(), expected_server.begin(), expected_server.end()));
+        for (const string& query : { "cat"s, "hat -3"s, "mat last"s }) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto expected = expected_server.FindTopDocuments(query, status);
+                const auto found = server.FindTopDocuments(query, status);
+                ASSERT_EQUAL(found.size(), expected.size());
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    ASSERT_EQUAL(found[i].id, expected[i].id);
+                    ASSERT_EQUAL(found[i].rating, expected[i].rating);
+                }
+            }
+        }
+    }
+
+    write_file("{\"id\": 7, \"title\": {\"a\": [1, \"]\"]}, \"text\": \"caf\\u00e9 \\\"big\\\" \\ud83d\\ude00\", \"ratings\": [3, 5]}\n"
+        "{\"status\":\"IRRELEVANT\",\"ratings\":[],\"id\":8,\"text\":\"plain text\",\"extra\":null}\n"s);
+    IngestOptions options;
+    options.format = CorpusFormat::JSONL;
+    SearchServer server;
+    ASSERT_EQUAL(IngestCorpus(server, path, options).document_count, 2u);
+    const map<string_view, double> word_frequencies = server.GetWordFrequencies(7);
+    ASSERT_EQUAL(word_frequencies.size(), 3u);
+    ASSERT_EQUAL(word_frequencies.count("caf\xC3\xA9"sv), 1u);
+    ASSERT_EQUAL(word_frequencies.count("\"big\""sv), 1u);
+    ASSERT_EQUAL(word_frequencies.count("\xF0\x9F\x98\x80"sv), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("caf\xC3\xA9"s).front().rating, 4);
+    ASSERT_EQUAL(server.FindTopDocuments("plain"s, DocumentStatus::IRRELEVANT).size(), 1u);
+
+    const auto assert_rejected = [&](const string& contents, CorpusFormat format, const string& message) {
+        write_file(contents);
+        SearchServer rejecting_server;
+        IngestOptions rejecting_options;
+        rejecting_options.format = format;
+        rejecting_options.block_size = 8;
+        try {
+            IngestCorpus(rejecting_server, path, rejecting_options);
+            ASSERT_HINT(false, "IngestCorpus must throw invalid_argument"s);
+        }
+        catch (const invalid_argument& e) {
+            ASSERT_HINT(string(e.what()).find(message) != string::npos, e.what());
+        }
+    };
+    assert_rejected("1\tACTUAL\t\tcat\n2\tACTUAL\tcat\n"s, CorpusFormat::TSV, "corpus line 2"s);
+    assert_rejected("1\tACTUAL\t\tcat\n1\tACTUAL\t\tdog\n"s, CorpusFormat::TSV, "duplicate id"s);
+    assert_rejected("1\tGOOD\t\tcat\n"s, CorpusFormat::TSV, "unknown document status"s);
+    assert_rejected("{\"id\": 1, \"text\": \"cat}\n"s, CorpusFormat::JSONL, "corpus line 1"s);
+    assert_rejected("{\"id\": 1}\n"s, CorpusFormat::JSONL, "must have an id and a text"s);
+    filesystem::remove(path);
+    try {
+        IngestCorpus(server, path);
+        ASSERT_HINT(false, "IngestCorpus must throw runtime_error"s);
+    }
+    catch (const runtime_error&) {
+    }
+}
+
+// Tokenizer.
+// The vectorized and the scalar tokenizer must split at every space like a find loop
+// and report the control characters wherever they are.
+
+void TestTokenizer()
+{
+    mt19937 generator(7);
+    const string alphabet = "ab  \xD0\x96\xFF\x7F"s;
+    for (int i = 0; i < 2000; ++i) {
+        string text(generator() % 100, ' ');
+        for (char& c : text) {
+            c = alphabet[generator() % alphabet.size()];
+        }
+        if (i % 4 == 0 && !text.empty()) {
+            text[generator() % text.size()] = static_cast<char>(generator() % 32);
+        }
+        vector<string_view> expected;
+        string_view rest = text;
+        for (size_t pos = 0; pos != rest.npos; rest.remove_prefix(pos + 1)) {
+            pos = rest.find(' ');
+            expected.push_back(rest.substr(0, pos));
+        }
+        const bool expected_valid = none_of(text.begin(), text.end(), [](char c) {
+            return c >= '\0' && c < ' ';
+            });
+        for (const bool vectorized : { false, true }) {
+            EnableVectorizedTokenizer(vectorized);
+            vector<string_view> words = { "kept"sv };
+            ASSERT_EQUAL(Tokenize(text, words), expected_valid);
+            ASSERT_EQUAL(words.size(), expected.size() + 1);
+            ASSERT(equal(words.begin() + 1, words.end(), expected.begin()));
+            ASSERT_EQUAL(HasNoControlChars(text), expected_valid);
+        }
+    }
+    EnableVectorizedTokenizer(true);
+
+    SearchServer search_server("in"s);
+    search_server.AddDocument(1, "cat in  the hat in a very long sentence of thirty two bytes"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(search_server.GetWordFrequencies(1).size(), 12u);
+    try {
+        search_server.AddDocument(2, "a long document with a control character after the first block\x01"sv, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "AddDocument must throw invalid_argument"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 1u);
+}
+
+// Query parsing.
+// Query terms live in small vectors: inline up to their capacity, on the heap past it.
+// Long queries with repeated words must find the same documents as short ones.
+
+void TestQueryParsing()
+{
+    SmallVector<int, 4> values;
+    for (int i = 0; i < 10; ++i) {
+        values.push_back(9 - i);
+        ASSERT_EQUAL(values.size(), static_cast<size_t>(i + 1));
+    }
+    sort(values.begin(), values.end());
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQUAL(values[i], i);
+    }
+    values.erase(values.begin() + 2, values.end());
+    SmallVector<int, 4> moved_values = move(values);
+    ASSERT(values.empty());
+    ASSERT_EQUAL(moved_values.size(), 2u);
+    ASSERT_EQUAL(moved_values[1], 1);
+    moved_values.erase(moved_values.begin(), moved_values.end());
+    moved_values.push_back(5);
+    ASSERT_EQUAL(moved_values.size(), 1u);
+    ASSERT_EQUAL(moved_values[0], 5);
+
+    SearchServer search_server("and"s);
+    string text;
+    for (int i = 0; i < 20; ++i) {
+        text += "w"s + to_string(i) + " "s;
+    }
+    search_server.AddDocument(1, text + "cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, text + "dog"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "cat and dog"s, DocumentStatus::ACTUAL, { 3 });
+    ASSERT_EQUAL(search_server.FindTopDocuments(text + text + "-dog"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments(text + text + "-dog"s).front().id, 1);
+    ASSERT_EQUAL(search_server.FindTopDocuments(execution::par, text + "+cat -w7 and"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat cat dog and"s).size(), 3u);
+    const auto [words, status] = search_server.MatchDocument(execution::par, text + "+w3 +w3 cat"s, 1);
+    ASSERT_EQUAL(words.size(), 21u);
+    for (const string& query : { "cat  dog"s, "--cat"s, "-+cat"s, "+-cat"s, "cat -"s, "ca\x02t"s, ""s }) {
+        try {
+            search_server.FindTopDocuments(query);
+            ASSERT_HINT(false, "FindTopDocuments must throw invalid_argument"s);
+        }
+        catch (const invalid_argument&) {
+        }
+    }
+}
+
+// Query cache.
+// Cached queries must follow the dictionary and contents changes, parse errors are cached too.
+
+void TestQueryCache()
+{
+    LruCache<int> cache(2);
+    cache.Insert("a"sv, 1);
+    cache.Insert("b"sv, 2);
+    ASSERT_EQUAL(*cache.Find("a"sv), 1);
+    cache.Insert("c"sv, 3);
+    ASSERT(cache.Find("b"sv) == nullptr);
+    cache.Insert("a"sv, 4);
+    ASSERT_EQUAL(*cache.Find("a"sv), 4);
+    cache.SetCapacity(1);
+    ASSERT_EQUAL(cache.Size(), 1u);
+    ASSERT(cache.Find("c"sv) == nullptr);
+
+    SearchServer search_server("and"s);
+    search_server.SetQueryCacheCapacity(16);
+    search_server.AddDocument(1, "cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat -owl"s).size(), 1u);
+    ASSERT(search_server.FindTopDocuments("owl"s).empty());
+    ASSERT(search_server.FindTopDocuments("+owl cat"s).empty());
+    search_server.AddDocument(2, "cat and owl"s, DocumentStatus::ACTUAL, { 2 });
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat -owl"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("owl"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("+owl cat"s).size(), 1u);
+    ASSERT_EQUAL(get<0>(search_server.MatchDocument("+owl cat"s, 2)).size(), 2u);
+    for (int i = 0; i < 3; ++i) {
+        try {
+            search_server.FindTopDocuments("cat --dog"s);
+            ASSERT_HINT(false, "FindTopDocuments must throw invalid_argument"s);
+        }
+        catch (const invalid_argument& e) {
+            ASSERT_EQUAL(string(e.what()), "Double minus in minus word"s);
+        }
+    }
+
+    const string path = (filesystem::temp_directory_path() / "search_server_query_cache.snapshot"s).string();
+    SearchServer saved_server;
+    saved_server.AddDocument(5, "bird"s, DocumentStatus::ACTUAL, { 5 });
+    saved_server.SaveSnapshot(path);
+    search_server.AddDocument(3, "zebra bird"s, DocumentStatus::ACTUAL, { 3 });
+    ASSERT_EQUAL(search_server.FindTopDocuments("bird"s).front().id, 3);
+    search_server.LoadSnapshot(path);
+    filesystem::remove(path);
+    ASSERT_EQUAL(search_server.FindTopDocuments("bird"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("bird"s).front().id, 5);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat and"s).size(), 0u);
+}
+
+// Result cache.
+// Cached results must be dropped by any change of the documents, and a scan of
+// one-off queries must not evict the frequent ones.
+
+void TestResultCache()
+{
+    SearchServer search_server("and"s);
+    search_server.SetResultCacheCapacity(1000);
+    search_server.AddDocument(1, "cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat"s, DocumentStatus::BANNED, { 2 });
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).front().id, 1);
+    ASSERT_EQUAL(search_server.FindTopDocuments(execution::par, "cat"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED).front().id, 2);
+    ResultCache::Stats stats = search_server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.hits, 2u);
+    ASSERT_EQUAL(stats.misses, 2u);
+    search_server.AddDocument(3, "cat cat"s, DocumentStatus::ACTUAL, { 3 });
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 2u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).front().id, 3);
+    search_server.RemoveDocument(3);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 1u);
+    search_server.SetMaxResultDocumentCount(0);
+    ASSERT(search_server.FindTopDocuments("cat"s).empty());
+    search_server.SetMaxResultDocumentCount(MAX_RESULT_DOCUMENT_COUNT);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s, [](int, DocumentStatus, int) { return true; }).size(), 2u);
+    stats = search_server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.hits, 3u);
+    ASSERT_EQUAL(stats.misses, 5u);
+    // the key is the parsed query: word order, repeated, stop and unknown words share an entry
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat dog"s).front().id, 1);
+    ASSERT_EQUAL(search_server.FindTopDocuments("dog cat"s).front().id, 1);
+    ASSERT_EQUAL(search_server.FindTopDocuments("dog and cat dog owl"s).front().id, 1);
+    ASSERT(search_server.FindTopDocuments("cat -dog"s).empty());
+    stats = search_server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.hits, 5u);
+    ASSERT_EQUAL(stats.misses, 7u);
+
+    // readers hitting the cache while a writer changes the documents
+    vector<thread> readers;
+    atomic_bool writing = true;
+    for (int reader = 0; reader < 4; ++reader) {
+        readers.emplace_back([&]() {
+            while (writing) {
+                const auto found = search_server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL);
+                ASSERT(!found.empty() && found.size() <= MAX_RESULT_DOCUMENT_COUNT);
+            }
+            });
+    }
+    for (int id = 10; id < 200; ++id) {
+        search_server.AddDocument(id, "cat "s + to_string(id), DocumentStatus::ACTUAL, { id });
+    }
+    writing = false;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    ResultCache cache(100, 1);
+    vector<string> hot_queries;
+    for (int i = 0; i < 50; ++i) {
+        hot_queries.push_back("hot "s + to_string(i));
+    }
+    const auto find = [&](const string& query) {
+        const ResultCache::Key key{ query, DocumentStatus::ACTUAL, 5 };
+        if (cache.Find(key, 1)) {
+            return true;
+        }
+        cache.Insert(key, 1, { Document(1, 0.5, 1) });
+        return false;
+    };
+    for (int repeat = 0; repeat < 4; ++repeat) {
+        for (const string& query : hot_queries) {
+            find(query);
+        }
+    }
+    for (int i = 0; i < 1000; ++i) {
+        find("scan "s + to_string(i));
+    }
+    const int hot_hits = static_cast<int>(count_if(hot_queries.begin(), hot_queries.end(), find));
+    ASSERT_HINT(hot_hits >= 45, "frequent queries must survive a scan"s);
+    ASSERT(!cache.Find({ hot_queries.front(), DocumentStatus::ACTUAL, 5 }, 2));
+    ASSERT(!cache.Find({ hot_queries.front(), DocumentStatus::ACTUAL, 5 }, 1));
+}
+
+void TestConcurrentReadsAndWrites()
+{
+    // a reader keeps its version while the writer publishes new ones without waiting for it
+    Versioned<vector<int>> numbers;
+    numbers.Write([](vector<int>& version) {
+        version.push_back(1);
+        });
+    {
+        const auto pinned = numbers.Read();
+        numbers.Write([](vector<int>& version) {
+            version.push_back(2);
+            });
+        numbers.Write([](vector<int>& version) {
+            version.push_back(3);
+            });
+        ASSERT_EQUAL(*pinned, vector<int>{ 1 });
+        ASSERT_EQUAL(*numbers.Read(), (vector<int>{ 1, 2, 3 }));
+    }
+    // a change that throws publishes nothing
+    try {
+        numbers.Write([](vector<int>& version) {
+            version.push_back(4);
+            throw runtime_error("failed change"s);
+            });
+    }
+    catch (const runtime_error&) {
+    }
+    ASSERT_EQUAL(*numbers.Read(), (vector<int>{ 1, 2, 3 }));
+    numbers.Reset({ 5 });
+    ASSERT_EQUAL(*numbers.Read(), vector<int>{ 5 });
+    // an old version lives while it is pinned, the next write after that frees it
+    Versioned<shared_ptr<int>> counted(make_shared<int>(1));
+    const weak_ptr<int> first = counted.GetPublished();
+    {
+        const auto pinned = counted.Read();
+        for (int i = 2; i < 5; ++i) {
+            counted.Reset(make_shared<int>(i));
+        }
+        ASSERT(!first.expired());
+        ASSERT_EQUAL(**pinned, 1);
+    }
+    counted.Reset(make_shared<int>(5));
+    ASSERT(first.expired());
+
+    // queries run while documents are added, removed, merged and the contents replaced
+    SearchServer search_server("and"s);
+    search_server.SetSegmentCapacity(16);
+    search_server.SetQueryCacheCapacity(16);
+    for (int id = 0; id < 100; ++id) {
+        search_server.AddDocument(id, "stable word"s + to_string(id), DocumentStatus::ACTUAL, { id });
+    }
+    const string path = (filesystem::temp_directory_path() / "search_server_test_concurrent.snapshot"s).string();
+    search_server.SaveSnapshot(path);
+    atomic<bool> writing = true;
+    atomic<int> query_count = 0;
+    vector<thread> readers;
+    for (int reader = 0; reader < 4; ++reader) {
+        readers.emplace_back([&, reader]() {
+            for (int i = 0; writing || i < 100; ++i) {
+                const auto stable = search_server.FindTopDocuments("stable -churn"s);
+                ASSERT_EQUAL(stable.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+                ASSERT(all_of(stable.begin(), stable.end(), [](const Document& document) {
+                    return document.id < 100;
+                    }));
+                for (const Document& document : search_server.FindTopDocuments(execution::par, "churn"s)) {
+                    ASSERT(document.id >= 1000);
+                }
+                const auto [words, status] = search_server.MatchDocument("stable and -churn"s, (reader + i) % 100);
+                ASSERT_EQUAL(words, vector<string_view>{ "stable"sv });
+                ASSERT_EQUAL(search_server.GetWordFrequencies((reader + i) % 100).size(), 2u);
+                ++query_count;
+            }
+            });
+    }
+    SearchServer expected("and"s);
+    const auto change = [&](SearchServer& server) {
+        for (int id = 1000; id < 1400; ++id) {
+            server.AddDocument(id, "churn word"s + to_string(id % 7), DocumentStatus::ACTUAL, { id % 10 });
+            if (id % 3 == 0) {
+                server.RemoveDocument(id - 1);
+            }
+        }
+        vector<DocumentInput> batch;
+        for (int id = 2000; id < 2100; ++id) {
+            batch.push_back({ id, "churn batch"sv, DocumentStatus::ACTUAL, { 1 } });
+        }
+        server.AddDocuments(execution::par, batch);
+    };
+    change(search_server);
+    search_server.LoadSnapshot(path);
+    change(search_server);
+    writing = false;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    filesystem::remove(path);
+    ASSERT(query_count >= 400);
+    search_server.WaitForMerges();
+
+    for (int id = 0; id < 100; ++id) {
+        expected.AddDocument(id, "stable word"s + to_string(id), DocumentStatus::ACTUAL, { id });
+    }
+    change(expected);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), expected.GetDocumentCount());
+    for (const string& query : { "churn"s, "word3 batch"s, "stable word42"s }) {
+        const auto found = search_server.FindTopDocuments(query);
+        const auto expected_found = expected.FindTopDocuments(query);
+        ASSERT_EQUAL(found.size(), expected_found.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected_found[i].id);
+            ASSERT(abs(found[i].relevance - expected_found[i].relevance) < 1e-6);
+        }
+    }
+
+    // a query cached on the newer copy is asked on the older one, which lacks its words
+    SearchServer growing("and"s);
+    growing.SetQueryCacheCapacity(64);
+    atomic<int> last_id = -1;
+    writing = true;
+    readers.clear();
+    for (int reader = 0; reader < 4; ++reader) {
+        readers.emplace_back([&]() {
+            while (writing) {
+                const int id = last_id;
+                if (id < 0) {
+                    continue;
+                }
+                const string query = "fresh"s + to_string(id);
+                const auto [words, status] = growing.MatchDocument(query, id);
+                ASSERT_EQUAL(words, vector<string_view>{ string_view(query) });
+                // the next document may be in one copy only
+                const string next_query = "fresh"s + to_string(id + 1);
+                for (const Document& document : growing.FindTopDocuments(next_query)) {
+                    ASSERT_EQUAL(document.id, id + 1);
+                }
+            }
+            });
+    }
+    for (int id = 0; id < 2000; ++id) {
+        growing.AddDocument(id, "fresh"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+        last_id = id;
+    }
+    writing = false;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+}
 
 void TestSearchServer() 
 {
@@ -250,4 +1703,31 @@ void TestSearchServer()
     RUN_TEST(TestPredicate);
     RUN_TEST(TestRating);
     RUN_TEST(TestRelevance);
+    RUN_TEST(TestRemoveDocument);
+    RUN_TEST(TestQueryTerms);
+    RUN_TEST(TestPostingList);
+    RUN_TEST(TestIdfTolerance);
+    RUN_TEST(TestDocumentIdCompaction);
+    RUN_TEST(TestDocumentFilter);
+    RUN_TEST(TestMaxScorePruning);
+    RUN_TEST(TestResultDocumentCount);
+    RUN_TEST(TestBitmap);
+    RUN_TEST(TestStatusDocuments);
+    RUN_TEST(TestRequiredWords);
+    RUN_TEST(TestSegments);
+    RUN_TEST(TestDeletedDocuments);
+    RUN_TEST(TestIdCompaction);
+    RUN_TEST(TestIndexFile);
+    RUN_TEST(TestSnapshot);
+    RUN_TEST(TestWriteAheadLog);
+    RUN_TEST(TestFlatHashMap);
+    RUN_TEST(TestStringPool);
+    RUN_TEST(TestPersistentVector);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestCorpusIngest);
+    RUN_TEST(TestTokenizer);
+    RUN_TEST(TestQueryParsing);
+    RUN_TEST(TestQueryCache);
+    RUN_TEST(TestResultCache);
+    RUN_TEST(TestConcurrentReadsAndWrites);
 }
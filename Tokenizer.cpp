@@ -0,0 +1,132 @@
+#include "Tokenizer.h"
+#include "Cpu_features.h"
+#if defined(SEARCH_SERVER_X86)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static atomic<bool> vectorized_tokenizer{ true };
+
+void EnableVectorizedTokenizer(bool enable)
+{
+    vectorized_tokenizer = enable;
+}
+
+static bool IsControlChar(char c)
+{
+    return static_cast<unsigned char>(c) < ' ';
+}
+
+static int CountTrailingZeros(uint32_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+// Emits the words ended by the spaces of a block, bit i of spaces stands for text[offset + i]
+static void EmitWords(const char* text, size_t offset, uint32_t spaces, size_t& word_start, vector<string_view>& words)
+{
+    while (spaces != 0) {
+        const size_t space = offset + CountTrailingZeros(spaces);
+        words.emplace_back(text + word_start, space - word_start);
+        word_start = space + 1;
+        spaces &= spaces - 1;
+    }
+}
+
+// The kernels go from offset over whole blocks and return where they stopped,
+// valid is cleared when a block has a control character
+
+static void TokenizeScalar(const char* text, size_t offset, size_t size, size_t& word_start, vector<string_view>& words, bool& valid)
+{
+    bool has_controls = false;
+    for (; offset < size; ++offset) {
+        if (text[offset] == ' ') {
+            words.emplace_back(text + word_start, offset - word_start);
+            word_start = offset + 1;
+        }
+        has_controls |= IsControlChar(text[offset]);
+    }
+    valid = valid && !has_controls;
+}
+
+#if defined(SEARCH_SERVER_SSE2)
+static size_t TokenizeSse2(const char* text, size_t offset, size_t size, size_t& word_start, vector<string_view>& words, bool& valid)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    __m128i controls = _mm_setzero_si128();
+    for (; offset + 16 <= size; offset += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + offset));
+        // unsigned bytes up to ' ' - 1 are equal to their minimum with it
+        controls = _mm_or_si128(controls, _mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control), bytes));
+        EmitWords(text, offset, static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, space))), word_start, words);
+    }
+    valid = valid && _mm_movemask_epi8(controls) == 0;
+    return offset;
+}
+#endif
+
+#if defined(SEARCH_SERVER_X86)
+SEARCH_SERVER_TARGET("avx2")
+static size_t TokenizeAvx2(const char* text, size_t offset, size_t size, size_t& word_start, vector<string_view>& words, bool& valid)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    __m256i controls = _mm256_setzero_si256();
+    for (; offset + 32 <= size; offset += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + offset));
+        controls = _mm256_or_si256(controls, _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, last_control), bytes));
+        EmitWords(text, offset, static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, space))), word_start, words);
+    }
+    valid = valid && _mm256_testz_si256(controls, controls);
+    return offset;
+}
+#endif
+
+bool Tokenize(string_view text, vector<string_view>& words)
+{
+    const char* data = text.data();
+    const size_t size = text.size();
+    size_t offset = 0;
+    size_t word_start = 0;
+    bool valid = true;
+    if (vectorized_tokenizer.load(memory_order_relaxed)) {
+#if defined(SEARCH_SERVER_X86)
+        if (GetCpuFeatures().avx2) {
+            offset = TokenizeAvx2(data, offset, size, word_start, words, valid);
+        }
+#endif
+#if defined(SEARCH_SERVER_SSE2)
+        // also takes the last 16 bytes the AVX2 kernel leaves
+        offset = TokenizeSse2(data, offset, size, word_start, words, valid);
+#endif
+    }
+    TokenizeScalar(data, offset, size, word_start, words, valid);
+    words.emplace_back(data + word_start, size - word_start);
+    return valid;
+}
+
+bool HasNoControlChars(string_view text)
+{
+    size_t offset = 0;
+#if defined(SEARCH_SERVER_SSE2)
+    if (vectorized_tokenizer.load(memory_order_relaxed)) {
+        const __m128i last_control = _mm_set1_epi8(' ' - 1);
+        for (; offset + 16 <= text.size(); offset += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + offset));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control), bytes)) != 0) {
+                return false;
+            }
+        }
+    }
+#endif
+    return none_of(text.begin() + offset, text.end(), IsControlChar);
+}
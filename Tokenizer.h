@@ -0,0 +1,17 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// Splits text at every space: adjacent spaces give an empty word and so does
+// an empty text. The words are appended to words, so a caller can reuse the
+// buffer. Returns false when the text has a control character (below ' '),
+// which no valid word may contain; the words are split all the same.
+// 32 or 16 bytes are classified at once when the CPU allows it.
+bool Tokenize(string_view text, vector<string_view>& words);
+
+// True when text has no control character
+bool HasNoControlChars(string_view text);
+
+// Switches between the vectorized and the scalar tokenizer,
+// the vectorized one is used by default when the CPU supports it
+void EnableVectorizedTokenizer(bool enable);
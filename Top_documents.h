@@ -0,0 +1,60 @@
+#pragma once
+#include "Document.h"
+using namespace std;
+
+// Bounded heap of the most relevant documents, selecting k of n documents
+// costs O(n log k) instead of sorting all of them
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t capacity)
+        : capacity_(capacity)
+    {
+    }
+
+    size_t GetCapacity() const
+    {
+        return capacity_;
+    }
+
+    bool IsFull() const
+    {
+        return documents_.size() >= capacity_;
+    }
+
+    // Relevance of the least relevant kept document
+    double GetThreshold() const
+    {
+        return documents_.front().relevance;
+    }
+
+    void Add(const Document& document)
+    {
+        if (documents_.size() < capacity_) {
+            documents_.push_back(document);
+            push_heap(documents_.begin(), documents_.end(), IsMoreRelevant);
+        }
+        else if (capacity_ > 0 && IsMoreRelevant(document, documents_.front())) {
+            pop_heap(documents_.begin(), documents_.end(), IsMoreRelevant);
+            documents_.back() = document;
+            push_heap(documents_.begin(), documents_.end(), IsMoreRelevant);
+        }
+    }
+
+    void Merge(const TopDocuments& other)
+    {
+        for (const Document& document : other.documents_) {
+            Add(document);
+        }
+    }
+
+    // Returns the documents from the most relevant one
+    vector<Document> Extract()
+    {
+        sort_heap(documents_.begin(), documents_.end(), IsMoreRelevant);
+        return move(documents_);
+    }
+
+private:
+    size_t capacity_;
+    vector<Document> documents_;
+};
@@ -0,0 +1,170 @@
+#pragma once
+#include "headers.h"
+using namespace std;
+
+// Versions of T published to readers through an atomic pointer. Readers pin the
+// published version without locking or waiting; a writer applies its change once to
+// a copy of the published version and swaps the pointer, it never waits for readers
+// either. T should share what the change doesn't touch, so copying it is cheap.
+// Old versions are freed by epoch reclamation: a version unpublished in epoch e is
+// freed by a later write once the epoch reached e + 2, which only happens when no
+// reader that started in epoch e or before is left. Readers count themselves in the
+// counter of their epoch in one of the slots, every thread arrives at its own slot,
+// so readers don't share a cache line. One writer at a time: the owner serializes them.
+template <typename T>
+class Versioned {
+public:
+    // Pins the version it was created with until destroyed
+    class ReadGuard {
+    public:
+        ReadGuard(const T& version, atomic<uint64_t>& readers)
+            : version_(&version)
+            , readers_(&readers)
+        {
+        }
+
+        ReadGuard(ReadGuard&& other) noexcept
+            : version_(other.version_)
+            , readers_(exchange(other.readers_, nullptr))
+        {
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ReadGuard& operator=(ReadGuard&&) = delete;
+
+        ~ReadGuard()
+        {
+            if (readers_ != nullptr) {
+                readers_->fetch_sub(1, memory_order_release);
+            }
+        }
+
+        const T& operator*() const
+        {
+            return *version_;
+        }
+
+        const T* operator->() const
+        {
+            return version_;
+        }
+
+    private:
+        const T* version_;
+        atomic<uint64_t>* readers_;
+    };
+
+    template <typename... Args>
+    explicit Versioned(const Args&... args)
+        : published_(new T(args...))
+    {
+    }
+
+    Versioned(const Versioned&) = delete;
+    Versioned& operator=(const Versioned&) = delete;
+
+    ~Versioned()
+    {
+        delete published_.load();
+        for (const Retired& retired : retired_) {
+            delete retired.version;
+        }
+    }
+
+    ReadGuard Read() const
+    {
+        Slot& slot = slots_[GetSlot()];
+        for (;;) {
+            const uint64_t epoch = epoch_.load();
+            atomic<uint64_t>& readers = slot.readers[epoch % EPOCH_COUNT];
+            readers.fetch_add(1);
+            // a writer that moved the epoch on before the increment may free what this reader loads
+            if (epoch_.load() == epoch) {
+                return ReadGuard(*published_.load(), readers);
+            }
+            readers.fetch_sub(1, memory_order_release);
+        }
+    }
+
+    // The published version without pinning it: for the writer, which alone
+    // replaces versions, or while no write can run
+    const T& GetPublished() const
+    {
+        return *published_.load();
+    }
+
+    // Calls change on a copy of the published version and publishes it. When change
+    // throws the published version stays as it was.
+    template <typename Change>
+    void Write(Change change)
+    {
+        auto version = make_unique<T>(*published_.load());
+        change(*version);
+        Publish(move(version));
+    }
+
+    // Publishes value in place of the current version
+    void Reset(T value)
+    {
+        Publish(make_unique<T>(move(value)));
+    }
+
+private:
+    // a counter per reader epoch: the current one, the one before it and the next one
+    inline static constexpr size_t EPOCH_COUNT = 3;
+    inline static constexpr size_t SLOT_COUNT = 64;
+    struct alignas(64) Slot {
+        array<atomic<uint64_t>, EPOCH_COUNT> readers{};
+    };
+
+    struct Retired {
+        T* version;
+        // the epoch it was unpublished in
+        uint64_t epoch;
+    };
+
+    atomic<T*> published_;
+    atomic<uint64_t> epoch_{ 0 };
+    mutable array<Slot, SLOT_COUNT> slots_;
+    vector<Retired> retired_;
+    inline static atomic<size_t> next_slot_{ 0 };
+
+    static size_t GetSlot()
+    {
+        thread_local const size_t slot = next_slot_.fetch_add(1, memory_order_relaxed) % SLOT_COUNT;
+        return slot;
+    }
+
+    void Publish(unique_ptr<T> version)
+    {
+        T* old = published_.exchange(version.release());
+        retired_.push_back({ old, epoch_.load() });
+        // the epoch moves on at most twice, then the versions retired two epochs ago are freed
+        if (TryAdvanceEpoch()) {
+            TryAdvanceEpoch();
+        }
+        const uint64_t epoch = epoch_.load();
+        const auto freed = partition(retired_.begin(), retired_.end(), [&](const Retired& retired) {
+            return retired.epoch + 2 > epoch;
+            });
+        for (auto it = freed; it != retired_.end(); ++it) {
+            delete it->version;
+        }
+        retired_.erase(freed, retired_.end());
+    }
+
+    // Moves from epoch e to e + 1 unless a reader of epoch e - 1 is left
+    bool TryAdvanceEpoch()
+    {
+        const uint64_t epoch = epoch_.load();
+        const size_t previous = (epoch + EPOCH_COUNT - 1) % EPOCH_COUNT;
+        for (const Slot& slot : slots_) {
+            if (slot.readers[previous].load() != 0) {
+                return false;
+            }
+        }
+        epoch_.store(epoch + 1);
+        return true;
+    }
+};
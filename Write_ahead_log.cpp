@@ -0,0 +1,251 @@
+#include "Write_ahead_log.h"
+#include <cerrno>
+#include <filesystem>
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(_WIN32)
+int OpenFile(const string& path, bool truncate)
+{
+    return _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0), _S_IREAD | _S_IWRITE);
+}
+
+bool WriteFile(int file, const uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        const int written = _write(file, data, static_cast<unsigned int>(min<size_t>(size, 1 << 30)));
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool SyncFile(int file)
+{
+    return _commit(file) == 0;
+}
+
+bool ResizeFile(int file, size_t size)
+{
+    return _chsize_s(file, static_cast<long long>(size)) == 0 && _lseeki64(file, 0, SEEK_END) >= 0;
+}
+
+void CloseFile(int file)
+{
+    _close(file);
+}
+#else
+int OpenFile(const string& path, bool truncate)
+{
+    return open(path.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+}
+
+bool WriteFile(int file, const uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t written = write(file, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool SyncFile(int file)
+{
+#if defined(__APPLE__)
+    return fsync(file) == 0;
+#else
+    return fdatasync(file) == 0;
+#endif
+}
+
+bool ResizeFile(int file, size_t size)
+{
+    return ftruncate(file, static_cast<off_t>(size)) == 0 && lseek(file, 0, SEEK_END) >= 0;
+}
+
+void CloseFile(int file)
+{
+    close(file);
+}
+#endif
+
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    {
+        unique_lock<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    if (sync_thread_.joinable()) {
+        sync_thread_.join();
+    }
+    unique_lock<mutex> lock(mutex_);
+    try {
+        Flush(lock, sync_mode_ != SyncMode::NONE);
+    }
+    catch (const runtime_error&) {
+        // nothing to report the error to
+    }
+    CloseFile(file_);
+}
+
+uint64_t WriteAheadLog::Append(RecordType type, const index_file::SectionWriter& payload)
+{
+    lock_guard<mutex> guard(mutex_);
+    if (error_) {
+        rethrow_exception(error_);
+    }
+    const vector<uint8_t>& data = payload.GetData();
+    RecordHeader header = { 0, ++last_lsn_, type, static_cast<uint32_t>(data.size()) };
+    const size_t position = buffer_.size();
+    buffer_.resize(position + sizeof(header) + data.size());
+    memcpy(buffer_.data() + position, &header, sizeof(header));
+    memcpy(buffer_.data() + position + sizeof(header), data.data(), data.size());
+    header.checksum = index_file::ComputeChecksum(buffer_.data() + position + sizeof(header.checksum), sizeof(header) - sizeof(header.checksum) + data.size());
+    memcpy(buffer_.data() + position, &header.checksum, sizeof(header.checksum));
+    return last_lsn_;
+}
+
+void WriteAheadLog::Sync(uint64_t lsn)
+{
+    if (sync_mode_ == SyncMode::PERIODIC) {
+        return;
+    }
+    unique_lock<mutex> lock(mutex_);
+    // the first waiting thread writes the records of all the others
+    while (durable_lsn_ < lsn && !error_) {
+        if (writing_) {
+            condition_.wait(lock);
+        }
+        else {
+            Flush(lock, sync_mode_ == SyncMode::EVERY_COMMIT);
+        }
+    }
+    if (error_) {
+        rethrow_exception(error_);
+    }
+}
+
+void WriteAheadLog::DropThrough(uint64_t lsn)
+{
+    unique_lock<mutex> lock(mutex_);
+    Flush(lock, sync_mode_ != SyncMode::NONE);
+    // Flush has waited for other writers, the mutex keeps new ones out
+    CloseFile(file_);
+    file_ = -1;
+    const vector<uint8_t> contents = ReadFile();
+    size_t position = 0;
+    while (contents.size() - position >= sizeof(RecordHeader)) {
+        RecordHeader header;
+        memcpy(&header, contents.data() + position, sizeof(header));
+        if (header.lsn > lsn) {
+            break;
+        }
+        position += sizeof(header) + header.size;
+    }
+    const string temporary_path = path_ + ".tmp"s;
+    const int file = OpenFile(temporary_path, true);
+    if (file < 0 || !WriteFile(file, contents.data() + position, contents.size() - position) || !SyncFile(file)) {
+        if (file >= 0) {
+            CloseFile(file);
+        }
+        Open(contents.size());
+        throw runtime_error("can't write "s + temporary_path);
+    }
+    CloseFile(file);
+    error_code error;
+    filesystem::rename(temporary_path, path_, error);
+    Open(error ? contents.size() : contents.size() - position);
+    if (error) {
+        throw runtime_error("can't replace "s + path_ + ": "s + error.message());
+    }
+}
+
+vector<uint8_t> WriteAheadLog::ReadFile() const
+{
+    error_code error;
+    if (!filesystem::exists(path_, error)) {
+        return {};
+    }
+    ifstream input(path_, ios::binary);
+    if (!input) {
+        throw runtime_error("can't read "s + path_);
+    }
+    return vector<uint8_t>(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+}
+
+void WriteAheadLog::Open(size_t valid_size)
+{
+    file_ = OpenFile(path_, false);
+    if (file_ < 0) {
+        throw runtime_error("can't open "s + path_);
+    }
+    if (!ResizeFile(file_, valid_size)) {
+        CloseFile(file_);
+        throw runtime_error("can't truncate "s + path_);
+    }
+}
+
+void WriteAheadLog::Flush(unique_lock<mutex>& lock, bool sync)
+{
+    condition_.wait(lock, [&]() {
+        return !writing_;
+        });
+    if (buffer_.empty() || error_) {
+        return;
+    }
+    vector<uint8_t> buffer;
+    buffer.swap(buffer_);
+    const uint64_t lsn = last_lsn_;
+    writing_ = true;
+    lock.unlock();
+    const bool written = WriteFile(file_, buffer.data(), buffer.size()) && (!sync || SyncFile(file_));
+    lock.lock();
+    writing_ = false;
+    if (written) {
+        durable_lsn_ = lsn;
+    }
+    else {
+        error_ = make_exception_ptr(runtime_error("can't write "s + path_));
+    }
+    condition_.notify_all();
+    if (error_) {
+        rethrow_exception(error_);
+    }
+}
+
+void WriteAheadLog::SyncPeriodically()
+{
+    unique_lock<mutex> lock(mutex_);
+    while (!stopping_) {
+        condition_.wait_for(lock, sync_interval_, [&]() {
+            return stopping_;
+            });
+        try {
+            Flush(lock, true);
+        }
+        catch (const runtime_error&) {
+            // error_ is reported to the next Append
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "headers.h"
+#include "Index_file.h"
+#include <cstring>
+using namespace std;
+
+// Append-only log of the changes of a server. Every record gets the next log
+// sequence number (lsn) and a checksum; a record torn by a crash ends the log.
+// Appending only buffers the record, Sync makes it durable according to the mode:
+// concurrent callers waiting for their records share one write and one fsync.
+class WriteAheadLog {
+public:
+    enum class SyncMode {
+        // Sync returns once the record is written and fsynced
+        EVERY_COMMIT,
+        // a background thread writes and fsyncs every sync interval,
+        // a crash loses at most the last interval of changes
+        PERIODIC,
+        // Sync returns once the record is written, fsync is left to the system
+        NONE
+    };
+
+    enum class RecordType : uint32_t {
+        ADD_DOCUMENT = 1,
+        REMOVE_DOCUMENT
+    };
+
+    // Opens or creates the log and cuts off a torn tail. Calls replay(lsn, type, payload)
+    // for every record with an lsn above after_lsn, new records continue after the last one.
+    // Throws runtime_error when the file can't be opened.
+    template <typename ReplayFunc>
+    WriteAheadLog(const string& path, SyncMode sync_mode, chrono::milliseconds sync_interval, uint64_t after_lsn, ReplayFunc replay)
+        : path_(path)
+        , sync_mode_(sync_mode)
+        , sync_interval_(sync_interval)
+    {
+        if (sync_mode_ == SyncMode::PERIODIC && sync_interval_.count() <= 0) {
+            throw invalid_argument("sync interval must be positive"s);
+        }
+        const size_t valid_size = ForEachRecord([&](uint64_t lsn, RecordType type, index_file::SectionReader payload) {
+            if (lsn > after_lsn) {
+                replay(lsn, type, payload);
+            }
+            });
+        Open(valid_size);
+        last_lsn_ = max(last_lsn_, after_lsn);
+        durable_lsn_ = last_lsn_;
+        if (sync_mode_ == SyncMode::PERIODIC) {
+            sync_thread_ = thread([this]() {
+                SyncPeriodically();
+                });
+        }
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    // Writes and fsyncs the buffered records
+    ~WriteAheadLog();
+
+    // Buffers the record, returns its lsn
+    uint64_t Append(RecordType type, const index_file::SectionWriter& payload);
+    // Waits until the record is as durable as the mode promises,
+    // throws runtime_error when the log can't be written
+    void Sync(uint64_t lsn);
+    // Drops the records up to lsn, a snapshot holds their changes
+    void DropThrough(uint64_t lsn);
+
+    uint64_t GetLastLsn() const
+    {
+        lock_guard<mutex> guard(mutex_);
+        return last_lsn_;
+    }
+
+private:
+    struct RecordHeader {
+        // of the rest of the header and the payload
+        uint64_t checksum;
+        uint64_t lsn;
+        RecordType type;
+        uint32_t size;
+    };
+
+    string path_;
+    SyncMode sync_mode_;
+    chrono::milliseconds sync_interval_;
+    int file_ = -1;
+    mutable mutex mutex_;
+    condition_variable condition_;
+    // records appended but not written yet
+    vector<uint8_t> buffer_;
+    uint64_t last_lsn_ = 0;
+    uint64_t durable_lsn_ = 0;
+    // a thread writes the buffer without holding the mutex
+    bool writing_ = false;
+    bool stopping_ = false;
+    exception_ptr error_;
+    thread sync_thread_;
+
+    // Calls func for every intact record, returns the size of the intact records
+    template <typename Func>
+    size_t ForEachRecord(Func func)
+    {
+        const vector<uint8_t> contents = ReadFile();
+        size_t position = 0;
+        while (contents.size() - position >= sizeof(RecordHeader)) {
+            RecordHeader header;
+            memcpy(&header, contents.data() + position, sizeof(header));
+            const size_t record_size = sizeof(header) + header.size;
+            if (header.size % 8 != 0 || header.size > contents.size() - position - sizeof(header)
+                || index_file::ComputeChecksum(contents.data() + position + sizeof(header.checksum), record_size - sizeof(header.checksum)) != header.checksum) {
+                break;
+            }
+            func(header.lsn, header.type, index_file::SectionReader(contents.data() + position + sizeof(header), header.size, 0));
+            last_lsn_ = header.lsn;
+            position += record_size;
+        }
+        return position;
+    }
+
+    vector<uint8_t> ReadFile() const;
+    void Open(size_t valid_size);
+    // Writes the buffer, fsyncs when sync is set, the lock is released meanwhile
+    void Flush(unique_lock<mutex>& lock, bool sync);
+    void SyncPeriodically();
+};
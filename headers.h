@@ -1,9 +1,14 @@
 #pragma once
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <utility>
 #include <numeric>
 #include <map>
+#include <unordered_map>
+#include <deque>
 #include <set>
 #include <string>
 #include <vector>
@@ -13,4 +18,8 @@
 #include <execution>
 #include <iterator>
 #include <ctime>
-#include <mutex>
\ No newline at end of file
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <functional>
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <vector>
 #include "Tests.h"
 #include "Remove_dublicates.h"
+#include "Benchmarks.h"
+#include "Corpus_ingest.h"
 using namespace std;
 
 
@@ -79,7 +81,35 @@ void gen_random(string& s, const int len) {
     s[len] = 0;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "--benchmark"s) {
+        BenchmarkPostings();
+        BenchmarkSnapshot();
+        BenchmarkWriteAheadLog();
+        BenchmarkAddDocuments();
+        BenchmarkTokenizer();
+        BenchmarkQueryCache();
+        BenchmarkResultCache();
+        BenchmarkConcurrentQueries();
+        return 0;
+    }
+    // --ingest <corpus file> [tsv|jsonl]
+    if (argc > 2 && argv[1] == "--ingest"s) {
+        IngestOptions options;
+        options.format = argc > 3 && argv[3] == "jsonl"s ? CorpusFormat::JSONL : CorpusFormat::TSV;
+        SearchServer search_server;
+        try {
+            const IngestStats stats = IngestCorpus(search_server, argv[2], options);
+            cout << "Documents: "s << stats.document_count << ", "s << stats.byte_count / (1024 * 1024) << " MiB in "s
+                << stats.duration.count() << " s: "s << stats.GetDocumentsPerSecond() << " documents/s, "s
+                << stats.GetMegabytesPerSecond() << " MiB/s"s << endl;
+        }
+        catch (const exception& e) {
+            cerr << "Ingest failed: "s << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
     SearchServer search_server("and with"s);
 
     int id = 0;